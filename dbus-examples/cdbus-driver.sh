@@ -25,6 +25,16 @@ type_enum='uint32'
 # List all window ID compton manages (except destroyed ones)
 dbus-send --print-reply --dest="$service" "$object" "${interface}.list_win"
 
+# Get the state of all mapped windows at once, along with the current generation
+generation=$(dbus-send --print-reply --dest="$service" "$object" "${interface}.win_state_all" boolean:true | $SED -n 's/^[[:space:]]*uint64[[:space:]]*\([[:digit:]]*\).*/\1/p' | head -n 1)
+
+# Get the windows changed or destroyed since then
+dbus-send --print-reply --dest="$service" "$object" "${interface}.win_state_changes" "uint64:${generation}"
+
+# Get how much work each window causes per second: damage events, damaged pixels,
+# milliseconds spent blurring, composing and shadowing it, and pixmap rebinds
+dbus-send --print-reply --dest="$service" "$object" "${interface}.win_stats"
+
 # Get window ID of currently focused window
 focused=$(dbus-send --print-reply --dest="$service" "$object" "${interface}.find_win" string:focused | $SED -n 's/^[[:space:]]*'${type_win}'[[:space:]]*\([[:digit:]]*\).*/\1/p')
 
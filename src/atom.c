@@ -23,12 +23,38 @@ static inline void *atom_getter(void *ud, const char *atom_name, int *err) {
 	return (void *)(intptr_t)atom;
 }
 
+#define ATOM_NAME(x) #x
+static const char *const predefined_atoms[] = {
+    LIST_APPLY(ATOM_NAME, SEP_COMMA, ATOM_LIST1),
+    LIST_APPLY(ATOM_NAME, SEP_COMMA, ATOM_LIST2),
+};
+#undef ATOM_NAME
+
 /**
  * Create a new atom structure and fetch all predefined atoms
  */
 struct atom *init_atoms(xcb_connection_t *c) {
 	auto atoms = ccalloc(1, struct atom);
 	atoms->c = new_cache((void *)c, atom_getter, NULL);
+
+	// Send all the requests before waiting for any reply, so fetching the
+	// predefined atoms only takes one round trip.
+	xcb_intern_atom_cookie_t cookies[ARR_SIZE(predefined_atoms)];
+	for (size_t i = 0; i < ARR_SIZE(predefined_atoms); i++) {
+		auto len = to_u16_checked(strlen(predefined_atoms[i]));
+		cookies[i] = xcb_intern_atom(c, 0, len, predefined_atoms[i]);
+	}
+	for (size_t i = 0; i < ARR_SIZE(predefined_atoms); i++) {
+		auto reply = xcb_intern_atom_reply(c, cookies[i], NULL);
+		if (!reply) {
+			// Leave it to cache_get to try again and report the error
+			continue;
+		}
+		log_debug("Atom %s is %d", predefined_atoms[i], reply->atom);
+		cache_set(atoms->c, predefined_atoms[i], (void *)(intptr_t)reply->atom);
+		free(reply);
+	}
+
 #define ATOM_GET(x) atoms->a##x = (xcb_atom_t)(intptr_t)cache_get(atoms->c, #x, NULL)
 	LIST_APPLY(ATOM_GET, SEP_COLON, ATOM_LIST1);
 	LIST_APPLY(ATOM_GET, SEP_COLON, ATOM_LIST2);
@@ -4,6 +4,7 @@
 #include <xcb/xcb.h>
 
 #include "backend/backend.h"
+#include "backend/command_list.h"
 #include "common.h"
 #include "compiler.h"
 #include "config.h"
@@ -13,7 +14,7 @@
 #include "win.h"
 #include "x.h"
 
-extern struct backend_operations xrender_ops, dummy_ops;
+extern struct backend_operations xrender_ops, dummy_ops, pixman_ops;
 #ifdef CONFIG_OPENGL
 extern struct backend_operations glx_ops;
 #endif
@@ -21,6 +22,7 @@ extern struct backend_operations glx_ops;
 struct backend_operations *backend_list[NUM_BKEND] = {
     [BKEND_XRENDER] = &xrender_ops,
     [BKEND_DUMMY] = &dummy_ops,
+    [BKEND_PIXMAN] = &pixman_ops,
 #ifdef CONFIG_OPENGL
     [BKEND_GLX] = &glx_ops,
 #endif
@@ -39,20 +41,215 @@ region_t get_damage(session_t *ps, bool all_damage) {
 	}
 
 	pixman_region32_init(&region);
-	if (buffer_age == -1 || buffer_age > ps->ndamage) {
+	if (buffer_age < 1 || buffer_age > ps->ndamage) {
 		pixman_region32_copy(&region, &ps->screen_reg);
 	} else {
-		for (int i = 0; i < buffer_age; i++) {
-			auto curr = ((ps->damage - ps->damage_ring) + i) % ps->ndamage;
-			log_trace("damage index: %d, damage ring offset: %ld", i, curr);
-			dump_region(&ps->damage_ring[curr]);
-			pixman_region32_union(&region, &region, &ps->damage_ring[curr]);
-		}
-		pixman_region32_intersect(&region, &region, &ps->screen_reg);
+		// Entries of the damage ring are already unions of all damage since a
+		// given age
+		auto curr =
+		    ((ps->damage - ps->damage_ring) + buffer_age - 1) % ps->ndamage;
+		log_trace("buffer age: %d, damage ring offset: %ld", buffer_age, curr);
+		dump_region(&ps->damage_ring[curr]);
+		pixman_region32_intersect(&region, &ps->damage_ring[curr],
+		                          &ps->screen_reg);
 	}
 	return region;
 }
 
+/// The window statistic the time spent on a command is added to
+static enum win_stat win_stat_of_command(enum backend_command_op op) {
+	switch (op) {
+	case BACKEND_COMMAND_BLUR: return WIN_STAT_BLUR_TIME;
+	case BACKEND_COMMAND_SHADOW: return WIN_STAT_SHADOW_TIME;
+	default: return WIN_STAT_COMPOSE_TIME;
+	}
+}
+
+/// Blur the background of a window
+static void paint_blur(session_t *ps, struct managed_win *w,
+                       const struct backend_command *cmd, const region_t *reg_paint,
+                       const region_t *reg_paint_in_bound, const region_t *reg_visible) {
+	if (!cmd->frame_only) {
+		// We need to blur the bounding shape of the window
+		// (reg_paint_in_bound = reg_bound \cap reg_paint)
+		ps->backend_data->ops->blur(ps->backend_data, cmd->opacity,
+		                            ps->backend_blur_context, reg_paint_in_bound,
+		                            reg_visible);
+		return;
+	}
+
+	// Window itself is solid, we only need to blur the frame
+	// region
+
+	// Readability assertions
+	assert(ps->o.blur_background_frame);
+	assert(w->mode == WMODE_FRAME_TRANS);
+
+	auto reg_blur = win_get_region_frame_local_by_val(w);
+	pixman_region32_translate(&reg_blur, w->g.x, w->g.y);
+	// make sure reg_blur \in reg_paint
+	pixman_region32_intersect(&reg_blur, &reg_blur, (region_t *)reg_paint);
+	if (ps->o.transparent_clipping) {
+		// ref: <transparent-clipping-note>
+		pixman_region32_intersect(&reg_blur, &reg_blur, (region_t *)reg_visible);
+	}
+	ps->backend_data->ops->blur(ps->backend_data, cmd->opacity,
+	                            ps->backend_blur_context, &reg_blur, reg_visible);
+	pixman_region32_fini(&reg_blur);
+}
+
+/// Draw the shadow of a window on target
+static void paint_shadow(session_t *ps, struct managed_win *w,
+                         const struct backend_command *cmd, const region_t *reg_bound,
+                         const region_t *reg_paint, const region_t *reg_visible) {
+	assert(!(w->flags & WIN_FLAGS_SHADOW_NONE));
+	// Clip region for the shadow
+	// reg_shadow \in reg_paint
+	auto reg_shadow = win_extents_by_val(w);
+	pixman_region32_intersect(&reg_shadow, &reg_shadow, (region_t *)reg_paint);
+	if (!ps->o.wintype_option[w->window_type].full_shadow) {
+		pixman_region32_subtract(&reg_shadow, &reg_shadow, (region_t *)reg_bound);
+	}
+
+	// Mask out the region we don't want shadow on
+	if (pixman_region32_not_empty(&ps->shadow_exclude_reg)) {
+		pixman_region32_subtract(&reg_shadow, &reg_shadow,
+		                         &ps->shadow_exclude_reg);
+	}
+
+	if (ps->o.xinerama_shadow_crop && cmd->xinerama_scr >= 0 &&
+	    cmd->xinerama_scr < ps->xinerama_nscrs) {
+		// There can be a window where number of screens is
+		// updated, but the screen number attached to the windows
+		// have not.
+		//
+		// Window screen number will be updated eventually, so
+		// here we just check to make sure we don't access out of
+		// bounds.
+		pixman_region32_intersect(&reg_shadow, &reg_shadow,
+		                          &ps->xinerama_scr_regs[cmd->xinerama_scr]);
+	}
+
+	if (ps->o.transparent_clipping) {
+		// ref: <transparent-clipping-note>
+		pixman_region32_intersect(&reg_shadow, &reg_shadow,
+		                          (region_t *)reg_visible);
+	}
+
+	if (w->shadow_resize_pending) {
+		// The shadow image still has the size from before the resize
+		region_t reg_image;
+		pixman_region32_init_rect(&reg_image, cmd->dst_x, cmd->dst_y,
+		                          (uint)w->shadow_image_width,
+		                          (uint)w->shadow_image_height);
+		pixman_region32_intersect(&reg_shadow, &reg_shadow, &reg_image);
+		pixman_region32_fini(&reg_image);
+	}
+
+	assert(cmd->image);
+	if (cmd->opacity == 1) {
+		ps->backend_data->ops->compose(ps->backend_data, w, cmd->image, NULL,
+		                               cmd->dst_x, cmd->dst_y, &reg_shadow,
+		                               reg_visible);
+	} else {
+		auto new_img = ps->backend_data->ops->copy(ps->backend_data, cmd->image,
+		                                           reg_visible);
+		ps->backend_data->ops->image_op(
+		    ps->backend_data, IMAGE_OP_APPLY_ALPHA_ALL, new_img, NULL,
+		    reg_visible, (double[]){cmd->opacity});
+		ps->backend_data->ops->compose(ps->backend_data, w, new_img, NULL,
+		                               cmd->dst_x, cmd->dst_y, &reg_shadow,
+		                               reg_visible);
+		ps->backend_data->ops->release_image(ps->backend_data, new_img);
+	}
+	pixman_region32_fini(&reg_shadow);
+}
+
+/// Draw a window on target
+///
+/// @param mask       mask to paint the window with, can be NULL
+/// @param reg_clip   the clip region of the window, in target coordinates
+static void paint_window(session_t *ps, struct managed_win *w,
+                         const struct backend_command *cmd, void *mask,
+                         const region_t *reg_bound, const region_t *reg_paint,
+                         const region_t *reg_clip, const region_t *reg_visible) {
+	// Set max brightness
+	if (ps->o.max_brightness < 1.0) {
+		ps->backend_data->ops->image_op(ps->backend_data, IMAGE_OP_MAX_BRIGHTNESS,
+		                                cmd->image, NULL, reg_visible,
+		                                &ps->o.max_brightness);
+	}
+
+	if (!cmd->invert_color && cmd->dim == 0 && cmd->frame_opacity == 1 &&
+	    cmd->opacity == 1) {
+		ps->backend_data->ops->compose(ps->backend_data, w, cmd->image, mask,
+		                               cmd->dst_x, cmd->dst_y, reg_clip,
+		                               reg_visible);
+		return;
+	}
+	if (cmd->opacity * MAX_ALPHA < 1) {
+		// We don't need to paint the window body itself if it's
+		// completely transparent.
+		return;
+	}
+
+	// For window image processing, we don't have to limit the process
+	// region to damage for correctness. (see <damager-note> for
+	// details)
+
+	// The bounding shape, in window local coordinates
+	region_t reg_bound_local;
+	pixman_region32_init(&reg_bound_local);
+	pixman_region32_copy(&reg_bound_local, (region_t *)reg_bound);
+	pixman_region32_translate(&reg_bound_local, -cmd->dst_x, -cmd->dst_y);
+
+	// The visible region, in window local coordinates
+	// Although we don't limit process region to damage, we provide
+	// that info in reg_visible as a hint. Since window image data
+	// outside of the damage region won't be painted onto target
+	region_t reg_visible_local;
+	pixman_region32_init(&reg_visible_local);
+	pixman_region32_intersect(&reg_visible_local, (region_t *)reg_visible,
+	                          (region_t *)reg_paint);
+	pixman_region32_translate(&reg_visible_local, -cmd->dst_x, -cmd->dst_y);
+	// Data outside of the bounding shape won't be visible, but it is
+	// not necessary to limit the image operations to the bounding
+	// shape yet. So pass that as the visible region, not the clip
+	// region.
+	pixman_region32_intersect(&reg_visible_local, &reg_visible_local,
+	                          &reg_bound_local);
+
+	auto new_img =
+	    ps->backend_data->ops->copy(ps->backend_data, cmd->image, &reg_visible_local);
+	if (cmd->invert_color) {
+		ps->backend_data->ops->image_op(ps->backend_data,
+		                                IMAGE_OP_INVERT_COLOR_ALL, new_img,
+		                                NULL, &reg_visible_local, NULL);
+	}
+	if (cmd->dim != 0) {
+		ps->backend_data->ops->image_op(ps->backend_data, IMAGE_OP_DIM_ALL,
+		                                new_img, NULL, &reg_visible_local,
+		                                (double[]){cmd->dim});
+	}
+	if (cmd->frame_opacity != 1) {
+		auto reg_frame = win_get_region_frame_local_by_val(w);
+		ps->backend_data->ops->image_op(ps->backend_data, IMAGE_OP_APPLY_ALPHA,
+		                                new_img, &reg_frame, &reg_visible_local,
+		                                (double[]){cmd->frame_opacity});
+		pixman_region32_fini(&reg_frame);
+	}
+	if (cmd->opacity != 1) {
+		ps->backend_data->ops->image_op(
+		    ps->backend_data, IMAGE_OP_APPLY_ALPHA_ALL, new_img, NULL,
+		    &reg_visible_local, (double[]){cmd->opacity});
+	}
+	ps->backend_data->ops->compose(ps->backend_data, w, new_img, mask, cmd->dst_x,
+	                               cmd->dst_y, reg_clip, reg_visible);
+	ps->backend_data->ops->release_image(ps->backend_data, new_img);
+	pixman_region32_fini(&reg_visible_local);
+	pixman_region32_fini(&reg_bound_local);
+}
+
 /// paint all windows
 void paint_all_new(session_t *ps, struct managed_win *t, bool ignore_damage) {
 	if (ps->o.xrender_sync_fence) {
@@ -81,6 +278,18 @@ void paint_all_new(session_t *ps, struct managed_win *t, bool ignore_damage) {
 		return;
 	}
 
+	auto cmds = &ps->frame_commands;
+	command_list_build(ps, t, cmds);
+	if (command_list_diff(&ps->last_frame_commands, cmds) && !cmds->content_damaged &&
+	    !ignore_damage && !ps->o.monitor_repaint) {
+		// The damage came from windows we don't paint, so this frame would be
+		// identical to the one on screen. Don't render or present it.
+		log_trace("Frame unchanged, skipping");
+		pixman_region32_clear(ps->damage);
+		pixman_region32_fini(&reg_damage);
+		return;
+	}
+
 #ifdef DEBUG_REPAINT
 	static struct timespec last_paint = {0};
 #endif
@@ -133,7 +342,6 @@ void paint_all_new(session_t *ps, struct managed_win *t, bool ignore_damage) {
 	// backend can optimize based on this info
 	region_t reg_visible;
 	pixman_region32_init(&reg_visible);
-	pixman_region32_copy(&reg_visible, &ps->screen_reg);
 	if (t && !ps->o.transparent_clipping) {
 		// Calculate the region upon which the root window (wallpaper) is to be
 		// painted based on the ignore region of the lowest window, if available
@@ -141,16 +349,32 @@ void paint_all_new(session_t *ps, struct managed_win *t, bool ignore_damage) {
 		// NOTE If transparent_clipping is enabled, transparent windows are
 		// included in the reg_ignore, but we still want to have the wallpaper
 		// beneath them, so we don't use reg_ignore for wallpaper in that case.
-		pixman_region32_subtract(&reg_visible, &reg_visible, t->reg_ignore);
+		pixman_region32_subtract(&reg_visible, &ps->screen_reg, t->reg_ignore);
+	} else {
+		pixman_region32_copy(&reg_visible, &ps->screen_reg);
+	}
+
+	// Windows that aren't painted keep their damage until they are
+	if (ps->backend_data->ops->image_damaged) {
+		for (auto w = t; w; w = w->prev_trans) {
+			if (w->win_image &&
+			    pixman_region32_not_empty(&w->pixmap_damage)) {
+				ps->backend_data->ops->image_damaged(
+				    ps->backend_data, w->win_image, &w->pixmap_damage);
+			}
+			pixman_region32_clear(&w->pixmap_damage);
+		}
 	}
 
 	if (ps->backend_data->ops->prepare) {
 		ps->backend_data->ops->prepare(ps->backend_data, &reg_paint);
 	}
 
-	if (ps->root_image) {
-		ps->backend_data->ops->compose(ps->backend_data, t, ps->root_image, 0, 0,
-		                               &reg_paint, &reg_visible);
+	auto root_cmd = &cmds->cmds[0];
+	assert(root_cmd->op == BACKEND_COMMAND_ROOT);
+	if (root_cmd->image) {
+		ps->backend_data->ops->compose(ps->backend_data, t, root_cmd->image, NULL,
+		                               0, 0, &reg_paint, &reg_visible);
 	} else {
 		ps->backend_data->ops->fill(ps->backend_data, (struct color){0, 0, 0, 1},
 		                            &reg_paint);
@@ -161,7 +385,21 @@ void paint_all_new(session_t *ps, struct managed_win *t, bool ignore_damage) {
 	// on top of that window. This is used to reduce the number of pixels painted.
 	//
 	// Whether this is beneficial is to be determined XXX
-	for (auto w = t; w; w = w->prev_trans) {
+	for (int i = 1; i < cmds->ncmds;) {
+		// Commands of the same window are next to each other
+		auto w = cmds->cmds[i].w;
+		int end = i;
+		while (end < cmds->ncmds && cmds->cmds[end].w == w) {
+			end++;
+		}
+		if (command_list_can_skip(cmds, i, end, &reg_paint)) {
+			// This window is painted exactly like last frame, and none of it
+			// is in the damaged region. Skipping it entirely saves us the
+			// image copies and image operations below.
+			i = end;
+			continue;
+		}
+
 		pixman_region32_subtract(&reg_visible, &ps->screen_reg, w->reg_ignore);
 		assert(!(w->flags & WIN_FLAGS_IMAGE_ERROR));
 		assert(!(w->flags & WIN_FLAGS_PIXMAP_STALE));
@@ -188,232 +426,90 @@ void paint_all_new(session_t *ps, struct managed_win *t, bool ignore_damage) {
 			                          &reg_paint_in_bound, &reg_visible);
 		}
 
-		// Store the window background for rounded corners
-		// If rounded corners backup the region first
-		if (w->corner_radius > 0) {
-			const int16_t x = w->g.x;
-			const int16_t y = w->g.y;
-			const auto wid = to_u16_checked(w->widthb);
-			const auto hei = to_u16_checked(w->heightb);
-			ps->backend_data->ops->store_back_texture(ps->backend_data, w,
-							ps->backend_round_context, &reg_bound, x, y, wid, hei);
-		}
-
-		// Blur window background
-		/* TODO(yshui) since the backend might change the content of the window
-		 * (e.g. with shaders), we should consult the backend whether the window
-		 * is transparent or not. for now we will just rely on the force_win_blend
-		 * option */
-		auto real_win_mode = w->mode;
-
-		if (w->blur_background &&
-		    (ps->o.force_win_blend || real_win_mode == WMODE_TRANS ||
-		     (ps->o.blur_background_frame && real_win_mode == WMODE_FRAME_TRANS))) {
-			// Minimize the region we try to blur, if the window
-			// itself is not opaque, only the frame is.
-
-			double blur_opacity = 1;
-			if (w->opacity < (1.0 / MAX_ALPHA)) {
-				// Hide blur for fully transparent windows.
-				blur_opacity = 0;
-			} else if (w->state == WSTATE_MAPPING) {
-				// Gradually increase the blur intensity during
-				// fading in.
-				assert(w->opacity <= w->opacity_target);
-				blur_opacity = w->opacity / w->opacity_target;
-			} else if (w->state == WSTATE_UNMAPPING ||
-			           w->state == WSTATE_DESTROYING) {
-				// Gradually decrease the blur intensity during
-				// fading out.
-				assert(w->opacity <= w->opacity_target_old);
-				blur_opacity = w->opacity / w->opacity_target_old;
-			} else if (w->state == WSTATE_FADING) {
-				if (w->opacity < w->opacity_target &&
-				    w->opacity_target_old < (1.0 / MAX_ALPHA)) {
-					// Gradually increase the blur intensity during
-					// fading in.
-					assert(w->opacity <= w->opacity_target);
-					blur_opacity = w->opacity / w->opacity_target;
-				} else if (w->opacity > w->opacity_target &&
-				           w->opacity_target < (1.0 / MAX_ALPHA)) {
-					// Gradually decrease the blur intensity during
-					// fading out.
-					assert(w->opacity <= w->opacity_target_old);
-					blur_opacity = w->opacity / w->opacity_target_old;
-				}
-			}
-			assert(blur_opacity >= 0 && blur_opacity <= 1);
-
-			if (real_win_mode == WMODE_TRANS || ps->o.force_win_blend) {
-				// We need to blur the bounding shape of the window
-				// (reg_paint_in_bound = reg_bound \cap reg_paint)
-				ps->backend_data->ops->blur(
-				    ps->backend_data, blur_opacity, ps->backend_blur_context,
-				    &reg_paint_in_bound, &reg_visible);
-			} else {
-				// Window itself is solid, we only need to blur the frame
-				// region
-
-				// Readability assertions
-				assert(ps->o.blur_background_frame);
-				assert(real_win_mode == WMODE_FRAME_TRANS);
-
-				auto reg_blur = win_get_region_frame_local_by_val(w);
-				pixman_region32_translate(&reg_blur, w->g.x, w->g.y);
-				// make sure reg_blur \in reg_paint
-				pixman_region32_intersect(&reg_blur, &reg_blur, &reg_paint);
-				if (ps->o.transparent_clipping) {
-					// ref: <transparent-clipping-note>
-					pixman_region32_intersect(&reg_blur, &reg_blur,
-					                          &reg_visible);
-				}
-				ps->backend_data->ops->blur(ps->backend_data, blur_opacity,
-				                            ps->backend_blur_context,
-				                            &reg_blur, &reg_visible);
-				pixman_region32_fini(&reg_blur);
-			}
+		// The part of the window the window image covers. While a resize is
+		// pending, the image still has the size from before the resize, nothing
+		// outside of it can be read.
+		region_t reg_win;
+		pixman_region32_init_rect(&reg_win, w->g.x, w->g.y,
+		                          (uint)min2(w->widthb, w->image_width),
+		                          (uint)min2(w->heightb, w->image_height));
+		const region_t *reg_image_bound = &reg_bound;
+		region_t reg_bound_clipped;
+		pixman_region32_init(&reg_bound_clipped);
+		if (w->resize_pending) {
+			pixman_region32_intersect(&reg_bound_clipped, &reg_bound,
+			                          &reg_win);
+			reg_image_bound = &reg_bound_clipped;
 		}
 
-		// Draw shadow on target
-		if (w->shadow) {
-			assert(!(w->flags & WIN_FLAGS_SHADOW_NONE));
-			// Clip region for the shadow
-			// reg_shadow \in reg_paint
-			auto reg_shadow = win_extents_by_val(w);
-			pixman_region32_intersect(&reg_shadow, &reg_shadow, &reg_paint);
-			if (!ps->o.wintype_option[w->window_type].full_shadow) {
-				pixman_region32_subtract(&reg_shadow, &reg_shadow, &reg_bound);
-			}
-
-			// Mask out the region we don't want shadow on
-			if (pixman_region32_not_empty(&ps->shadow_exclude_reg)) {
-				pixman_region32_subtract(&reg_shadow, &reg_shadow,
-				                         &ps->shadow_exclude_reg);
-			}
-
-			if (ps->o.xinerama_shadow_crop && w->xinerama_scr >= 0 &&
-			    w->xinerama_scr < ps->xinerama_nscrs) {
-				// There can be a window where number of screens is
-				// updated, but the screen number attached to the windows
-				// have not.
-				//
-				// Window screen number will be updated eventually, so
-				// here we just check to make sure we don't access out of
-				// bounds.
-				pixman_region32_intersect(
-				    &reg_shadow, &reg_shadow,
-				    &ps->xinerama_scr_regs[w->xinerama_scr]);
-			}
-
+		// Windows with a complex bounding shape are painted through a mask. So
+		// the window itself can be clipped to its rectangle, which has far
+		// fewer rectangles than its bounding shape.
+		const region_t *reg_compose = &reg_paint_in_bound;
+		region_t reg_compose_clipped;
+		pixman_region32_init(&reg_compose_clipped);
+		if (w->shape_mask) {
+			pixman_region32_intersect(&reg_compose_clipped, &reg_win,
+			                          &reg_paint);
 			if (ps->o.transparent_clipping) {
 				// ref: <transparent-clipping-note>
-				pixman_region32_intersect(&reg_shadow, &reg_shadow,
+				pixman_region32_intersect(&reg_compose_clipped,
+				                          &reg_compose_clipped,
 				                          &reg_visible);
 			}
-
-			assert(w->shadow_image);
-			if (w->opacity == 1) {
-				ps->backend_data->ops->compose(
-				    ps->backend_data, w, w->shadow_image, w->g.x + w->shadow_dx,
-				    w->g.y + w->shadow_dy, &reg_shadow, &reg_visible);
-			} else {
-				auto new_img = ps->backend_data->ops->copy(
-				    ps->backend_data, w->shadow_image, &reg_visible);
-				ps->backend_data->ops->image_op(
-				    ps->backend_data, IMAGE_OP_APPLY_ALPHA_ALL, new_img,
-				    NULL, &reg_visible, (double[]){w->opacity});
-				ps->backend_data->ops->compose(
-				    ps->backend_data, w, new_img, w->g.x + w->shadow_dx,
-				    w->g.y + w->shadow_dy, &reg_shadow, &reg_visible);
-				ps->backend_data->ops->release_image(ps->backend_data, new_img);
-			}
-			pixman_region32_fini(&reg_shadow);
-		}
-
-		// Set max brightness
-		if (ps->o.max_brightness < 1.0) {
-			ps->backend_data->ops->image_op(
-			    ps->backend_data, IMAGE_OP_MAX_BRIGHTNESS, w->win_image, NULL,
-			    &reg_visible, &ps->o.max_brightness);
+			reg_compose = &reg_compose_clipped;
+		} else if (w->resize_pending) {
+			pixman_region32_intersect(&reg_compose_clipped,
+			                          &reg_paint_in_bound, &reg_win);
+			reg_compose = &reg_compose_clipped;
 		}
+		pixman_region32_fini(&reg_win);
 
-		// Draw window on target
-		if (!w->invert_color && !w->dim && w->frame_opacity == 1 && w->opacity == 1) {
-			ps->backend_data->ops->compose(ps->backend_data, w, w->win_image,
-			                               w->g.x, w->g.y,
-			                               &reg_paint_in_bound, &reg_visible);
-		} else if (w->opacity * MAX_ALPHA >= 1) {
-			// We don't need to paint the window body itself if it's
-			// completely transparent.
-
-			// For window image processing, we don't have to limit the process
-			// region to damage for correctness. (see <damager-note> for
-			// details)
-
-			// The bounding shape, in window local coordinates
-			region_t reg_bound_local;
-			pixman_region32_init(&reg_bound_local);
-			pixman_region32_copy(&reg_bound_local, &reg_bound);
-			pixman_region32_translate(&reg_bound_local, -w->g.x, -w->g.y);
-
-			// The visible region, in window local coordinates
-			// Although we don't limit process region to damage, we provide
-			// that info in reg_visible as a hint. Since window image data
-			// outside of the damage region won't be painted onto target
-			region_t reg_visible_local;
-			pixman_region32_init(&reg_visible_local);
-			pixman_region32_intersect(&reg_visible_local, &reg_visible, &reg_paint);
-			pixman_region32_translate(&reg_visible_local, -w->g.x, -w->g.y);
-			// Data outside of the bounding shape won't be visible, but it is
-			// not necessary to limit the image operations to the bounding
-			// shape yet. So pass that as the visible region, not the clip
-			// region.
-			pixman_region32_intersect(&reg_visible_local, &reg_visible_local,
-			                          &reg_bound_local);
-
-			auto new_img = ps->backend_data->ops->copy(
-			    ps->backend_data, w->win_image, &reg_visible_local);
-			if (w->invert_color) {
-				ps->backend_data->ops->image_op(
-				    ps->backend_data, IMAGE_OP_INVERT_COLOR_ALL, new_img,
-				    NULL, &reg_visible_local, NULL);
+		for (; i < end; i++) {
+			auto cmd = &cmds->cmds[i];
+			struct timespec cmd_start = {0};
+			if (ps->win_stats_enabled) {
+				cmd_start = get_time_timespec();
 			}
-			if (w->dim) {
-				double dim_opacity = ps->o.inactive_dim;
-				if (!ps->o.inactive_dim_fixed) {
-					dim_opacity *= w->opacity;
-				}
-				ps->backend_data->ops->image_op(
-				    ps->backend_data, IMAGE_OP_DIM_ALL, new_img, NULL,
-				    &reg_visible_local, (double[]){dim_opacity});
+			switch (cmd->op) {
+			case BACKEND_COMMAND_STORE_BACK:
+				// Store the window background for rounded corners
+				ps->backend_data->ops->store_back_texture(
+				    ps->backend_data, w, ps->backend_round_context,
+				    &reg_bound, to_i16_checked(cmd->dst_x),
+				    to_i16_checked(cmd->dst_y), to_u16_checked(w->widthb),
+				    to_u16_checked(w->heightb));
+				break;
+			case BACKEND_COMMAND_BLUR:
+				paint_blur(ps, w, cmd, &reg_paint, &reg_paint_in_bound,
+				           &reg_visible);
+				break;
+			case BACKEND_COMMAND_SHADOW:
+				paint_shadow(ps, w, cmd, &reg_bound, &reg_paint,
+				             &reg_visible);
+				break;
+			case BACKEND_COMMAND_COMPOSE:
+				paint_window(ps, w, cmd, w->shape_mask,
+				             reg_image_bound, &reg_paint, reg_compose,
+				             &reg_visible);
+				break;
+			case BACKEND_COMMAND_ROUND:
+				// Round the corners as last step after
+				// blur/shadow/dim/etc
+				ps->backend_data->ops->round(
+				    ps->backend_data, w, ps->backend_round_context,
+				    cmd->image, &reg_bound, &reg_visible);
+				break;
+			case BACKEND_COMMAND_ROOT: assert(false);
 			}
-			if (w->frame_opacity != 1) {
-				auto reg_frame = win_get_region_frame_local_by_val(w);
-				ps->backend_data->ops->image_op(
-				    ps->backend_data, IMAGE_OP_APPLY_ALPHA, new_img, &reg_frame,
-				    &reg_visible_local, (double[]){w->frame_opacity});
-				pixman_region32_fini(&reg_frame);
+			if (ps->win_stats_enabled) {
+				auto stat = win_stat_of_command(cmd->op);
+				win_stats_add_time(&w->stats, stat, cmd_start);
 			}
-			if (w->opacity != 1) {
-				ps->backend_data->ops->image_op(
-				    ps->backend_data, IMAGE_OP_APPLY_ALPHA_ALL, new_img,
-				    NULL, &reg_visible_local, (double[]){w->opacity});
-			}
-			ps->backend_data->ops->compose(ps->backend_data, w, new_img, w->g.x,
-			                               w->g.y, &reg_paint_in_bound,
-			                               &reg_visible);
-			ps->backend_data->ops->release_image(ps->backend_data, new_img);
-			pixman_region32_fini(&reg_visible_local);
-			pixman_region32_fini(&reg_bound_local);
-		}
-
-		// Round the corners as last step after blur/shadow/dim/etc
-		if (w->corner_radius > 0.0) {
-			ps->backend_data->ops->round(ps->backend_data, w,
-						ps->backend_round_context, w->win_image,
-						&reg_bound, &reg_visible);
 		}
 
+		pixman_region32_fini(&reg_compose_clipped);
+		pixman_region32_fini(&reg_bound_clipped);
 		pixman_region32_fini(&reg_bound);
 		pixman_region32_fini(&reg_paint_in_bound);
 	}
@@ -426,6 +522,15 @@ void paint_all_new(session_t *ps, struct managed_win *t, bool ignore_damage) {
 		pixman_region32_fini(&reg_damage_debug);
 	}
 
+	for (auto w = t; w; w = w->prev_trans) {
+		w->pixmap_damaged = false;
+	}
+	// Keep the commands of this frame to diff the next frame against
+	cmds->valid = true;
+	auto last_frame = ps->last_frame_commands;
+	ps->last_frame_commands = ps->frame_commands;
+	ps->frame_commands = last_frame;
+
 	// Move the head of the damage ring
 	ps->damage = ps->damage - 1;
 	if (ps->damage < ps->damage_ring) {
@@ -440,6 +545,7 @@ void paint_all_new(session_t *ps, struct managed_win *t, bool ignore_damage) {
 	}
 
 	pixman_region32_fini(&reg_damage);
+	pixman_region32_fini(&reg_visible);
 
 #ifdef DEBUG_REPAINT
 	struct timespec now = get_time_timespec();
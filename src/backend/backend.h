@@ -130,16 +130,32 @@ struct backend_operations {
 	/// Optional
 	void (*prepare)(backend_t *backend_data, const region_t *reg_damage);
 
+	/// Called before `prepare` for every image bound with `bind_pixmap` whose pixmap
+	/// was damaged since the last frame, for backends that keep anything derived
+	/// from the content of the pixmap.
+	///
+	/// @param image       the image bound to the damaged pixmap
+	/// @param reg_damage  the damaged part of the pixmap, in pixmap coordinates. It
+	///                    can reach past the pixmap.
+	///
+	/// Optional
+	void (*image_damaged)(backend_t *backend_data, void *image,
+	                      const region_t *reg_damage);
+
 	/**
 	 * Paint the content of an image onto the rendering buffer
 	 *
 	 * @param backend_data the backend data
 	 * @param image_data   the image to paint
+	 * @param mask         a mask created by `make_mask`, placed at the same position
+	 *                     as the image. Parts of the image outside of the mask are
+	 *                     not painted. Can be NULL.
 	 * @param dst_x, dst_y the top left corner of the image in the target
 	 * @param reg_paint    the clip region, in target coordinates
 	 * @param reg_visible the visible region, in target coordinates
 	 */
-	void (*compose)(backend_t *backend_data, struct managed_win *const w, void *image_data, int dst_x, int dst_y,
+	void (*compose)(backend_t *backend_data, struct managed_win *const w,
+	                void *image_data, void *mask, int dst_x, int dst_y,
 	                const region_t *reg_paint, const region_t *reg_visible);
 
 	/// Fill rectangle of the rendering buffer, mostly for debug purposes, optional.
@@ -181,6 +197,14 @@ struct backend_operations {
 	void *(*render_shadow)(backend_t *backend_data, int width, int height,
 	                       const conv *kernel, double r, double g, double b, double a);
 
+	/// Create a mask image of the given size, which is opaque inside `reg`, and
+	/// transparent everywhere else. Used in place of clip regions with too many
+	/// rectangles. The returned image is released with `release_image`.
+	///
+	/// Optional, returns NULL if masks are not supported.
+	void *(*make_mask)(backend_t *backend_data, int width, int height,
+	                   const region_t *reg);
+
 	// ============ Resource management ===========
 
 	/// Free resources associated with an image data structure
@@ -193,9 +193,10 @@ make_shadow(xcb_connection_t *c, const conv *kernel, double opacity, int width,
 /**
  * Generate shadow <code>Picture</code> for a window.
  */
-bool build_shadow(xcb_connection_t *c, xcb_drawable_t d, double opacity, const int width,
-                  const int height, const conv *kernel, xcb_render_picture_t shadow_pixel,
-                  xcb_pixmap_t *pixmap, xcb_render_picture_t *pict) {
+bool build_shadow(xcb_connection_t *c, struct x_shm_pool *shm_pool, xcb_drawable_t d,
+                  double opacity, const int width, const int height, const conv *kernel,
+                  xcb_render_picture_t shadow_pixel, xcb_pixmap_t *pixmap,
+                  xcb_render_picture_t *pict) {
 	xcb_image_t *shadow_image = NULL;
 	xcb_pixmap_t shadow_pixmap = XCB_NONE, shadow_pixmap_argb = XCB_NONE;
 	xcb_render_picture_t shadow_picture = XCB_NONE, shadow_picture_argb = XCB_NONE;
@@ -227,33 +228,12 @@ bool build_shadow(xcb_connection_t *c, xcb_drawable_t d, double opacity, const i
 	gc = x_new_id(c);
 	xcb_create_gc(c, gc, shadow_pixmap, 0, NULL);
 
-	// We need to make room for protocol metadata in the request. The metadata should
-	// be 24 bytes plus padding, let's be generous and give it 1kb
-	auto maximum_image_size = xcb_get_maximum_request_length(c) * 4 - 1024;
-	auto maximum_row =
-	    to_u16_checked(clamp(maximum_image_size / shadow_image->stride, 0, UINT16_MAX));
-	if (maximum_row <= 0) {
-		// TODO(yshui) Upload image with XShm
-		log_error("X server request size limit is too restrictive, or the shadow "
-		          "image is too wide for us to send a single row of the shadow "
-		          "image. Shadow size: %dx%d",
-		          width, height);
+	if (!x_put_image(c, shm_pool, shadow_pixmap, gc, shadow_image, 0, 0)) {
+		log_error("Failed to upload shadow image. Shadow size: %dx%d", width,
+		          height);
 		goto shadow_picture_err;
 	}
 
-	for (uint32_t row = 0; row < shadow_image->height; row += maximum_row) {
-		auto batch_height = maximum_row;
-		if (batch_height > shadow_image->height - row) {
-			batch_height = to_u16_checked(shadow_image->height - row);
-		}
-
-		uint32_t offset = row * shadow_image->stride / sizeof(*shadow_image->data);
-		xcb_put_image(c, (uint8_t)shadow_image->format, shadow_pixmap, gc,
-		              shadow_image->width, batch_height, 0, to_i16_checked(row),
-		              0, shadow_image->depth, shadow_image->stride * batch_height,
-		              shadow_image->data + offset);
-	}
-
 	xcb_render_composite(c, XCB_RENDER_PICT_OP_SRC, shadow_pixel, shadow_picture,
 	                     shadow_picture_argb, 0, 0, 0, 0, 0, 0, shadow_image->width,
 	                     shadow_image->height);
@@ -299,8 +279,9 @@ default_backend_render_shadow(backend_t *backend_data, int width, int height,
 	             shadow = XCB_NONE;
 	xcb_render_picture_t pict = XCB_NONE;
 
-	if (!build_shadow(backend_data->c, backend_data->root, a, width, height, kernel,
-	                  shadow_pixel, &shadow, &pict)) {
+	if (!build_shadow(backend_data->c, &backend_data->ps->shm_pool,
+	                  backend_data->root, a, width, height, kernel, shadow_pixel,
+	                  &shadow, &pict)) {
 		return NULL;
 	}
 
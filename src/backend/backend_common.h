@@ -15,6 +15,7 @@ typedef struct win win;
 typedef struct conv conv;
 typedef struct backend_base backend_t;
 struct backend_operations;
+struct x_shm_pool;
 
 struct dual_kawase_params {
 	/// Number of downsample passes
@@ -25,9 +26,12 @@ struct dual_kawase_params {
 	int expand;
 };
 
-bool build_shadow(xcb_connection_t *, xcb_drawable_t, double opacity, int width,
-                  int height, const conv *kernel, xcb_render_picture_t shadow_pixel,
-                  xcb_pixmap_t *pixmap, xcb_render_picture_t *pict);
+/// Generate shadow picture for a window. The shadow image is uploaded through
+/// `shm_pool` when possible, which can be NULL.
+bool build_shadow(xcb_connection_t *, struct x_shm_pool *shm_pool, xcb_drawable_t,
+                  double opacity, int width, int height, const conv *kernel,
+                  xcb_render_picture_t shadow_pixel, xcb_pixmap_t *pixmap,
+                  xcb_render_picture_t *pict);
 
 xcb_render_picture_t solid_picture(xcb_connection_t *, xcb_drawable_t, bool argb,
                                    double a, double r, double g, double b);
@@ -0,0 +1,243 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (c) Yuxuan Shui <yshuiv7@gmail.com>
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <test.h>
+
+#include "backend/command_list.h"
+#include "common.h"
+#include "compiler.h"
+#include "config.h"
+#include "region.h"
+#include "utils.h"
+#include "win.h"
+
+static struct backend_command *
+command_list_push(struct command_list *cmds, enum backend_command_op op,
+                  struct managed_win *w) {
+	if (cmds->ncmds == cmds->capacity) {
+		cmds->capacity = cmds->capacity ? cmds->capacity * 2 : 16;
+		cmds->cmds = crealloc(cmds->cmds, cmds->capacity);
+	}
+	auto ret = &cmds->cmds[cmds->ncmds++];
+	*ret = (struct backend_command){
+	    .op = op,
+	    .w = w,
+	    .wid = w ? w->base.id : XCB_NONE,
+	};
+	return ret;
+}
+
+/// Opacity of the background blur of a window, taking fading into account
+static double win_blur_opacity(const struct managed_win *w) {
+	double blur_opacity = 1;
+	if (w->opacity < (1.0 / MAX_ALPHA)) {
+		// Hide blur for fully transparent windows.
+		blur_opacity = 0;
+	} else if (w->state == WSTATE_MAPPING) {
+		// Gradually increase the blur intensity during
+		// fading in.
+		assert(w->opacity <= w->opacity_target);
+		blur_opacity = w->opacity / w->opacity_target;
+	} else if (w->state == WSTATE_UNMAPPING || w->state == WSTATE_DESTROYING) {
+		// Gradually decrease the blur intensity during
+		// fading out.
+		assert(w->opacity <= w->opacity_target_old);
+		blur_opacity = w->opacity / w->opacity_target_old;
+	} else if (w->state == WSTATE_FADING) {
+		if (w->opacity < w->opacity_target &&
+		    w->opacity_target_old < (1.0 / MAX_ALPHA)) {
+			// Gradually increase the blur intensity during
+			// fading in.
+			assert(w->opacity <= w->opacity_target);
+			blur_opacity = w->opacity / w->opacity_target;
+		} else if (w->opacity > w->opacity_target &&
+		           w->opacity_target < (1.0 / MAX_ALPHA)) {
+			// Gradually decrease the blur intensity during
+			// fading out.
+			assert(w->opacity <= w->opacity_target_old);
+			blur_opacity = w->opacity / w->opacity_target_old;
+		}
+	}
+	assert(blur_opacity >= 0 && blur_opacity <= 1);
+	return blur_opacity;
+}
+
+void command_list_build(session_t *ps, struct managed_win *t, struct command_list *cmds) {
+	cmds->ncmds = 0;
+	cmds->content_damaged = false;
+	cmds->valid = false;
+
+	auto root = command_list_push(cmds, BACKEND_COMMAND_ROOT, NULL);
+	root->image = ps->root_image;
+	root->extents = *pixman_region32_extents(&ps->screen_reg);
+
+	for (auto w = t; w; w = w->prev_trans) {
+		// reminder: bounding shape contains the WM frame
+		const rect_t bound = {
+		    .x1 = w->g.x,
+		    .y1 = w->g.y,
+		    .x2 = w->g.x + w->widthb,
+		    .y2 = w->g.y + w->heightb,
+		};
+		cmds->content_damaged = cmds->content_damaged || w->pixmap_damaged;
+
+		if (w->corner_radius > 0) {
+			auto cmd = command_list_push(cmds, BACKEND_COMMAND_STORE_BACK, w);
+			cmd->dst_x = w->g.x;
+			cmd->dst_y = w->g.y;
+			cmd->extents = bound;
+			cmd->corner_radius = w->corner_radius;
+		}
+
+		/* TODO(yshui) since the backend might change the content of the window
+		 * (e.g. with shaders), we should consult the backend whether the window
+		 * is transparent or not. for now we will just rely on the force_win_blend
+		 * option */
+		if (w->blur_background &&
+		    (ps->o.force_win_blend || w->mode == WMODE_TRANS ||
+		     (ps->o.blur_background_frame && w->mode == WMODE_FRAME_TRANS))) {
+			auto cmd = command_list_push(cmds, BACKEND_COMMAND_BLUR, w);
+			cmd->extents = bound;
+			cmd->opacity = win_blur_opacity(w);
+			cmd->frame_only =
+			    !ps->o.force_win_blend && w->mode != WMODE_TRANS;
+		}
+
+		if (w->shadow) {
+			auto cmd = command_list_push(cmds, BACKEND_COMMAND_SHADOW, w);
+			cmd->image = w->shadow_image;
+			cmd->dst_x = w->g.x + w->shadow_dx;
+			cmd->dst_y = w->g.y + w->shadow_dy;
+			cmd->extents = (rect_t){
+			    .x1 = cmd->dst_x,
+			    .y1 = cmd->dst_y,
+			    .x2 = cmd->dst_x + w->shadow_width,
+			    .y2 = cmd->dst_y + w->shadow_height,
+			};
+			cmd->opacity = w->opacity;
+			cmd->xinerama_scr = w->xinerama_scr;
+		}
+
+		auto cmd = command_list_push(cmds, BACKEND_COMMAND_COMPOSE, w);
+		cmd->image = w->win_image;
+		cmd->dst_x = w->g.x;
+		cmd->dst_y = w->g.y;
+		cmd->extents = bound;
+		cmd->opacity = w->opacity;
+		cmd->frame_opacity = w->frame_opacity;
+		cmd->invert_color = w->invert_color;
+		if (w->dim) {
+			cmd->dim = ps->o.inactive_dim;
+			if (!ps->o.inactive_dim_fixed) {
+				cmd->dim *= w->opacity;
+			}
+		}
+
+		if (w->corner_radius > 0) {
+			cmd = command_list_push(cmds, BACKEND_COMMAND_ROUND, w);
+			cmd->image = w->win_image;
+			cmd->dst_x = w->g.x;
+			cmd->dst_y = w->g.y;
+			cmd->extents = bound;
+			cmd->corner_radius = w->corner_radius;
+		}
+	}
+}
+
+static bool
+command_equal(const struct backend_command *a, const struct backend_command *b) {
+	return a->op == b->op && a->wid == b->wid && a->image == b->image &&
+	       a->dst_x == b->dst_x && a->dst_y == b->dst_y &&
+	       a->extents.x1 == b->extents.x1 && a->extents.y1 == b->extents.y1 &&
+	       a->extents.x2 == b->extents.x2 && a->extents.y2 == b->extents.y2 &&
+	       a->opacity == b->opacity && a->dim == b->dim &&
+	       a->frame_opacity == b->frame_opacity &&
+	       a->corner_radius == b->corner_radius &&
+	       a->xinerama_scr == b->xinerama_scr &&
+	       a->invert_color == b->invert_color && a->frame_only == b->frame_only;
+}
+
+bool command_list_diff(const struct command_list *prev, struct command_list *curr) {
+	bool identical = prev->valid && prev->ncmds == curr->ncmds;
+	for (int i = 0; i < curr->ncmds; i++) {
+		// Commands are compared position by position. A restack shifts all
+		// commands above it, which are then simply treated as changed.
+		curr->cmds[i].unchanged = prev->valid && i < prev->ncmds &&
+		                          command_equal(&prev->cmds[i], &curr->cmds[i]);
+		identical = identical && curr->cmds[i].unchanged;
+	}
+	return identical;
+}
+
+bool command_list_can_skip(const struct command_list *cmds, int begin, int end,
+                           const region_t *reg_paint) {
+	for (int i = begin; i < end; i++) {
+		auto cmd = &cmds->cmds[i];
+		if (!cmd->unchanged) {
+			return false;
+		}
+		if (pixman_region32_contains_rectangle((region_t *)reg_paint,
+		                                       (rect_t *)&cmd->extents) !=
+		    PIXMAN_REGION_OUT) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void command_list_deinit(struct command_list *cmds) {
+	free(cmds->cmds);
+	*cmds = (struct command_list){0};
+}
+
+TEST_CASE(command_list_diff) {
+	struct backend_command prev_cmds[] = {
+	    {.op = BACKEND_COMMAND_ROOT, .extents = {0, 0, 100, 100}},
+	    {.op = BACKEND_COMMAND_COMPOSE, .wid = 1, .opacity = 1},
+	    {.op = BACKEND_COMMAND_COMPOSE, .wid = 2, .opacity = 1},
+	};
+	struct backend_command curr_cmds[ARR_SIZE(prev_cmds) + 1];
+	memcpy(curr_cmds, prev_cmds, sizeof(prev_cmds));
+	struct command_list prev = {
+	    .cmds = prev_cmds, .ncmds = ARR_SIZE(prev_cmds), .valid = true};
+	struct command_list curr = {.cmds = curr_cmds, .ncmds = ARR_SIZE(prev_cmds)};
+
+	TEST_TRUE(command_list_diff(&prev, &curr));
+	TEST_TRUE(curr_cmds[0].unchanged && curr_cmds[1].unchanged &&
+	          curr_cmds[2].unchanged);
+
+	// `unchanged` itself isn't compared
+	prev_cmds[1].unchanged = true;
+	curr_cmds[1].unchanged = false;
+	TEST_TRUE(command_list_diff(&prev, &curr));
+
+	curr_cmds[1].opacity = 0.5;
+	TEST_TRUE(!command_list_diff(&prev, &curr));
+	TEST_TRUE(curr_cmds[0].unchanged);
+	TEST_TRUE(!curr_cmds[1].unchanged);
+	TEST_TRUE(curr_cmds[2].unchanged);
+
+	// A restack changes every command above it
+	curr_cmds[1] = prev_cmds[2];
+	curr_cmds[2] = prev_cmds[1];
+	TEST_TRUE(!command_list_diff(&prev, &curr));
+	TEST_TRUE(curr_cmds[0].unchanged);
+	TEST_TRUE(!curr_cmds[1].unchanged && !curr_cmds[2].unchanged);
+
+	// An extra command is changed, and the others are still compared
+	memcpy(curr_cmds, prev_cmds, sizeof(prev_cmds));
+	curr_cmds[3] = (struct backend_command){.op = BACKEND_COMMAND_COMPOSE, .wid = 3};
+	curr.ncmds = ARR_SIZE(curr_cmds);
+	TEST_TRUE(!command_list_diff(&prev, &curr));
+	TEST_TRUE(curr_cmds[2].unchanged);
+	TEST_TRUE(!curr_cmds[3].unchanged);
+
+	// Nothing is unchanged from an invalid list
+	curr.ncmds = ARR_SIZE(prev_cmds);
+	prev.valid = false;
+	TEST_TRUE(!command_list_diff(&prev, &curr));
+	TEST_TRUE(!curr_cmds[0].unchanged);
+}
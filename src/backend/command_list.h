@@ -0,0 +1,94 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (c) Yuxuan Shui <yshuiv7@gmail.com>
+
+#pragma once
+
+#include <stdbool.h>
+#include <xcb/xproto.h>
+
+#include "region.h"
+
+typedef struct session session_t;
+struct managed_win;
+
+enum backend_command_op {
+	/// Paint the root image, or fill with black if there is no root image
+	BACKEND_COMMAND_ROOT,
+	/// Save the background of a window, needed for rounded corners
+	BACKEND_COMMAND_STORE_BACK,
+	/// Blur the background of a window
+	BACKEND_COMMAND_BLUR,
+	/// Compose the shadow of a window
+	BACKEND_COMMAND_SHADOW,
+	/// Compose the window itself
+	BACKEND_COMMAND_COMPOSE,
+	/// Round the corners of a window
+	BACKEND_COMMAND_ROUND,
+};
+
+/// A single render operation, together with all the inputs that affect its result.
+/// Two commands that compare equal produce the same pixels, provided the content of
+/// the images they use didn't change.
+struct backend_command {
+	enum backend_command_op op;
+	/// The window this command is for, NULL for the root. Only valid during the
+	/// frame this command is recorded in.
+	struct managed_win *w;
+	/// Id of the window, XCB_NONE for the root. Used to compare commands across
+	/// frames.
+	xcb_window_t wid;
+	/// The image this command reads from, if any
+	void *image;
+	/// Where `image` is placed on the target
+	int dst_x, dst_y;
+	/// Bounding box of the part of the target this command could change
+	rect_t extents;
+	/// Opacity of the blur, the shadow, or the window
+	double opacity;
+	/// Dim opacity, 0 if the window is not dimmed
+	double dim;
+	double frame_opacity;
+	int corner_radius;
+	/// Xinerama screen the shadow is cropped to
+	int xinerama_scr;
+	bool invert_color;
+	/// Only blur the frame of the window
+	bool frame_only;
+
+	/// Whether this command is the same as the command at the same position in the
+	/// last frame. Not part of the comparison.
+	bool unchanged;
+};
+
+struct command_list {
+	struct backend_command *cmds;
+	int ncmds;
+	int capacity;
+	/// Whether a window with damaged content is painted by this list
+	bool content_damaged;
+	/// Whether this list reflects what is currently on screen, i.e. it is safe to
+	/// diff against
+	bool valid;
+};
+
+/// Record the render commands needed to paint the screen, with `t` being the bottom
+/// most window to paint.
+void command_list_build(session_t *ps, struct managed_win *t, struct command_list *cmds);
+
+/// Compare `curr` against `prev`, setting `unchanged` of each command in `curr`.
+///
+/// @return whether `curr` is identical to `prev`
+bool command_list_diff(const struct command_list *prev, struct command_list *curr);
+
+/// Whether the commands in `[begin, end)` can be skipped: they are all unchanged from
+/// the last frame, and none of them touches `reg_paint`.
+bool command_list_can_skip(const struct command_list *cmds, int begin, int end,
+                           const region_t *reg_paint);
+
+void command_list_deinit(struct command_list *cmds);
+
+/// Mark `cmds` as unusable for diffing. Call this when something not captured by the
+/// commands changed the screen, e.g. the screen got exposed or a window changed shape.
+static inline void command_list_invalidate(struct command_list *cmds) {
+	cmds->valid = false;
+}
@@ -56,7 +56,8 @@ static void dummy_check_image(struct backend_base *base, const struct dummy_imag
 	assert(*tmp->refcount > 0);
 }
 
-void dummy_compose(struct backend_base *base, struct managed_win *w attr_unused, void *image, int dst_x attr_unused,
+void dummy_compose(struct backend_base *base, struct managed_win *w attr_unused,
+                   void *image, void *mask attr_unused, int dst_x attr_unused,
                    int dst_y attr_unused, const region_t *reg_paint attr_unused,
                    const region_t *reg_visible attr_unused) {
 	dummy_check_image(base, image);
@@ -22,6 +22,7 @@
 
 #include "backend/backend_common.h"
 #include "backend/gl/gl_common.h"
+#include "backend/gl/program_cache.h"
 
 #define GLSL(version, ...) "#version " #version "\n" #__VA_ARGS__
 #define QUOTE(...) #__VA_ARGS__
@@ -56,6 +57,15 @@ struct gl_blur_context {
 	int resize_width, resize_height;
 
 	int npasses;
+
+	/// Number of dual-kawase iterations. The first `iterations` blur_textures hold
+	/// the back buffer downsampled once per iteration, the rest are the targets of
+	/// the upsample passes. Keeping them apart lets windows share the downsampled
+	/// back buffer.
+	int iterations;
+	/// Parts of the downsampled back buffer that are up to date, in X coordinates.
+	/// Only the rest has to be downsampled again when another window is blurred.
+	region_t pyramid_valid;
 };
 
 struct gl_round_context {
@@ -82,59 +92,101 @@ static GLint glGetUniformLocationChecked(GLuint p, const char *name) {
 	return ret;
 }
 
-GLuint gl_create_shader(GLenum shader_type, const char *shader_str) {
+/// Record that `reg` of the back buffer has been painted over, see
+/// gl_data::back_painted
+static inline void gl_mark_back_painted(struct gl_data *gd, const region_t *reg) {
+	pixman_region32_union(&gd->back_painted, &gd->back_painted, (region_t *)reg);
+}
+
+/// Upload rectangles converted by x_rect_to_coords into `vao`, using the two buffers
+/// in `bo` as the vertex and the index buffer.
+static void gl_setup_rects_vao(GLuint vao, const GLuint bo[2], int nrects,
+                               const GLint *coord, const GLuint *indices) {
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, bo[0]);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bo[1]);
+	glBufferData(GL_ARRAY_BUFFER, (long)sizeof(*coord) * nrects * 16, coord,
+	             GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, (long)sizeof(*indices) * nrects * 6,
+	             indices, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(vert_coord_loc);
+	glEnableVertexAttribArray(vert_in_texcoord_loc);
+	glVertexAttribPointer(vert_coord_loc, 2, GL_INT, GL_FALSE, sizeof(GLint) * 4,
+	                      NULL);
+	glVertexAttribPointer(vert_in_texcoord_loc, 2, GL_INT, GL_FALSE,
+	                      sizeof(GLint) * 4, (void *)(sizeof(GLint) * 2));
+}
+
+/// Start compiling a shader, without waiting for the result. Drivers can compile
+/// shaders in the background until their status is queried.
+static GLuint gl_compile_shader(GLenum shader_type, const char *shader_str) {
 	log_trace("===\n%s\n===", shader_str);
 
-	bool success = false;
 	GLuint shader = glCreateShader(shader_type);
 	if (!shader) {
 		log_error("Failed to create shader with type %#x.", shader_type);
-		goto end;
+		return 0;
 	}
 	glShaderSource(shader, 1, &shader_str, NULL);
 	glCompileShader(shader);
+	return shader;
+}
 
-	// Get shader status
-	{
-		GLint status = GL_FALSE;
-		glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
-		if (GL_FALSE == status) {
-			GLint log_len = 0;
-			glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &log_len);
-			if (log_len) {
-				char log[log_len + 1];
-				glGetShaderInfoLog(shader, log_len, NULL, log);
-				log_error("Failed to compile shader with type %d: %s",
-				          shader_type, log);
-			}
-			goto end;
-		}
+/// Wait for a shader started by `gl_compile_shader` to finish compiling. The shader is
+/// deleted if the compilation failed.
+static GLuint gl_finish_shader(GLenum shader_type, GLuint shader) {
+	if (!shader) {
+		return 0;
 	}
 
-	success = true;
-
-end:
-	if (shader && !success) {
+	GLint status = GL_FALSE;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+	if (GL_FALSE == status) {
+		GLint log_len = 0;
+		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &log_len);
+		if (log_len) {
+			char log[log_len + 1];
+			glGetShaderInfoLog(shader, log_len, NULL, log);
+			log_error("Failed to compile shader with type %d: %s",
+			          shader_type, log);
+		}
 		glDeleteShader(shader);
-		shader = 0;
+		return 0;
 	}
-
 	return shader;
 }
 
-GLuint gl_create_program(const GLuint *const shaders, int nshaders) {
-	bool success = false;
+GLuint gl_create_shader(GLenum shader_type, const char *shader_str) {
+	return gl_finish_shader(shader_type, gl_compile_shader(shader_type, shader_str));
+}
+
+/// Start linking a program, without waiting for the result.
+static GLuint gl_link_program(const GLuint *const shaders, int nshaders) {
 	GLuint program = glCreateProgram();
 	if (!program) {
 		log_error("Failed to create program.");
-		goto end;
+		return 0;
 	}
 
 	for (int i = 0; i < nshaders; ++i)
 		glAttachShader(program, shaders[i]);
+	if (gl_program_cache_supported()) {
+		// Some drivers only keep the binary around with this hint
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
 	glLinkProgram(program);
+	return program;
+}
 
-	// Get program status
+/// Wait for a program started by `gl_link_program` to finish linking. The program is
+/// deleted if the linking failed.
+static GLuint
+gl_finish_program(GLuint program, const GLuint *const shaders, int nshaders) {
+	if (!program) {
+		return 0;
+	}
+
+	bool success = false;
 	{
 		GLint status = GL_FALSE;
 		glGetProgramiv(program, GL_LINK_STATUS, &status);
@@ -146,17 +198,14 @@ GLuint gl_create_program(const GLuint *const shaders, int nshaders) {
 				glGetProgramInfoLog(program, log_len, NULL, log);
 				log_error("Failed to link program: %s", log);
 			}
-			goto end;
+		} else {
+			success = true;
 		}
 	}
-	success = true;
 
-end:
-	if (program) {
-		for (int i = 0; i < nshaders; ++i)
-			glDetachShader(program, shaders[i]);
-	}
-	if (program && !success) {
+	for (int i = 0; i < nshaders; ++i)
+		glDetachShader(program, shaders[i]);
+	if (!success) {
 		glDeleteProgram(program);
 		program = 0;
 	}
@@ -164,39 +213,97 @@ end:
 	return program;
 }
 
+GLuint gl_create_program(const GLuint *const shaders, int nshaders) {
+	return gl_finish_program(gl_link_program(shaders, nshaders), shaders, nshaders);
+}
+
 /**
  * @brief Create a program from vertex and fragment shader strings.
+ *
+ * The program binary cache is consulted first, and newly linked programs are added to
+ * it.
  */
 GLuint gl_create_program_from_str(const char *vert_shader_str, const char *frag_shader_str) {
-	GLuint vert_shader = 0;
-	GLuint frag_shader = 0;
 	GLuint prog = 0;
+	gl_create_programs_from_str(1, &vert_shader_str, &frag_shader_str, &prog);
+	return prog;
+}
 
-	if (vert_shader_str)
-		vert_shader = gl_create_shader(GL_VERTEX_SHADER, vert_shader_str);
-	if (frag_shader_str)
-		frag_shader = gl_create_shader(GL_FRAGMENT_SHADER, frag_shader_str);
+static int nonzero_shaders(const GLuint shaders[2], GLuint out[2]) {
+	int count = 0;
+	for (int i = 0; i < 2; i++) {
+		if (shaders[i]) {
+			out[count++] = shaders[i];
+		}
+	}
+	return count;
+}
 
-	{
-		GLuint shaders[2];
-		int count = 0;
-		if (vert_shader) {
-			shaders[count++] = vert_shader;
+void gl_create_programs_from_str(int n, const char *const *vert_shader_strs,
+                                 const char *const *frag_shader_strs, GLuint *progs) {
+	auto start = get_time_timespec();
+	auto shaders = ccalloc(2 * n, GLuint);
+	int ncached = 0;
+
+	// Every step is started for all the programs before waiting for any of them, so
+	// drivers that compile in the background can work on them in parallel.
+	for (int i = 0; i < n; i++) {
+		const char *vert = vert_shader_strs[i], *frag = frag_shader_strs[i];
+		progs[i] = gl_program_cache_load(vert, frag);
+		if (progs[i]) {
+			ncached++;
+			continue;
+		}
+		if (vert) {
+			shaders[2 * i] = gl_compile_shader(GL_VERTEX_SHADER, vert);
 		}
-		if (frag_shader) {
-			shaders[count++] = frag_shader;
+		if (frag) {
+			shaders[2 * i + 1] = gl_compile_shader(GL_FRAGMENT_SHADER, frag);
 		}
+	}
+
+	for (int i = 0; i < n; i++) {
+		if (progs[i]) {
+			continue;
+		}
+		auto pair = &shaders[2 * i];
+		pair[0] = gl_finish_shader(GL_VERTEX_SHADER, pair[0]);
+		pair[1] = gl_finish_shader(GL_FRAGMENT_SHADER, pair[1]);
+		if ((vert_shader_strs[i] && !pair[0]) ||
+		    (frag_shader_strs[i] && !pair[1])) {
+			// Linking would fail anyway
+			continue;
+		}
+
+		GLuint linked[2];
+		int count = nonzero_shaders(pair, linked);
 		if (count) {
-			prog = gl_create_program(shaders, count);
+			progs[i] = gl_link_program(linked, count);
 		}
 	}
 
-	if (vert_shader)
-		glDeleteShader(vert_shader);
-	if (frag_shader)
-		glDeleteShader(frag_shader);
+	for (int i = 0; i < n; i++) {
+		GLuint linked[2];
+		int count = nonzero_shaders(&shaders[2 * i], linked);
+		if (!count) {
+			// Loaded from the cache, or failed to compile
+			continue;
+		}
+		progs[i] = gl_finish_program(progs[i], linked, count);
+		for (int j = 0; j < count; j++) {
+			glDeleteShader(linked[j]);
+		}
+		if (progs[i]) {
+			gl_program_cache_store(progs[i], vert_shader_strs[i],
+			                       frag_shader_strs[i]);
+		}
+	}
+	free(shaders);
 
-	return prog;
+	auto end = get_time_timespec();
+	log_debug("Created %d programs (%d from cache) in %ld us", n, ncached,
+	          (end.tv_sec - start.tv_sec) * 1000000L +
+	              (end.tv_nsec - start.tv_nsec) / 1000);
 }
 
 static void gl_free_prog_main(gl_win_shader_t *pprogram) {
@@ -285,32 +392,35 @@ _gl_average_texture_color(backend_t *base, GLuint source_texture, GLuint destina
  * width and half height).
  * Returned texture must not be deleted, since it's owned by the gl_image. It will be
  * deleted when the gl_image is released.
+ * The result is kept until the texture is damaged, see gl_prepare.
  */
 static GLuint gl_average_texture_color(backend_t *base, struct gl_image *img) {
 	auto gd = (struct gl_data *)base;
+	if (img->inner->average_color) {
+		return img->inner->average_color;
+	}
 
 	// Prepare textures which will be used for destination and source of rendering
 	// during downscaling.
 	const int texture_count = ARR_SIZE(img->inner->auxiliary_texture);
 	if (!img->inner->auxiliary_texture[0]) {
 		assert(!img->inner->auxiliary_texture[1]);
-		glGenTextures(texture_count, img->inner->auxiliary_texture);
 		glActiveTexture(GL_TEXTURE0);
 		for (int i = 0; i < texture_count; i++) {
+			img->inner->auxiliary_texture[i] = gl_get_pooled_texture(
+			    gd, GL_RGB8, img->inner->width, img->inner->height);
 			glBindTexture(GL_TEXTURE_2D, img->inner->auxiliary_texture[i]);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
 			glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR,
 			                 (GLint[]){0, 0, 0, 0});
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, img->inner->width,
-			             img->inner->height, 0, GL_BGR, GL_UNSIGNED_BYTE, NULL);
 		}
 	}
 
-	// Prepare framebuffer used for rendering and bind it
-	GLuint fbo;
-	glGenFramebuffers(1, &fbo);
+	// Bind the framebuffer used for rendering
+	GLuint fbo = gd->average_fbo;
 	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
 	glDrawBuffer(GL_COLOR_ATTACHMENT0);
 
@@ -358,7 +468,8 @@ static GLuint gl_average_texture_color(backend_t *base, struct gl_image *img) {
 	glUseProgram(0);
 
 	// Cleanup framebuffers
-	glDeleteFramebuffers(1, &fbo);
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+	                       0, 0);
 	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
 	glDrawBuffer(GL_BACK);
 
@@ -367,9 +478,12 @@ static GLuint gl_average_texture_color(backend_t *base, struct gl_image *img) {
 
 	gl_check_err();
 
+	img->inner->average_color = result_texture;
 	return result_texture;
 }
 
+static gl_win_shader_t *gl_get_win_shader(struct gl_data *gd, unsigned features);
+
 /**
  * Render a region with texture data.
  *
@@ -379,47 +493,95 @@ static GLuint gl_average_texture_color(backend_t *base, struct gl_image *img) {
  *                    should go. In OpenGL coordinate system (important!).
  * @param reg_tgt     the clip region, in Xorg coordinate system
  * @param reg_visible ignored
+ * @param mask        the mask, aligned with the texture, can be NULL
  */
-static void _gl_compose(backend_t *base, struct gl_image *img, GLuint target,
-                        GLint *coord, GLuint *indices, int nrects) {
+static void _gl_compose(backend_t *base, struct gl_image *img,
+                        const struct gl_image *mask, GLuint target, GLint *coord,
+                        GLuint *indices, int nrects) {
 	auto gd = (struct gl_data *)base;
 	if (!img || !img->inner->texture) {
 		log_error("Missing texture.");
 		return;
 	}
 
-	GLuint brightness = 0;
+	// Pick the cheapest shader variant that can draw this image
+	unsigned features = 0;
+	if (img->opacity < 1.0) {
+		features |= WIN_SHADER_OPACITY;
+	}
+	if (img->dim > 0) {
+		features |= WIN_SHADER_DIM;
+	}
+	if (img->color_inverted) {
+		features |= WIN_SHADER_INVERT;
+	}
 	if (img->max_brightness < 1.0) {
+		features |= WIN_SHADER_BRIGHTNESS;
+	}
+	if (mask) {
+		features |= WIN_SHADER_MASK;
+	}
+	if (img->corner_radius > 0) {
+		features |= WIN_SHADER_ROUNDED;
+	}
+	auto shader = gl_get_win_shader(gd, features);
+	if (!shader) {
+		return;
+	}
+
+	GLuint brightness = 0;
+	if (features & WIN_SHADER_BRIGHTNESS) {
 		brightness = gl_average_texture_color(base, img);
 	}
 
-	assert(gd->win_shader.prog);
-	glUseProgram(gd->win_shader.prog);
-	if (gd->win_shader.unifm_opacity >= 0) {
-		glUniform1f(gd->win_shader.unifm_opacity, (float)img->opacity);
+	glUseProgram(shader->prog);
+	if (shader->unifm_opacity >= 0) {
+		glUniform1f(shader->unifm_opacity, (float)img->opacity);
+	}
+	if (shader->unifm_tex >= 0) {
+		glUniform1i(shader->unifm_tex, 0);
+	}
+	if (shader->unifm_dim >= 0) {
+		glUniform1f(shader->unifm_dim, (float)img->dim);
 	}
-	if (gd->win_shader.unifm_invert_color >= 0) {
-		glUniform1i(gd->win_shader.unifm_invert_color, img->color_inverted);
+	if (shader->unifm_brightness >= 0) {
+		glUniform1i(shader->unifm_brightness, 1);
 	}
-	if (gd->win_shader.unifm_tex >= 0) {
-		glUniform1i(gd->win_shader.unifm_tex, 0);
+	if (shader->unifm_max_brightness >= 0) {
+		glUniform1f(shader->unifm_max_brightness, (float)img->max_brightness);
 	}
-	if (gd->win_shader.unifm_dim >= 0) {
-		glUniform1f(gd->win_shader.unifm_dim, (float)img->dim);
+	if (shader->unifm_mask >= 0) {
+		glUniform1i(shader->unifm_mask, 2);
 	}
-	if (gd->win_shader.unifm_brightness >= 0) {
-		glUniform1i(gd->win_shader.unifm_brightness, 1);
+	if (shader->unifm_y_flip >= 0) {
+		// Masks and rounded corners work top row first, while the texture
+		// coordinates of a non y-inverted image are flipped.
+		glUniform1i(shader->unifm_y_flip, !img->inner->y_inverted);
 	}
-	if (gd->win_shader.unifm_max_brightness >= 0) {
-		glUniform1f(gd->win_shader.unifm_max_brightness, (float)img->max_brightness);
+	if (shader->unifm_corner_radius >= 0) {
+		// The corners can't be rounded more than half of the image
+		auto radius = min2(img->corner_radius,
+		                   min2(img->inner->width, img->inner->height) / 2);
+		glUniform1f(shader->unifm_corner_radius, (float)radius);
+		glUniform1i(shader->unifm_corner_type, img->corner_type);
+		glUniform1f(shader->unifm_corner_border_width,
+		            (float)img->corner_border_width);
+		glUniform2f(shader->unifm_size, (float)img->inner->width,
+		            (float)img->inner->height);
 	}
 
 	// log_trace("Draw: %d, %d, %d, %d -> %d, %d (%d, %d) z %d\n",
 	//          x, y, width, height, dx, dy, ptex->width, ptex->height, z);
 
 	// Bind texture
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, brightness);
+	if (mask) {
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_2D, mask->inner->texture);
+	}
+	if (brightness) {
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, brightness);
+	}
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, img->inner->texture);
 
@@ -450,6 +612,11 @@ static void _gl_compose(backend_t *base, struct gl_image *img, GLuint target,
 
 	// Cleanup
 	glBindTexture(GL_TEXTURE_2D, 0);
+	if (mask) {
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glActiveTexture(GL_TEXTURE0);
+	}
 	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
 	glDrawBuffer(GL_BACK);
 
@@ -528,8 +695,9 @@ x_rect_to_coords(int nrects, const rect_t *rects, int dst_x, int dst_y, int text
 }
 
 // TODO(yshui) make use of reg_visible
-void gl_compose(backend_t *base, struct managed_win *w attr_unused, void *image_data, int dst_x, int dst_y,
-                const region_t *reg_tgt, const region_t *reg_visible attr_unused) {
+void gl_compose(backend_t *base, struct managed_win *w attr_unused, void *image_data,
+                void *mask, int dst_x, int dst_y, const region_t *reg_tgt,
+                const region_t *reg_visible attr_unused) {
 	auto gd = (struct gl_data *)base;
 	struct gl_image *img = image_data;
 
@@ -553,12 +721,145 @@ void gl_compose(backend_t *base, struct managed_win *w attr_unused, void *image_
 	auto indices = ccalloc(nrects * 6, GLuint);
 	x_rect_to_coords(nrects, rects, dst_x, dst_y, img->inner->height, gd->height,
 	                 img->inner->y_inverted, coord, indices);
-	_gl_compose(base, img, gd->back_fbo, coord, indices, nrects);
+	_gl_compose(base, img, mask, gd->back_fbo, coord, indices, nrects);
+	gl_mark_back_painted(gd, reg_tgt);
 
 	free(indices);
 	free(coord);
 }
 
+void *gl_make_mask(backend_t *base, int width, int height, const region_t *reg) {
+	auto gd = (struct gl_data *)base;
+	if (width <= 0 || height <= 0) {
+		return NULL;
+	}
+
+	// Rasterize the region, which has the same origin as the mask
+	auto pixels = ccalloc(width * height, uint8_t);
+	int nrects;
+	const rect_t *rects = pixman_region32_rectangles((region_t *)reg, &nrects);
+	for (int i = 0; i < nrects; i++) {
+		int x1 = max2(rects[i].x1, 0), x2 = min2(rects[i].x2, width);
+		int y1 = max2(rects[i].y1, 0), y2 = min2(rects[i].y2, height);
+		for (int y = y1; y < y2 && x1 < x2; y++) {
+			memset(pixels + y * width + x1, 0xff, (size_t)(x2 - x1));
+		}
+	}
+
+	auto inner = ccalloc(1, struct gl_texture);
+	inner->texture = gl_get_pooled_texture(gd, GL_R8, width, height);
+	inner->pool_format = GL_R8;
+	inner->width = width;
+	inner->height = height;
+	inner->y_inverted = true;
+	inner->refcount = 1;
+	inner->user_data = gd->decouple_texture_user_data(base, NULL);
+
+	glBindTexture(GL_TEXTURE_2D, inner->texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RED, GL_UNSIGNED_BYTE,
+	                pixels);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	free(pixels);
+
+	auto ret = ccalloc(1, struct gl_image);
+	ret->inner = inner;
+	ret->opacity = 1;
+	ret->max_brightness = 1;
+	ret->ewidth = width;
+	ret->eheight = height;
+	gl_check_err();
+	return ret;
+}
+
+void *gl_render_shadow(backend_t *base, int width, int height, const conv *kernel,
+                       double r, double g, double b, double a) {
+	static const GLuint shadow_vert_in_coord_loc = 0;
+	auto gd = (struct gl_data *)base;
+	// We only support square kernels for shadow, same as make_shadow
+	assert(kernel->w == kernel->h && kernel->w % 2 == 1);
+	assert(kernel->rsum);
+	int d = kernel->w;
+	int swidth = width + d - 1, sheight = height + d - 1;
+
+	// The shader computes the sum of the kernel over its intersection with the
+	// window from the summed area table of the kernel, which is what make_shadow
+	// does on the CPU.
+	auto sums = ccalloc(d * d, GLfloat);
+	for (int i = 0; i < d * d; i++) {
+		sums[i] = (GLfloat)kernel->rsum[i];
+	}
+	GLuint kernel_texture = gl_get_pooled_texture(gd, GL_R32F, d, d);
+	glBindTexture(GL_TEXTURE_2D, kernel_texture);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, d, d, GL_RED, GL_FLOAT, sums);
+	free(sums);
+
+	auto inner = ccalloc(1, struct gl_texture);
+	inner->texture = gl_get_pooled_texture(gd, GL_RGBA8, swidth, sheight);
+	inner->pool_format = GL_RGBA8;
+	inner->width = swidth;
+	inner->height = sheight;
+	inner->y_inverted = true;
+	inner->refcount = 1;
+	inner->user_data = gd->decouple_texture_user_data(base, NULL);
+
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, gd->image_fbo);
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+	                       inner->texture, 0);
+	glDrawBuffer(GL_COLOR_ATTACHMENT0);
+	glClearColor(0, 0, 0, 0);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	glUseProgram(gd->shadow_shader.prog);
+	glUniform1i(gd->shadow_shader.unifm_kernel_size, d);
+	glUniform2i(gd->shadow_shader.unifm_box_size, width, height);
+	glUniform4f(gd->shadow_shader.unifm_color, (GLfloat)(r * a), (GLfloat)(g * a),
+	            (GLfloat)(b * a), (GLfloat)a);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, kernel_texture);
+
+	GLint coord[] = {0, 0, swidth, 0, swidth, sheight, 0, sheight};
+	GLuint indices[] = {0, 1, 2, 2, 3, 0};
+	GLuint vao;
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+	GLuint bo[2];
+	glGenBuffers(2, bo);
+	glBindBuffer(GL_ARRAY_BUFFER, bo[0]);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bo[1]);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(coord), coord, GL_STREAM_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STREAM_DRAW);
+	glEnableVertexAttribArray(shadow_vert_in_coord_loc);
+	glVertexAttribPointer(shadow_vert_in_coord_loc, 2, GL_INT, GL_FALSE,
+	                      sizeof(*coord) * 2, NULL);
+	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, NULL);
+
+	// Cleanup
+	glDisableVertexAttribArray(shadow_vert_in_coord_loc);
+	glBindVertexArray(0);
+	glDeleteVertexArrays(1, &vao);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glDeleteBuffers(2, bo);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	gl_put_pooled_texture(gd, kernel_texture, GL_R32F, d, d);
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+	                       0, 0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glUseProgram(0);
+
+	auto ret = ccalloc(1, struct gl_image);
+	ret->inner = inner;
+	ret->opacity = 1;
+	ret->max_brightness = 1;
+	ret->has_alpha = true;
+	ret->ewidth = swidth;
+	ret->eheight = sheight;
+	gl_check_err();
+	return ret;
+}
+
 /**
  * Blur contents in a particular region.
  */
@@ -648,15 +949,20 @@ bool gl_kernel_blur(backend_t *base, double opacity, void *ctx, const rect_t *ex
 	return true;
 }
 
+/// Blur with dual-kawase.
+///
+/// @param vao, vao_nelems the vertex arrays of the blur region, the resized blur region
+///                        and the part of the resized blur region that has to be
+///                        downsampled again
 bool gl_dual_kawase_blur(backend_t *base, double opacity, void *ctx, const rect_t *extent,
-                         const GLuint vao[2], const int vao_nelems[2]) {
+                         const GLuint vao[3], const int vao_nelems[3]) {
 	auto bctx = (struct gl_blur_context *)ctx;
 	auto gd = (struct gl_data *)base;
 
 	int dst_y_screen_coord = gd->height - extent->y2,
 	    dst_y_fb_coord = bctx->fb_height - extent->y2;
 
-	int iterations = bctx->blur_texture_count;
+	int iterations = bctx->iterations;
 	int scale_factor = 1;
 
 	// Kawase downsample pass
@@ -671,6 +977,10 @@ bool gl_dual_kawase_blur(backend_t *base, double opacity, void *ctx, const rect_
 	for (int i = 0; i < iterations; ++i) {
 		// Scale output width / height by half in each iteration
 		scale_factor <<= 1;
+		if (!vao_nelems[2]) {
+			// Everything we need is still there from blurring other windows
+			continue;
+		}
 
 		GLuint src_texture;
 		int tex_width, tex_height;
@@ -699,8 +1009,8 @@ bool gl_dual_kawase_blur(backend_t *base, double opacity, void *ctx, const rect_
 		assert(bctx->blur_fbos[i]);
 
 		glBindTexture(GL_TEXTURE_2D, src_texture);
-		glBindVertexArray(vao[1]);
-		auto nelems = vao_nelems[1];
+		glBindVertexArray(vao[2]);
+		auto nelems = vao_nelems[2];
 		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, bctx->blur_fbos[i]);
 		glDrawBuffer(GL_COLOR_ATTACHMENT0);
 
@@ -726,7 +1036,11 @@ bool gl_dual_kawase_blur(backend_t *base, double opacity, void *ctx, const rect_
 		// Scale output width / height back by two in each iteration
 		scale_factor >>= 1;
 
-		const GLuint src_texture = bctx->blur_textures[i];
+		// Upsampling starts from the smallest downsampled texture, and doesn't
+		// touch the downsampled textures so they can be reused.
+		const GLuint src_texture = i == iterations - 1
+		                               ? bctx->blur_textures[i]
+		                               : bctx->blur_textures[iterations + i];
 		assert(src_texture);
 
 		// Calculate normalized half-width/-height of a src pixel
@@ -739,12 +1053,13 @@ bool gl_dual_kawase_blur(backend_t *base, double opacity, void *ctx, const rect_
 
 		glBindTexture(GL_TEXTURE_2D, src_texture);
 		if (i > 0) {
-			assert(bctx->blur_fbos[i - 1]);
+			const GLuint dst_fbo = bctx->blur_fbos[iterations + i - 1];
+			assert(dst_fbo);
 
 			// not last pass, draw into next framebuffer
 			glBindVertexArray(vao[1]);
 			nelems = vao_nelems[1];
-			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, bctx->blur_fbos[i - 1]);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, dst_fbo);
 			glDrawBuffer(GL_COLOR_ATTACHMENT0);
 
 			glUniform2f(up_pass->orig_loc, (GLfloat)bctx->resize_width,
@@ -784,13 +1099,19 @@ bool gl_blur(backend_t *base, double opacity, void *ctx, const region_t *reg_blu
 		bctx->fb_width = gd->width + bctx->resize_width * 2;
 		bctx->fb_height = gd->height + bctx->resize_height * 2;
 
+		pixman_region32_clear(&bctx->pyramid_valid);
 		for (int i = 0; i < bctx->blur_texture_count; ++i) {
 			auto tex_size = bctx->texture_sizes + i;
 			if (bctx->method == BLUR_METHOD_DUAL_KAWASE) {
 				// Use smaller textures for each iteration (quarter of the
-				// previous texture)
-				tex_size->width = 1 + ((bctx->fb_width - 1) >> (i + 1));
-				tex_size->height = 1 + ((bctx->fb_height - 1) >> (i + 1));
+				// previous texture). Upsample targets are the same size
+				// as the downsampled texture of their iteration.
+				int level =
+				    i < bctx->iterations ? i : i - bctx->iterations;
+				tex_size->width =
+				    1 + ((bctx->fb_width - 1) >> (level + 1));
+				tex_size->height =
+				    1 + ((bctx->fb_height - 1) >> (level + 1));
 			} else {
 				tex_size->width = bctx->fb_width;
 				tex_size->height = bctx->fb_height;
@@ -845,230 +1166,264 @@ bool gl_blur(backend_t *base, double opacity, void *ctx, const region_t *reg_blu
 	x_rect_to_coords(nrects_resized, rects_resized, extent_resized->x1,
 	                 extent_resized->y2, bctx->fb_height, bctx->fb_height, false,
 	                 coord_resized, indices_resized);
-	pixman_region32_fini(&reg_blur_resized);
-
-	GLuint vao[2];
-	glGenVertexArrays(2, vao);
-	GLuint bo[4];
-	glGenBuffers(4, bo);
-
-	glBindVertexArray(vao[0]);
-	glBindBuffer(GL_ARRAY_BUFFER, bo[0]);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bo[1]);
-	glBufferData(GL_ARRAY_BUFFER, (long)sizeof(*coord) * nrects * 16, coord, GL_STATIC_DRAW);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, (long)sizeof(*indices) * nrects * 6,
-	             indices, GL_STATIC_DRAW);
-	glEnableVertexAttribArray(vert_coord_loc);
-	glEnableVertexAttribArray(vert_in_texcoord_loc);
-	glVertexAttribPointer(vert_coord_loc, 2, GL_INT, GL_FALSE, sizeof(GLint) * 4, NULL);
-	glVertexAttribPointer(vert_in_texcoord_loc, 2, GL_INT, GL_FALSE,
-	                      sizeof(GLint) * 4, (void *)(sizeof(GLint) * 2));
 
-	glBindVertexArray(vao[1]);
-	glBindBuffer(GL_ARRAY_BUFFER, bo[2]);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bo[3]);
-	glBufferData(GL_ARRAY_BUFFER, (long)sizeof(*coord_resized) * nrects_resized * 16,
-	             coord_resized, GL_STATIC_DRAW);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-	             (long)sizeof(*indices_resized) * nrects_resized * 6, indices_resized,
-	             GL_STATIC_DRAW);
-	glEnableVertexAttribArray(vert_coord_loc);
-	glEnableVertexAttribArray(vert_in_texcoord_loc);
-	glVertexAttribPointer(vert_coord_loc, 2, GL_INT, GL_FALSE, sizeof(GLint) * 4, NULL);
-	glVertexAttribPointer(vert_in_texcoord_loc, 2, GL_INT, GL_FALSE,
-	                      sizeof(GLint) * 4, (void *)(sizeof(GLint) * 2));
+	GLuint vao[3];
+	glGenVertexArrays(3, vao);
+	GLuint bo[6];
+	glGenBuffers(6, bo);
+	gl_setup_rects_vao(vao[0], &bo[0], nrects, coord, indices);
+	gl_setup_rects_vao(vao[1], &bo[2], nrects_resized, coord_resized,
+	                   indices_resized);
+	free(indices);
+	free(coord);
+	free(indices_resized);
+	free(coord_resized);
 
-	int vao_nelems[2] = {nrects * 6, nrects_resized * 6};
+	int vao_nelems[3] = {nrects * 6, nrects_resized * 6, 0};
 
 	if (bctx->method == BLUR_METHOD_DUAL_KAWASE) {
+		// Windows are blurred bottom to top, and only what has been painted
+		// below a window since the last blur changes its downsampled
+		// background. So only that part has to be downsampled again.
+		region_t reg_stale;
+		pixman_region32_init(&reg_stale);
+		resize_region_into(&gd->back_painted, &reg_stale, bctx->resize_width,
+		                   bctx->resize_height);
+		pixman_region32_subtract(&bctx->pyramid_valid, &bctx->pyramid_valid,
+		                         &reg_stale);
+		pixman_region32_subtract(&reg_stale, &reg_blur_resized,
+		                         &bctx->pyramid_valid);
+
+		int nrects_stale;
+		auto rects_stale = pixman_region32_rectangles(&reg_stale, &nrects_stale);
+		if (nrects_stale) {
+			auto coord_stale = ccalloc(nrects_stale * 16, GLint);
+			auto indices_stale = ccalloc(nrects_stale * 6, GLuint);
+			x_rect_to_coords(nrects_stale, rects_stale, extent_resized->x1,
+			                 extent_resized->y2, bctx->fb_height,
+			                 bctx->fb_height, false, coord_stale,
+			                 indices_stale);
+			gl_setup_rects_vao(vao[2], &bo[4], nrects_stale, coord_stale,
+			                   indices_stale);
+			vao_nelems[2] = nrects_stale * 6;
+			free(indices_stale);
+			free(coord_stale);
+		}
+		pixman_region32_union(&bctx->pyramid_valid, &bctx->pyramid_valid,
+		                      &reg_blur_resized);
+		pixman_region32_fini(&reg_stale);
+
 		ret = gl_dual_kawase_blur(base, opacity, ctx, extent_resized, vao, vao_nelems);
 	} else {
 		ret = gl_kernel_blur(base, opacity, ctx, extent_resized, vao, vao_nelems);
 	}
+	pixman_region32_fini(&reg_blur_resized);
+	pixman_region32_clear(&gd->back_painted);
+	gl_mark_back_painted(gd, reg_blur);
 
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	glBindTexture(GL_TEXTURE_2D, 0);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-	glDeleteBuffers(4, bo);
+	glDeleteBuffers(6, bo);
 	glBindVertexArray(0);
-	glDeleteVertexArrays(2, vao);
+	glDeleteVertexArrays(3, vao);
 	glUseProgram(0);
 
-	free(indices);
-	free(coord);
-	free(indices_resized);
-	free(coord_resized);
-
 	gl_check_err();
 	return ret;
 }
 
-bool gl_round(backend_t *backend_data attr_unused, struct managed_win *w, void *ctx_, void *image_data,
-                 const region_t *reg_round attr_unused, const region_t *reg_visible attr_unused) {
+// clang-format off
+/// Distance of `pos` from the center of the arc of the rounded corner it's in. 0 if
+/// `pos` is not in a rounded corner. Only the corners whose bits are set in `corners`
+/// are rounded, numbered clockwise from the top left. `pos` is relative to the top
+/// left of a `size` rectangle, top row first.
+static const char corner_distance_glsl[] = QUOTE(
+	float corner_distance(vec2 pos, vec2 size, float radius, int corners) {
+		bool right = pos.x > size.x / 2.0, bottom = pos.y > size.y / 2.0;
+		int corner = right ? (bottom ? 2 : 1) : (bottom ? 3 : 0);
+		if ((corners & (1 << corner)) == 0) {
+			return 0.0;
+		}
+		vec2 center = vec2(right ? size.x - radius : radius,
+		                   bottom ? size.y - radius : radius);
+		vec2 d = (pos - center) * vec2(right ? 1.0 : -1.0, bottom ? 1.0 : -1.0);
+		return d.x > 0.0 && d.y > 0.0 ? length(d) : 0.0;
+	}
+);
 
+// clang-format on
+
+/// Get the rectangles covering the rounded corners of `w`, in X coordinates.
+///
+/// @return the number of rectangles
+static int gl_corner_rects(const struct managed_win *w, rect_t rects[4]) {
+	auto radius = min2(w->corner_radius, min2(w->widthb, w->heightb) / 2);
+	int x1 = w->g.x, y1 = w->g.y, x2 = w->g.x + w->widthb, y2 = w->g.y + w->heightb;
+	const rect_t corners[] = {
+	    {.x1 = x1, .y1 = y1, .x2 = x1 + radius, .y2 = y1 + radius},
+	    {.x1 = x2 - radius, .y1 = y1, .x2 = x2, .y2 = y1 + radius},
+	    {.x1 = x2 - radius, .y1 = y2 - radius, .x2 = x2, .y2 = y2},
+	    {.x1 = x1, .y1 = y2 - radius, .x2 = x1 + radius, .y2 = y2},
+	};
+	int nrects = 0;
+	for (int i = 0; radius > 0 && i < (int)ARR_SIZE(corners); i++) {
+		if (w->corner_type & (1 << i)) {
+			rects[nrects++] = corners[i];
+		}
+	}
+	return nrects;
+}
+
+bool gl_round(backend_t *backend_data, struct managed_win *w, void *ctx_,
+              void *image_data, const region_t *reg_round,
+              const region_t *reg_visible attr_unused) {
 	struct gl_round_context *cctx = ctx_;
 	auto gd = (struct gl_data *)backend_data;
-	auto img = (struct gl_image*)image_data;
+	auto img = (struct gl_image *)image_data;
 
-	//log_warn("r(%d) b(%d) bo(%d), wxy(%d %d) wwh(%d %d) img(%d %d)",
-	//	w->corner_radius, w->g.border_width, w->border_width, w->g.x, w->g.y,
-	//	w->widthb, w->heightb, img->inner->width, img->inner->height);
+	// The corners were cut out when the window was composed. Only this window
+	// has to be rounded.
+	if (img) {
+		img->corner_radius = 0;
+	}
+	if (!w->blur_background) {
+		// Without blur, the background behind the corners was never painted
+		// over.
+		return true;
+	}
+
+	// Put back the part of the background that the blur painted over, outside
+	// of the corners. This only has to be done where the corners are.
+	rect_t corners[4];
+	region_t reg_corners;
+	pixman_region32_init_rects(&reg_corners, corners, gl_corner_rects(w, corners));
+	pixman_region32_intersect(&reg_corners, &reg_corners, (region_t *)reg_round);
 
 	int nrects;
-	const rect_t *rects;
-	rects = pixman_region32_rectangles((region_t *)reg_round, &nrects);
+	const rect_t *rects = pixman_region32_rectangles(&reg_corners, &nrects);
 	if (!nrects) {
 		// Nothing to paint
-		return false;
+		pixman_region32_fini(&reg_corners);
+		return true;
 	}
 
-	GLuint target = gd->back_fbo;
-	int dst_x = w->g.x;
-	int dst_y = w->g.y;
-
 	auto coord = ccalloc(nrects * 16, GLint);
 	auto indices = ccalloc(nrects * 6, GLuint);
-	x_rect_to_coords(nrects, rects, dst_x, dst_y,
-					img ? img->inner->height : w->heightb, gd->height,
-					img ? img->inner->y_inverted : true, coord, indices);
+	x_rect_to_coords(nrects, rects, 0, 0, gd->height, gd->height, true, coord,
+	                 indices);
 
 	GLuint vao;
 	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
-
 	GLuint bo[2];
 	glGenBuffers(2, bo);
-	glBindBuffer(GL_ARRAY_BUFFER, bo[0]);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bo[1]);
-	glBufferData(GL_ARRAY_BUFFER, (long)sizeof(*coord) * nrects * 16, coord, GL_STATIC_DRAW);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, (long)sizeof(*indices) * nrects * 6,
-	             indices, GL_STATIC_DRAW);
-
-	glEnableVertexAttribArray(vert_coord_loc);
-	glEnableVertexAttribArray(vert_in_texcoord_loc);
-	glVertexAttribPointer(vert_coord_loc, 2, GL_INT, GL_FALSE, sizeof(GLint) * 4, NULL);
-	glVertexAttribPointer(vert_in_texcoord_loc, 2, GL_INT, GL_FALSE,
-	                      sizeof(GLint) * 4, (void *)(sizeof(GLint) * 2));
+	gl_setup_rects_vao(vao, bo, nrects, coord, indices);
 
-	//glDisable(GL_BLEND);
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
-
-	// Bind texture
-	//glViewport(0, 0, gd->width, gd->height);
 	glActiveTexture(GL_TEXTURE1);
 	glBindTexture(GL_TEXTURE_2D, cctx->bg_tex[0]);
 	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, img ? img->inner->texture : gd->back_texture);
 
 	const gl_round_shader_t *ppass = &cctx->round_shader[0];
 	glUseProgram(ppass->prog);
+	glUniform1i(ppass->unifm_tex_bg, 1);
+	auto radius = min2(w->corner_radius, min2(w->widthb, w->heightb) / 2);
+	glUniform1f(ppass->unifm_radius, (float)radius);
+	glUniform1i(ppass->unifm_type, w->corner_type);
+	glUniform2f(ppass->unifm_texcoord, (float)w->g.x, (float)w->g.y);
+	glUniform2f(ppass->unifm_texsize, (float)w->widthb, (float)w->heightb);
+	glUniform2f(ppass->unifm_resolution, (float)gd->width, (float)gd->height);
 
-	if (ppass->unifm_tex_bg >= 0)
-			glUniform1i(ppass->unifm_tex_bg, (GLint)1);
-	if (ppass->unifm_radius)
-		glUniform1f(ppass->unifm_radius, (float)w->corner_radius);
-	if (ppass->unifm_type)
-		glUniform1f(ppass->unifm_type, (float)w->corner_type);
-	if (ppass->unifm_texcoord)
-		glUniform2f(ppass->unifm_texcoord, (float)w->g.x, (float)w->g.y);
-	if (ppass->unifm_texsize)
-		glUniform2f(ppass->unifm_texsize, (float)w->widthb, (float)w->heightb);
-	if (ppass->unifm_borderw)
-		glUniform1f(ppass->unifm_borderw, (w->round_borders) ? (w->border_width > 0 ? w->border_width : w->g.border_width) : 0);
-	if (ppass->unifm_resolution)
-		glUniform2f(ppass->unifm_resolution, (float)gd->width, (float)gd->height);
-
-	// Draw
-	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, gd->back_fbo);
 	glDrawElements(GL_TRIANGLES, nrects * 6, GL_UNSIGNED_INT, NULL);
+	gl_mark_back_painted(gd, &reg_corners);
+
+	// Cleanup
 	glDisableVertexAttribArray(vert_coord_loc);
 	glDisableVertexAttribArray(vert_in_texcoord_loc);
 	glBindVertexArray(0);
 	glDeleteVertexArrays(1, &vao);
-
-	// Cleanup
+	glActiveTexture(GL_TEXTURE1);
 	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
 	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
-	glDrawBuffer(GL_BACK);
-	glEnable(GL_BLEND);
-
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 	glDeleteBuffers(2, bo);
-
 	glUseProgram(0);
 	gl_check_err();
 
 	free(indices);
 	free(coord);
-
+	pixman_region32_fini(&reg_corners);
 	return true;
 }
 
-// Assumes the two textures are the same dimensions
-static bool copyFrameBufferTexture(int width, int height, GLuint fboIn, GLuint textureIn, GLuint fboOut, GLuint textureOut)
-{
-	bool ret = false;
-
-    // Bind input FBO + texture to a color attachment
-    glBindFramebuffer(GL_READ_FRAMEBUFFER, fboIn);
-    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textureIn, 0);
-	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) !=
-		GL_FRAMEBUFFER_COMPLETE) {
-		log_error("Source framebuffer attachment failed.");
-		goto out;
-	}
-    glReadBuffer(GL_COLOR_ATTACHMENT0);
-
-    // Bind destination FBO + texture to another color attachment
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fboOut);
-    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, textureOut, 0);
-	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) !=
-		GL_FRAMEBUFFER_COMPLETE) {
-		log_error("Destination framebuffer attachment failed.");
-		goto out;
-	}
-    glDrawBuffer(GL_COLOR_ATTACHMENT1);
-
-    // specify source, destination drawing (sub)rectangles.
-    glBlitFramebuffer(0, 0, width, height,
-                        0, 0, width, height,
-                        GL_COLOR_BUFFER_BIT, GL_NEAREST);
-
-	ret = true;
-
-out:
-    // unbind the color attachments
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, 0, 0);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-	gl_check_err();
-	return ret;
-}
-
-bool gl_store_back_texture(backend_t *backend_data attr_unused,
-			struct managed_win *w attr_unused, void *ctx_ attr_unused,
-			const region_t *reg_tgt attr_unused, int x attr_unused, int y attr_unused,
-			int width attr_unused, int height attr_unused) {
-
+bool gl_store_back_texture(backend_t *backend_data, struct managed_win *w, void *ctx_,
+                           const region_t *reg_tgt attr_unused, int x attr_unused,
+                           int y attr_unused, int width attr_unused,
+                           int height attr_unused) {
 	struct gl_round_context *cctx = ctx_;
 	auto gd = (struct gl_data *)backend_data;
 
-	//log_info("Copying xy(%d %d) wh(%d %d)", x, y, width, height);
+	// Have the window shader cut out the corners when the window is composed
+	auto img = (struct gl_image *)w->win_image;
+	if (img) {
+		img->corner_radius = w->corner_radius;
+		img->corner_type = w->corner_type;
+		img->corner_border_width = 0;
+		if (cctx->round_borders) {
+			img->corner_border_width =
+			    w->border_width > 0 ? w->border_width : w->g.border_width;
+		}
+	}
+	if (!w->blur_background) {
+		// Nothing will be painted over the background behind the corners
+		// before the window is composed, so there is nothing to restore.
+		return true;
+	}
 
-	{
-		// Prepare our backup texture
+	if (cctx->tex_sizes[0].width != gd->width ||
+	    cctx->tex_sizes[0].height != gd->height) {
 		glBindTexture(GL_TEXTURE_2D, cctx->bg_tex[0]);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, gd->width,
-				gd->height, 0, GL_BGR, GL_UNSIGNED_BYTE, NULL);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, gd->width, gd->height, 0,
+		             GL_BGRA, GL_UNSIGNED_BYTE, NULL);
 		glBindTexture(GL_TEXTURE_2D, 0);
-
-		copyFrameBufferTexture(gd->width, gd->height, gd->back_fbo, gd->back_texture, cctx->bg_fbo[0], cctx->bg_tex[0]);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, cctx->bg_fbo[0]);
+		glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+		                       GL_TEXTURE_2D, cctx->bg_tex[0], 0);
+		glDrawBuffer(GL_COLOR_ATTACHMENT0);
+		if (glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) !=
+		    GL_FRAMEBUFFER_COMPLETE) {
+			log_error("Framebuffer attachment failed.");
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+			return false;
+		}
+		cctx->tex_sizes[0].width = gd->width;
+		cctx->tex_sizes[0].height = gd->height;
+	}
+
+	// Only the background behind the corners is ever used
+	rect_t corners[4];
+	int ncorners = gl_corner_rects(w, corners);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, gd->back_fbo);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, cctx->bg_fbo[0]);
+	for (int i = 0; i < ncorners; i++) {
+		// Y-flip
+		int x1 = max2(corners[i].x1, 0), x2 = min2(corners[i].x2, gd->width);
+		int y1 = gd->height - min2(corners[i].y2, gd->height);
+		int y2 = gd->height - max2(corners[i].y1, 0);
+		if (x1 < x2 && y1 < y2) {
+			glBlitFramebuffer(x1, y1, x2, y2, x1, y1, x2, y2,
+			                  GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		}
 	}
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
 
+	gl_check_err();
 	return true;
 }
 
@@ -1100,14 +1455,20 @@ static int gl_win_shader_from_string(const char *vshader_str, const char *fshade
 		return -1;
 	}
 
-	// Get uniform addresses
-	ret->unifm_opacity = glGetUniformLocationChecked(ret->prog, "opacity");
-	ret->unifm_invert_color = glGetUniformLocationChecked(ret->prog, "invert_color");
+	// Get uniform addresses. Uniforms of features a variant doesn't have are
+	// optimized out, so they are expected to be missing.
+	ret->unifm_opacity = glGetUniformLocation(ret->prog, "opacity");
 	ret->unifm_tex = glGetUniformLocationChecked(ret->prog, "tex");
-	ret->unifm_dim = glGetUniformLocationChecked(ret->prog, "dim");
-	ret->unifm_brightness = glGetUniformLocationChecked(ret->prog, "brightness");
-	ret->unifm_max_brightness =
-	    glGetUniformLocationChecked(ret->prog, "max_brightness");
+	ret->unifm_dim = glGetUniformLocation(ret->prog, "dim");
+	ret->unifm_brightness = glGetUniformLocation(ret->prog, "brightness");
+	ret->unifm_max_brightness = glGetUniformLocation(ret->prog, "max_brightness");
+	ret->unifm_mask = glGetUniformLocation(ret->prog, "mask");
+	ret->unifm_y_flip = glGetUniformLocation(ret->prog, "y_flip");
+	ret->unifm_size = glGetUniformLocation(ret->prog, "size");
+	ret->unifm_corner_radius = glGetUniformLocation(ret->prog, "corner_radius");
+	ret->unifm_corner_type = glGetUniformLocation(ret->prog, "corner_type");
+	ret->unifm_corner_border_width =
+	    glGetUniformLocation(ret->prog, "corner_border_width");
 
 	glUseProgram(ret->prog);
 	int orig_loc = glGetUniformLocation(ret->prog, "orig");
@@ -1162,6 +1523,35 @@ static const char fill_vert[] = GLSL(330,
 	}
 );
 
+static const char shadow_frag[] = GLSL(330,
+	// Summed area table of the kernel
+	uniform sampler2D kernel_sum;
+	uniform int kernel_size;
+	// Size of the window casting the shadow
+	uniform ivec2 box_size;
+	uniform vec4 color;
+	float sum_to(int x, int y) {
+		if (x < 0 || y < 0) {
+			return 0.0;
+		}
+		return texelFetch(kernel_sum, ivec2(x, y), 0).r;
+	}
+	void main() {
+		// The window occupies [r, r + box_size) of the shadow, find the part of
+		// the kernel centered at this pixel that overlaps with it
+		ivec2 p = ivec2(gl_FragCoord.xy);
+		int r = kernel_size / 2;
+		ivec2 lo = max(ivec2(0), ivec2(2 * r) - p);
+		ivec2 hi = min(ivec2(kernel_size - 1), box_size + ivec2(2 * r - 1) - p);
+		float sum = 0.0;
+		if (all(lessThanEqual(lo, hi))) {
+			sum = sum_to(hi.x, hi.y) - sum_to(lo.x - 1, hi.y) -
+			      sum_to(hi.x, lo.y - 1) + sum_to(lo.x - 1, lo.y - 1);
+		}
+		gl_FragColor = color * clamp(sum, 0.0, 1.0);
+	}
+);
+
 static const char interpolating_frag[] = GLSL(330,
 	uniform sampler2D tex;
 	in vec2 texcoord;
@@ -1247,6 +1637,7 @@ static void _gl_fill(backend_t *base, struct color c, const region_t *clip, GLui
 
 void gl_fill(backend_t *base, struct color c, const region_t *clip) {
 	auto gd = (struct gl_data *)base;
+	gl_mark_back_painted(gd, clip);
 	return _gl_fill(base, c, clip, gd->back_fbo, gd->height, true);
 }
 
@@ -1263,8 +1654,19 @@ void gl_release_image(backend_t *base, void *image_data) {
 	gd->release_user_data(base, wd->inner);
 	assert(wd->inner->user_data == NULL);
 
-	glDeleteTextures(1, &wd->inner->texture);
-	glDeleteTextures(2, wd->inner->auxiliary_texture);
+	auto inner = wd->inner;
+	if (inner->pool_format) {
+		gl_put_pooled_texture(gd, inner->texture, inner->pool_format,
+		                      inner->width, inner->height);
+	} else {
+		glDeleteTextures(1, &inner->texture);
+	}
+	for (int i = 0; i < (int)ARR_SIZE(inner->auxiliary_texture); i++) {
+		if (inner->auxiliary_texture[i]) {
+			gl_put_pooled_texture(gd, inner->auxiliary_texture[i], GL_RGB8,
+			                      inner->width, inner->height);
+		}
+	}
 	free(wd->inner);
 	free(wd);
 	gl_check_err();
@@ -1310,6 +1712,7 @@ void gl_destroy_blur_context(backend_t *base attr_unused, void *ctx) {
 	bctx->blur_texture_count = 0;
 	bctx->blur_fbo_count = 0;
 
+	pixman_region32_fini(&bctx->pyramid_valid);
 	free(bctx);
 
 	gl_check_err();
@@ -1319,9 +1722,10 @@ void gl_destroy_round_context(struct backend_base *base attr_unused, void *ctx a
 
 	struct gl_round_context *cctx = ctx;
 
-	if (cctx->round_shader && cctx->round_shader->prog) {
-		glDeleteProgram(cctx->round_shader->prog);
-		cctx->round_shader->prog = 0;
+	if (cctx->round_shader) {
+		if (cctx->round_shader->prog) {
+			glDeleteProgram(cctx->round_shader->prog);
+		}
 		free(cctx->round_shader);
 	}
 
@@ -1557,9 +1961,11 @@ bool gl_create_dual_kawase_blur_context(void *blur_context, GLfloat *projection,
 
 	auto blur_params = generate_dual_kawase_params(args);
 
-	// Specify required textures and FBOs
-	ctx->blur_texture_count = blur_params->iterations;
-	ctx->blur_fbo_count = blur_params->iterations;
+	// Specify required textures and FBOs, one of each per iteration for
+	// downsampling, and one less for upsampling
+	ctx->iterations = blur_params->iterations;
+	ctx->blur_texture_count = blur_params->iterations * 2 - 1;
+	ctx->blur_fbo_count = blur_params->iterations * 2 - 1;
 
 	ctx->resize_width += blur_params->expand;
 	ctx->resize_height += blur_params->expand;
@@ -1714,6 +2120,7 @@ void *gl_create_blur_context(backend_t *base, enum blur_method method, void *arg
 	auto gd = (struct gl_data *)base;
 
 	auto ctx = ccalloc(1, struct gl_blur_context);
+	pixman_region32_init(&ctx->pyramid_valid);
 
 	if (!method || method >= BLUR_METHOD_INVALID) {
 		ctx->method = BLUR_METHOD_NONE;
@@ -1798,140 +2205,59 @@ void *gl_create_round_context(struct backend_base *base attr_unused, void *args
 	                                   {0, 2.0f / (GLfloat)viewport_dimensions[1], 0, 0},
 	                                   {0, 0, 0, 0},
 	                                   {-1, -1, 0, 1}};
-    GLfloat *projection = projection_matrix[0];
 
 	ctx->round_borders = round_params->round_borders;
 	ctx->round_shader = ccalloc(1, gl_round_shader_t);
 
-	char *lc_numeric_old = strdup(setlocale(LC_NUMERIC, NULL));
-	// Enforce LC_NUMERIC locale "C" here to make sure decimal point is sane
-	// Thanks to hiciu for reporting.
-	setlocale(LC_NUMERIC, "C");
-
-	// Dual-kawase downsample shader / program
-	auto pass = ctx->round_shader;
-	{
-		// TEST passthrough shader
-		/*static const char frag_passthrough[] = GLSL(330,
-			uniform sampler2D tex;
-			in vec2 texcoord;
-			void main() {
-				//gl_FragColor = texture2D(tex, texcoord);
-				//gl_FragColor = vec4(texture2D(tex, vec2(texcoord.xy), 0).rgb, 1);
-				gl_FragColor = texelFetch(tex, ivec2(texcoord.xy), 0);
-				//gl_FragColor = vec4(1.0, 0.0, 0.0, 1.0);
-			}
-		);*/
-
-		// dst0 shader from opengl.c
-		// clang-format off
-		static const char *FRAG_SHADER_ROUND_CORNERS = GLSL(330,
-			uniform sampler2D tex;
-			uniform sampler2D tex_bg;
-			uniform float u_radius;
-			uniform float u_type;
-			uniform float u_borderw;
-			uniform vec2 u_texcoord;
-			uniform vec2 u_texsize;
-			uniform vec2 u_resolution;
-			in vec2 texcoord;
-			out vec4 out_color;
-			// https://www.shadertoy.com/view/ltS3zW
-			float RectSDF(vec2 p, vec2 b, float r) {
-			  vec2 d = abs(p) - b + vec2(r);
-			  return min(max(d.x, d.y), 0.0) + length(max(d, 0.0)) - r;
-			}
-			void main() {
-				vec2 coord = vec2(u_texcoord.x, u_resolution.y-u_texsize.y-u_texcoord.y);
-				vec4 u_v4WndBgColor = texelFetch(tex_bg, ivec2(gl_FragCoord.xy), 0);
-				vec4 u_v4BorderColor = texelFetch(tex, ivec2(0, 0), 0);
-				vec4 u_v4FillColor = vec4(0.0, 0.0, 0.0, 0.0);  // Inside rect, transparent
-				vec4 v4FromColor = u_v4BorderColor;				// Always the border color. If no border, this still should be set
-				vec4 v4ToColor = u_v4WndBgColor;				// Outside corners color = background texture
-				float u_fRadiusPx = u_radius;
-				int u_iType = int(u_type);
-				float u_fHalfBorderThickness = u_borderw / 2.0;
-
-				// misc tests, uncomment for diff rect colors
-				//u_v4FillColor = texture2D(tex, texcoord/u_texsize);
-				//u_v4FillColor = texelFetch(tex, ivec2(texcoord.xy), 0);
-				//u_v4FillColor = vec4(0.0, 1.0, 0.0, 0.0);  // Inside rect color
-				//v4FromColor = u_v4BorderColor = vec4(1.0, 1.0, 0.0, 1.0);
-				//v4ToColor = vec4(0.0, 0.0, 1.0, 1.0); //Outside color
-
-				vec2 u_v2HalfShapeSizePx = u_texsize/2.0 - vec2(u_fHalfBorderThickness);
-				vec2 v_v2CenteredPos = (gl_FragCoord.xy - u_texsize.xy / 2.0 - coord);
-
-				if ((v_v2CenteredPos.x < u_v2HalfShapeSizePx.x - u_fRadiusPx &&
-			     v_v2CenteredPos.y > u_v2HalfShapeSizePx.y - u_fRadiusPx &&
-			     u_iType%2<1) ||
-			    (v_v2CenteredPos.x > u_v2HalfShapeSizePx.x - u_fRadiusPx &&
-			     v_v2CenteredPos.y > u_v2HalfShapeSizePx.y - u_fRadiusPx &&
-			     u_iType%4<2) ||
-			    (v_v2CenteredPos.x < u_v2HalfShapeSizePx.x - u_fRadiusPx &&
-			     v_v2CenteredPos.y < u_v2HalfShapeSizePx.y - u_fRadiusPx &&
-			     u_iType<8) ||
-			    (v_v2CenteredPos.x > u_v2HalfShapeSizePx.x - u_fRadiusPx &&
-			     v_v2CenteredPos.y < u_v2HalfShapeSizePx.y - u_fRadiusPx &&
-			     u_iType%8<4)) u_fRadiusPx = 0.0;
-
-				float fDist = RectSDF(v_v2CenteredPos, u_v2HalfShapeSizePx, u_fRadiusPx - u_fHalfBorderThickness);
-				if (u_fHalfBorderThickness > 0.0) {
-					if (fDist < 0.0) {
-						v4ToColor = u_v4FillColor;
-					}
-					fDist = abs(fDist) - u_fHalfBorderThickness;
-				} else {
-					v4FromColor = u_v4FillColor;
-				}
-				float fBlendAmount = smoothstep(-1.0, 1.0, fDist);
-
-				// final color
-				vec4 c = mix(v4FromColor, v4ToColor, fBlendAmount);
-				// we don't use discard due to alleged worse perf
-				// instead we can use alpha blending
-				//if ( c == vec4(0.0,0.0,0.0,0.0) ) discard; else
-				out_color = c;
-			}
-		);
-		// clang-format on
-
-		// Build shader
-		const char* SHADER_STR = FRAG_SHADER_ROUND_CORNERS;
-		//const char* SHADER_STR = frag_passthrough;
-		size_t shader_len = strlen(SHADER_STR) + 1 /* null terminator */;
-		char *shader_str = ccalloc(shader_len, char);
-		auto real_shader_len = snprintf(shader_str, shader_len, "%s", SHADER_STR);
-		CHECK(real_shader_len >= 0);
-		CHECK((size_t)real_shader_len < shader_len);
-
-		// Build program
-		pass->prog = gl_create_program_from_str(vertex_shader, shader_str);
-		free(shader_str);
-		if (!pass->prog) {
-			log_error("Failed to create GLSL program.");
-			success = false;
-			goto out;
+	// Puts the background back outside of the rounded corners of a window
+	// clang-format off
+	static const char round_shader_glsl[] = QUOTE(
+		uniform sampler2D tex_bg;
+		uniform float radius;
+		uniform int corner_type;
+		uniform vec2 win_pos;
+		uniform vec2 win_size;
+		uniform vec2 resolution;
+		out vec4 out_color;
+		void main() {
+			// Position in the window, top row first
+			vec2 pos = vec2(gl_FragCoord.x, resolution.y - gl_FragCoord.y);
+			pos -= win_pos;
+			float d = corner_distance(pos, win_size, radius, corner_type);
+			float coverage = clamp(radius + 0.5 - d, 0.0, 1.0);
+			vec4 bg = texelFetch(tex_bg, ivec2(gl_FragCoord.xy), 0);
+			out_color = vec4(bg.rgb, 1.0) * (1.0 - coverage);
 		}
-		glBindFragDataLocation(pass->prog, 0, "out_color");
-
-		// Get uniform addresses
-		pass->unifm_tex_bg = glGetUniformLocationChecked(pass->prog, "tex_bg");
-		pass->unifm_radius = glGetUniformLocationChecked(pass->prog, "u_radius");
-		pass->unifm_type = glGetUniformLocationChecked(pass->prog, "u_type");
-		pass->unifm_texcoord = glGetUniformLocationChecked(pass->prog, "u_texcoord");
-		pass->unifm_texsize = glGetUniformLocationChecked(pass->prog, "u_texsize");
-		pass->unifm_borderw = glGetUniformLocationChecked(pass->prog, "u_borderw");
-		pass->unifm_resolution = glGetUniformLocationChecked(pass->prog, "u_resolution");
+	);
+	// clang-format on
 
-		// Setup projection matrix
-		glUseProgram(pass->prog);
-		int pml = glGetUniformLocationChecked(pass->prog, "projection");
-		glUniformMatrix4fv(pml, 1, false, projection);
-		glUseProgram(0);
+	auto pass = ctx->round_shader;
+	auto shader_str = mstrjoin3("#version 330\n", corner_distance_glsl,
+	                            round_shader_glsl);
+	pass->prog = gl_create_program_from_str(vertex_shader, shader_str);
+	free(shader_str);
+	if (!pass->prog) {
+		log_error("Failed to create GLSL program.");
+		success = false;
+		goto out;
 	}
+	glBindFragDataLocation(pass->prog, 0, "out_color");
+
+	// Get uniform addresses
+	pass->unifm_tex_bg = glGetUniformLocationChecked(pass->prog, "tex_bg");
+	pass->unifm_radius = glGetUniformLocationChecked(pass->prog, "radius");
+	pass->unifm_type = glGetUniformLocationChecked(pass->prog, "corner_type");
+	pass->unifm_texcoord = glGetUniformLocationChecked(pass->prog, "win_pos");
+	pass->unifm_texsize = glGetUniformLocationChecked(pass->prog, "win_size");
+	pass->unifm_resolution = glGetUniformLocationChecked(pass->prog, "resolution");
+
+	// Setup projection matrix
+	glUseProgram(pass->prog);
+	int pml = glGetUniformLocationChecked(pass->prog, "projection");
+	glUniformMatrix4fv(pml, 1, false, projection_matrix[0]);
+	glUseProgram(0);
 
-	// Texture size will be defined by gl_round
+	// Texture size will be defined by gl_store_back_texture
 	ctx->tex_count = 1;
 	ctx->bg_tex = ccalloc(ctx->tex_count, GLuint);
 	ctx->tex_sizes = ccalloc(ctx->tex_count, struct tex_size);
@@ -1959,11 +2285,6 @@ void *gl_create_round_context(struct backend_base *base attr_unused, void *args
 	success = true;
 
 out:
-
-	// Restore LC_NUMERIC
-	setlocale(LC_NUMERIC, lc_numeric_old);
-	free(lc_numeric_old);
-
 	if (!success) {
 		gl_destroy_round_context(&gd->base, ctx);
 		ctx = NULL;
@@ -1974,29 +2295,59 @@ out:
 }
 
 // clang-format off
-const char *win_shader_glsl = GLSL(330,
+/// Window shader, without the version and the feature constants, which are prepended
+/// by win_shader_variant_source. The compiler removes the code of disabled features.
+static const char win_shader_glsl[] = QUOTE(
 	uniform float opacity;
 	uniform float dim;
-	uniform bool invert_color;
 	in vec2 texcoord;
 	uniform sampler2D tex;
 	uniform sampler2D brightness;
 	uniform float max_brightness;
+	uniform sampler2D mask;
+	uniform bool y_flip;
+	uniform vec2 size;
+	uniform float corner_radius;
+	uniform int corner_type;
+	uniform float corner_border_width;
 
 	void main() {
 		vec4 c = texelFetch(tex, ivec2(texcoord), 0);
-		if (invert_color) {
+		// Position in the image, top row first
+		vec2 pos = y_flip ? vec2(texcoord.x, -texcoord.y) : texcoord;
+		if (has_rounded_corners) {
+			float d = corner_distance(pos, size, corner_radius, corner_type);
+			if (corner_border_width > 0.0 && d > 0.0) {
+				// Continue the border along the arc. Any corner pixel
+				// of the image is part of the border.
+				vec4 border = texelFetch(tex, ivec2(0, 0), 0);
+				float inner = corner_radius - corner_border_width;
+				c = mix(c, border, clamp(d - inner + 0.5, 0.0, 1.0));
+			}
+			c *= clamp(corner_radius + 0.5 - d, 0.0, 1.0);
+		}
+		if (has_mask) {
+			c *= texelFetch(mask, ivec2(pos), 0).r;
+		}
+		if (has_invert) {
 			c = vec4(c.aaa - c.rgb, c.a);
 		}
-		c = vec4(c.rgb * (1.0 - dim), c.a) * opacity;
+		if (has_dim) {
+			c = vec4(c.rgb * (1.0 - dim), c.a);
+		}
+		if (has_opacity) {
+			c *= opacity;
+		}
 
-		vec3 rgb_brightness = texelFetch(brightness, ivec2(0, 0), 0).rgb;
-		// Ref: https://en.wikipedia.org/wiki/Relative_luminance
-		float brightness = rgb_brightness.r * 0.21 +
-		                   rgb_brightness.g * 0.72 +
-		                   rgb_brightness.b * 0.07;
-		if (brightness > max_brightness)
-			c.rgb = c.rgb * (max_brightness / brightness);
+		if (has_brightness) {
+			vec3 rgb_brightness = texelFetch(brightness, ivec2(0, 0), 0).rgb;
+			// Ref: https://en.wikipedia.org/wiki/Relative_luminance
+			float brightness = rgb_brightness.r * 0.21 +
+			                   rgb_brightness.g * 0.72 +
+			                   rgb_brightness.b * 0.07;
+			if (brightness > max_brightness)
+				c.rgb = c.rgb * (max_brightness / brightness);
+		}
 
 		gl_FragColor = c;
 	}
@@ -2013,7 +2364,54 @@ const char *present_vertex_shader = GLSL(330,
 );
 // clang-format on
 
+/// Source of the window shader variant with the given features
+static char *win_shader_variant_source(unsigned features) {
+	char *ret = NULL;
+	int len = asprintf(&ret,
+	                   "#version 330\n"
+	                   "const bool has_opacity = %s;\n"
+	                   "const bool has_dim = %s;\n"
+	                   "const bool has_invert = %s;\n"
+	                   "const bool has_brightness = %s;\n"
+	                   "const bool has_mask = %s;\n"
+	                   "const bool has_rounded_corners = %s;\n"
+	                   "%s%s",
+	                   features & WIN_SHADER_OPACITY ? "true" : "false",
+	                   features & WIN_SHADER_DIM ? "true" : "false",
+	                   features & WIN_SHADER_INVERT ? "true" : "false",
+	                   features & WIN_SHADER_BRIGHTNESS ? "true" : "false",
+	                   features & WIN_SHADER_MASK ? "true" : "false",
+	                   features & WIN_SHADER_ROUNDED ? "true" : "false",
+	                   corner_distance_glsl, win_shader_glsl);
+	allocchk(len >= 0 ? ret : NULL);
+	return ret;
+}
+
+static gl_win_shader_t *gl_get_win_shader(struct gl_data *gd, unsigned features) {
+	assert(features < WIN_SHADER_VARIANT_COUNT);
+	auto shader = &gd->win_shaders[features];
+	if (shader->prog) {
+		return shader;
+	}
+
+	log_debug("Building window shader variant %#x", features);
+	auto source = win_shader_variant_source(features);
+	gl_win_shader_from_string(vertex_shader, source, shader);
+	free(source);
+	if (!shader->prog) {
+		return NULL;
+	}
+
+	int pml = glGetUniformLocationChecked(shader->prog, "projection");
+	glUseProgram(shader->prog);
+	glUniformMatrix4fv(pml, 1, false, gd->projection_matrix[0]);
+	glUseProgram(0);
+	return shader;
+}
+
 bool gl_init(struct gl_data *gd, session_t *ps) {
+	pixman_region32_init(&gd->back_painted);
+
 	// Initialize GLX data structure
 	glDisable(GL_DEPTH_TEST);
 	glDepthMask(GL_FALSE);
@@ -2040,9 +2438,12 @@ bool gl_init(struct gl_data *gd, session_t *ps) {
 	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
+	gl_texture_pool_init(&gd->texture_pool);
 	glGenFramebuffers(1, &gd->back_fbo);
+	glGenFramebuffers(1, &gd->image_fbo);
+	glGenFramebuffers(1, &gd->average_fbo);
 	glGenTextures(1, &gd->back_texture);
-	if (!gd->back_fbo || !gd->back_texture) {
+	if (!gd->back_fbo || !gd->image_fbo || !gd->average_fbo || !gd->back_texture) {
 		log_error("Failed to generate a framebuffer object");
 		return false;
 	}
@@ -2061,22 +2462,49 @@ bool gl_init(struct gl_data *gd, session_t *ps) {
 	                                   {0, 2.0f / (GLfloat)viewport_dimensions[1], 0, 0},
 	                                   {0, 0, 0, 0},
 	                                   {-1, -1, 0, 1}};
+	memcpy(gd->projection_matrix, projection_matrix, sizeof(projection_matrix));
 
-	// Initialize shaders
-	gl_win_shader_from_string(vertex_shader, win_shader_glsl, &gd->win_shader);
-	int pml = glGetUniformLocationChecked(gd->win_shader.prog, "projection");
-	glUseProgram(gd->win_shader.prog);
-	glUniformMatrix4fv(pml, 1, false, projection_matrix[0]);
-	glUseProgram(0);
+	// Initialize shaders. Only the plain window shader is built here, the other
+	// variants are built when they are first needed.
+	if (!gl_get_win_shader(gd, 0)) {
+		log_error("Failed to create the window shader");
+		return false;
+	}
+
+	// Build the rest of the shaders in one batch, so they can be compiled in parallel
+	const char *vert_shaders[] = {fill_vert, fill_vert, present_vertex_shader,
+	                              interpolating_vert};
+	const char *frag_shaders[] = {fill_frag, shadow_frag, dummy_frag,
+	                              interpolating_frag};
+	GLuint progs[ARR_SIZE(vert_shaders)];
+	gl_create_programs_from_str(ARR_SIZE(vert_shaders), vert_shaders, frag_shaders,
+	                            progs);
 
-	gd->fill_shader.prog = gl_create_program_from_str(fill_vert, fill_frag);
+	gd->fill_shader.prog = progs[0];
 	gd->fill_shader.color_loc = glGetUniformLocation(gd->fill_shader.prog, "color");
-	pml = glGetUniformLocationChecked(gd->fill_shader.prog, "projection");
+	int pml = glGetUniformLocationChecked(gd->fill_shader.prog, "projection");
 	glUseProgram(gd->fill_shader.prog);
 	glUniformMatrix4fv(pml, 1, false, projection_matrix[0]);
 	glUseProgram(0);
 
-	gd->present_prog = gl_create_program_from_str(present_vertex_shader, dummy_frag);
+	gd->shadow_shader.prog = progs[1];
+	if (!gd->shadow_shader.prog) {
+		log_error("Failed to create the shadow shader");
+		return false;
+	}
+	gd->shadow_shader.unifm_kernel_size =
+	    glGetUniformLocationChecked(gd->shadow_shader.prog, "kernel_size");
+	gd->shadow_shader.unifm_box_size =
+	    glGetUniformLocationChecked(gd->shadow_shader.prog, "box_size");
+	gd->shadow_shader.unifm_color =
+	    glGetUniformLocationChecked(gd->shadow_shader.prog, "color");
+	pml = glGetUniformLocationChecked(gd->shadow_shader.prog, "projection");
+	glUseProgram(gd->shadow_shader.prog);
+	glUniform1i(glGetUniformLocationChecked(gd->shadow_shader.prog, "kernel_sum"), 0);
+	glUniformMatrix4fv(pml, 1, false, projection_matrix[0]);
+	glUseProgram(0);
+
+	gd->present_prog = progs[2];
 	if (!gd->present_prog) {
 		log_error("Failed to create the present shader");
 		return false;
@@ -2087,8 +2515,7 @@ bool gl_init(struct gl_data *gd, session_t *ps) {
 	glUniformMatrix4fv(pml, 1, false, projection_matrix[0]);
 	glUseProgram(0);
 
-	gd->brightness_shader.prog =
-	    gl_create_program_from_str(interpolating_vert, interpolating_frag);
+	gd->brightness_shader.prog = progs[3];
 	if (!gd->brightness_shader.prog) {
 		log_error("Failed to create the brightness shader");
 		return false;
@@ -2126,12 +2553,27 @@ bool gl_init(struct gl_data *gd, session_t *ps) {
 }
 
 void gl_deinit(struct gl_data *gd) {
-	gl_free_prog_main(&gd->win_shader);
+	for (int i = 0; i < WIN_SHADER_VARIANT_COUNT; i++) {
+		gl_free_prog_main(&gd->win_shaders[i]);
+	}
+	if (gd->shadow_shader.prog) {
+		glDeleteProgram(gd->shadow_shader.prog);
+		gd->shadow_shader.prog = 0;
+	}
+
+	log_debug("Texture pool: %lu hits, %lu misses, %lu evictions",
+	          gd->texture_pool.hits, gd->texture_pool.misses,
+	          gd->texture_pool.evictions);
+	gl_texture_pool_deinit(&gd->texture_pool);
+	glDeleteFramebuffers(1, &gd->image_fbo);
+	glDeleteFramebuffers(1, &gd->average_fbo);
+	gd->image_fbo = gd->average_fbo = 0;
 
 	if (gd->logger) {
 		log_remove_target_tls(gd->logger);
 		gd->logger = NULL;
 	}
+	pixman_region32_fini(&gd->back_painted);
 
 	gl_check_err();
 }
@@ -2154,6 +2596,22 @@ GLuint gl_new_texture(GLenum target) {
 	return texture;
 }
 
+/// Size limit of the texture pool, in bytes
+static size_t gl_texture_pool_budget(struct gl_data *gd) {
+	return (size_t)gd->base.ps->o.glx_texture_pool_size * 1024 * 1024;
+}
+
+GLuint gl_get_pooled_texture(struct gl_data *gd, GLenum internal_format, int width,
+                             int height) {
+	return gl_texture_pool_get(&gd->texture_pool, internal_format, width, height);
+}
+
+void gl_put_pooled_texture(struct gl_data *gd, GLuint texture, GLenum internal_format,
+                           int width, int height) {
+	gl_texture_pool_put(&gd->texture_pool, texture, internal_format, width, height,
+	                    gl_texture_pool_budget(gd));
+}
+
 /// Decouple `img` from the image it references, also applies all the lazy operations
 static inline void gl_image_decouple(backend_t *base, struct gl_image *img) {
 	if (img->inner->refcount == 1) {
@@ -2163,18 +2621,16 @@ static inline void gl_image_decouple(backend_t *base, struct gl_image *img) {
 	auto gd = (struct gl_data *)base;
 	auto new_tex = ccalloc(1, struct gl_texture);
 
-	new_tex->texture = gl_new_texture(GL_TEXTURE_2D);
-	glBindTexture(GL_TEXTURE_2D, new_tex->texture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, img->inner->width, img->inner->height, 0,
-	             GL_BGRA, GL_UNSIGNED_BYTE, NULL);
+	new_tex->texture =
+	    gl_get_pooled_texture(gd, GL_RGBA8, img->inner->width, img->inner->height);
+	new_tex->pool_format = GL_RGBA8;
 	new_tex->y_inverted = true;
 	new_tex->height = img->inner->height;
 	new_tex->width = img->inner->width;
 	new_tex->refcount = 1;
 	new_tex->user_data = gd->decouple_texture_user_data(base, img->inner->user_data);
 
-	GLuint fbo;
-	glGenFramebuffers(1, &fbo);
+	GLuint fbo = gd->image_fbo;
 	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
 	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
 	                       new_tex->texture, 0);
@@ -2203,9 +2659,11 @@ static inline void gl_image_decouple(backend_t *base, struct gl_image *img) {
 	};
 	// clang-format on
 
-	_gl_compose(base, img, fbo, coord, (GLuint[]){0, 1, 2, 2, 3, 0}, 1);
+	_gl_compose(base, img, NULL, fbo, coord, (GLuint[]){0, 1, 2, 2, 3, 0}, 1);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+	                       0, 0);
 	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
-	glDeleteFramebuffers(1, &fbo);
 
 	img->inner->refcount--;
 	img->inner = new_tex;
@@ -2221,16 +2679,34 @@ static void gl_image_apply_alpha(backend_t *base, struct gl_image *img,
 	// Result color = 0 (GL_ZERO) + alpha (GL_CONSTANT_ALPHA) * original color
 	glBlendFunc(GL_ZERO, GL_CONSTANT_ALPHA);
 	glBlendColor(0, 0, 0, (GLclampf)alpha);
-	GLuint fbo;
-	glGenFramebuffers(1, &fbo);
+	auto gd = (struct gl_data *)base;
+	GLuint fbo = gd->image_fbo;
 	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
 	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
 	                       img->inner->texture, 0);
 	glDrawBuffer(GL_COLOR_ATTACHMENT0);
 	_gl_fill(base, (struct color){0, 0, 0, 0}, reg_op, fbo, 0, false);
 	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+	                       0, 0);
 	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
-	glDeleteFramebuffers(1, &fbo);
+}
+
+void gl_prepare(backend_t *base, const region_t *reg_damage attr_unused) {
+	auto gd = (struct gl_data *)base;
+	// The downsampled back buffer kept by the blur is only reused within a frame
+	pixman_region32_union_rect(&gd->back_painted, &gd->back_painted, 0, 0,
+	                           (uint)gd->width, (uint)gd->height);
+	// The budget can be lowered by reloading the configuration
+	gl_texture_pool_trim(&gd->texture_pool, gl_texture_pool_budget(gd));
+}
+
+void gl_image_damaged(backend_t *base attr_unused, void *image,
+                      const region_t *reg_damage attr_unused) {
+	// Textures are bound to their pixmaps and always have the current content,
+	// but what we computed from that content is outdated once they are damaged.
+	((struct gl_image *)image)->inner->average_color = 0;
 }
 
 void gl_present(backend_t *base, const region_t *region) {
@@ -2300,6 +2776,7 @@ bool gl_image_op(backend_t *base, enum image_operations op, void *image_data,
 		gl_image_decouple(base, tex);
 		assert(tex->inner->refcount == 1);
 		gl_image_apply_alpha(base, tex, reg_op, *(double *)arg);
+		tex->inner->average_color = 0;
 		break;
 	case IMAGE_OP_RESIZE_TILE:
 		// texture is already set to repeat, so nothing else we need to do
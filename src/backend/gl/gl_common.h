@@ -7,6 +7,7 @@
 #include <string.h>
 
 #include "backend/backend.h"
+#include "backend/gl/texture_pool.h"
 #include "log.h"
 #include "region.h"
 
@@ -17,13 +18,30 @@
 typedef struct {
 	GLuint prog;
 	GLint unifm_opacity;
-	GLint unifm_invert_color;
 	GLint unifm_tex;
 	GLint unifm_dim;
 	GLint unifm_brightness;
 	GLint unifm_max_brightness;
+	GLint unifm_mask;
+	GLint unifm_y_flip;
+	GLint unifm_size;
+	GLint unifm_corner_radius;
+	GLint unifm_corner_type;
+	GLint unifm_corner_border_width;
 } gl_win_shader_t;
 
+/// Optional features of the window shader. Every combination of them is a separate
+/// variant of the shader, so windows only pay for the features they use.
+enum gl_win_shader_feature {
+	WIN_SHADER_OPACITY = 1 << 0,
+	WIN_SHADER_DIM = 1 << 1,
+	WIN_SHADER_INVERT = 1 << 2,
+	WIN_SHADER_BRIGHTNESS = 1 << 3,
+	WIN_SHADER_MASK = 1 << 4,
+	WIN_SHADER_ROUNDED = 1 << 5,
+	WIN_SHADER_VARIANT_COUNT = 1 << 6,
+};
+
 // Program and uniforms for brightness shader
 typedef struct {
 	GLuint prog;
@@ -43,15 +61,12 @@ typedef struct {
 
 typedef struct {
 	GLuint prog;
-	GLint projection_loc;
 	GLint unifm_radius;
 	GLint unifm_type;
 	GLint unifm_texcoord;
 	GLint unifm_texsize;
-	GLint unifm_borderw;
 	GLint unifm_resolution;
 	GLint unifm_tex_bg;
-	GLint unifm_tex_wnd;
 } gl_round_shader_t;
 
 typedef struct {
@@ -59,6 +74,14 @@ typedef struct {
 	GLint color_loc;
 } gl_fill_shader_t;
 
+// Program and uniforms for shadow shader
+typedef struct {
+	GLuint prog;
+	GLint unifm_kernel_size;
+	GLint unifm_box_size;
+	GLint unifm_color;
+} gl_shadow_shader_t;
+
 struct gl_texture {
 	int refcount;
 	GLuint texture;
@@ -67,6 +90,12 @@ struct gl_texture {
 
 	// Textures for auxiliary uses.
 	GLuint auxiliary_texture[2];
+	/// 1x1 texture holding the average color of `texture`, one of the auxiliary
+	/// textures. 0 if it has to be computed again, because the content changed.
+	GLuint average_color;
+	/// Internal format of `texture` if it's from the texture pool, 0 if the texture
+	/// is bound to a pixmap.
+	GLenum pool_format;
 	void *user_data;
 };
 
@@ -79,6 +108,13 @@ typedef struct gl_image {
 	int ewidth, eheight;
 	bool has_alpha;
 	bool color_inverted;
+	/// Radius of the rounded corners, 0 if the corners are not rounded. Everything
+	/// outside of the corners is cut off when the image is composed.
+	int corner_radius;
+	/// Which corners are rounded, see managed_win::corner_type
+	int corner_type;
+	/// Width of the border drawn along the rounded corners, 0 for none
+	int corner_border_width;
 } gl_image_t;
 
 struct gl_data {
@@ -87,11 +123,26 @@ struct gl_data {
 	bool is_nvidia;
 	// Height and width of the root window
 	int height, width;
-	gl_win_shader_t win_shader;
+	/// Variants of the window shader, indexed by their features. Built on first use.
+	gl_win_shader_t win_shaders[WIN_SHADER_VARIANT_COUNT];
+	/// Maps screen coordinates to NDC, shared by all shaders
+	GLfloat projection_matrix[4][4];
 	gl_brightness_shader_t brightness_shader;
 	gl_fill_shader_t fill_shader;
+	gl_shadow_shader_t shadow_shader;
 	GLuint back_texture, back_fbo;
+	/// Parts of the back buffer painted since the last blur, in X coordinates. Tells
+	/// which parts of the downsampled back buffer kept by dual-kawase blur are stale.
+	region_t back_painted;
 	GLuint present_prog;
+	/// Textures released by images, reused by new ones of the same size
+	struct gl_texture_pool texture_pool;
+	/// Framebuffer used to render into images. Its attachment is changed as needed,
+	/// instead of creating a framebuffer every time.
+	GLuint image_fbo;
+	/// Framebuffer used to compute average colors, which can happen while
+	/// `image_fbo` is in use.
+	GLuint average_fbo;
 
 	/// Called when an gl_texture is decoupled from the texture it refers. Returns
 	/// the decoupled user_data
@@ -106,17 +157,32 @@ struct gl_data {
 typedef struct session session_t;
 
 #define GL_PROG_MAIN_INIT                                                                \
-	{ .prog = 0, .unifm_opacity = -1, .unifm_invert_color = -1, .unifm_tex = -1, }
+	{ .prog = 0, .unifm_opacity = -1, .unifm_tex = -1, }
 
 GLuint gl_create_shader(GLenum shader_type, const char *shader_str);
 GLuint gl_create_program(const GLuint *const shaders, int nshaders);
 GLuint gl_create_program_from_str(const char *vert_shader_str, const char *frag_shader_str);
+/// Create `n` programs from pairs of vertex and fragment shader strings, like
+/// `gl_create_program_from_str`. Programs that fail to build are set to 0.
+void gl_create_programs_from_str(int n, const char *const *vert_shader_strs,
+                                 const char *const *frag_shader_strs, GLuint *progs);
 
 /**
  * @brief Render a region with texture data.
  */
-void gl_compose(backend_t *, struct managed_win *, void *ptex, int dst_x, int dst_y, const region_t *reg_tgt,
-                const region_t *reg_visible);
+void gl_compose(backend_t *, struct managed_win *, void *ptex, void *mask, int dst_x,
+                int dst_y, const region_t *reg_tgt, const region_t *reg_visible);
+
+/**
+ * @brief Create a mask texture from a region.
+ */
+void *gl_make_mask(backend_t *base, int width, int height, const region_t *reg);
+
+/**
+ * @brief Render a shadow directly into a texture.
+ */
+void *gl_render_shadow(backend_t *base, int width, int height, const conv *kernel,
+                       double r, double g, double b, double a);
 
 void gl_resize(struct gl_data *, int width, int height);
 
@@ -125,6 +191,13 @@ void gl_deinit(struct gl_data *gd);
 
 GLuint gl_new_texture(GLenum target);
 
+/// Get a texture from the texture pool of `gd`, see `gl_texture_pool_get`
+GLuint gl_get_pooled_texture(struct gl_data *gd, GLenum internal_format, int width,
+                             int height);
+/// Return a texture from `gl_get_pooled_texture` to the pool
+void gl_put_pooled_texture(struct gl_data *gd, GLuint texture, GLenum internal_format,
+                           int width, int height);
+
 bool gl_image_op(backend_t *base, enum image_operations op, void *image_data,
                  const region_t *reg_op, const region_t *reg_visible, void *arg);
 
@@ -149,6 +222,8 @@ bool gl_store_back_texture(backend_t *backend_data, struct managed_win *w,
 bool gl_is_image_transparent(backend_t *base, void *image_data);
 void gl_fill(backend_t *base, struct color, const region_t *clip);
 
+void gl_prepare(backend_t *base, const region_t *reg_damage);
+void gl_image_damaged(backend_t *base, void *image, const region_t *reg_damage);
 void gl_present(backend_t *base, const region_t *);
 
 static inline void gl_delete_texture(GLuint texture) {
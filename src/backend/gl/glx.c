@@ -511,6 +511,8 @@ static void glx_diagnostics(backend_t *base) {
 	}
 #endif
 
+	gl_texture_pool_print_stats(&gd->gl.texture_pool);
+
 	if (warn_software_rendering) {
 		printf("\n(You are using a software renderer. Unless you are doing this\n"
 		       "intentionally, this means you don't have a graphics driver\n"
@@ -524,6 +526,8 @@ struct backend_operations glx_ops = {
     .deinit = glx_deinit,
     .bind_pixmap = glx_bind_pixmap,
     .release_image = gl_release_image,
+    .prepare = gl_prepare,
+    .image_damaged = gl_image_damaged,
     .compose = gl_compose,
     .image_op = gl_image_op,
     .copy = gl_copy,
@@ -532,7 +536,8 @@ struct backend_operations glx_ops = {
     .is_image_transparent = gl_is_image_transparent,
     .present = glx_present,
     .buffer_age = glx_buffer_age,
-    .render_shadow = default_backend_render_shadow,
+    .render_shadow = gl_render_shadow,
+    .make_mask = gl_make_mask,
     .fill = gl_fill,
     .create_blur_context = gl_create_blur_context,
     .destroy_blur_context = gl_destroy_blur_context,
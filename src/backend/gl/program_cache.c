@@ -0,0 +1,206 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (c) Yuxuan Shui <yshuiv7@gmail.com>
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "string_utils.h"
+#include "utils.h"
+
+#include "backend/gl/gl_common.h"
+#include "backend/gl/program_cache.h"
+
+#define PROGRAM_CACHE_MAGIC "picomPB1"
+/// Binaries larger than this are neither loaded nor saved
+#define PROGRAM_CACHE_MAX_SIZE (64 * 1024 * 1024)
+
+struct program_cache_header {
+	char magic[8];
+	uint64_t key;
+	uint32_t format;
+	uint32_t length;
+};
+
+/// FNV-1a hash of `str`, including its terminating NUL, so concatenating different
+/// strings can't produce the same hash.
+static uint64_t fnv1a(uint64_t hash, const char *str) {
+	const char *p = str ? str : "";
+	do {
+		hash = (hash ^ (uint8_t)*p) * 0x100000001b3;
+	} while (*p++);
+	return hash;
+}
+
+static uint64_t
+program_cache_key(const char *vert_shader_str, const char *frag_shader_str) {
+	uint64_t key = 0xcbf29ce484222325;
+	key = fnv1a(key, vert_shader_str);
+	key = fnv1a(key, frag_shader_str);
+	key = fnv1a(key, (const char *)glGetString(GL_VENDOR));
+	key = fnv1a(key, (const char *)glGetString(GL_RENDERER));
+	key = fnv1a(key, (const char *)glGetString(GL_VERSION));
+	return key;
+}
+
+/// Path of the cache file for `key`, creating the cache directory when `create` is set.
+static char *program_cache_path(uint64_t key, bool create) {
+	const char *xdg_cache_home = getenv("XDG_CACHE_HOME");
+	char *dir = NULL;
+	if (xdg_cache_home && *xdg_cache_home) {
+		dir = mstrjoin(xdg_cache_home, "/picom");
+	} else {
+		const char *home = getenv("HOME");
+		if (!home) {
+			return NULL;
+		}
+		dir = mstrjoin(home, "/.cache/picom");
+	}
+
+	if (create) {
+		// The parent directory might not exist either
+		char *slash = strrchr(dir, '/');
+		*slash = '\0';
+		mkdir(dir, 0700);
+		*slash = '/';
+		if (mkdir(dir, 0700) != 0 && errno != EEXIST) {
+			log_debug("Cannot create program cache directory %s: %s", dir,
+			          strerror(errno));
+			free(dir);
+			return NULL;
+		}
+	}
+
+	char name[32];
+	snprintf(name, sizeof(name), "/%016" PRIx64 ".bin", key);
+	auto path = mstrjoin(dir, name);
+	free(dir);
+	return path;
+}
+
+bool gl_program_cache_supported(void) {
+	GLint nformats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &nformats);
+	// Contexts without program binary support report GL_INVALID_ENUM
+	gl_clear_err();
+	return nformats > 0;
+}
+
+GLuint gl_program_cache_load(const char *vert_shader_str, const char *frag_shader_str) {
+	if (!gl_program_cache_supported()) {
+		return 0;
+	}
+
+	auto key = program_cache_key(vert_shader_str, frag_shader_str);
+	auto path = program_cache_path(key, false);
+	if (!path) {
+		return 0;
+	}
+
+	GLuint prog = 0;
+	void *binary = NULL;
+	FILE *f = fopen(path, "rb");
+	if (!f) {
+		goto out;
+	}
+
+	struct program_cache_header header;
+	if (fread(&header, sizeof(header), 1, f) != 1 ||
+	    memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+	    header.key != key || header.length == 0 ||
+	    header.length > PROGRAM_CACHE_MAX_SIZE) {
+		log_debug("Ignoring invalid program binary %s", path);
+		goto out;
+	}
+	binary = cvalloc(header.length);
+	if (fread(binary, 1, header.length, f) != header.length) {
+		log_debug("Ignoring truncated program binary %s", path);
+		goto out;
+	}
+
+	prog = glCreateProgram();
+	if (!prog) {
+		goto out;
+	}
+	glProgramBinary(prog, header.format, binary, (GLsizei)header.length);
+	GLint status = GL_FALSE;
+	glGetProgramiv(prog, GL_LINK_STATUS, &status);
+	if (status == GL_FALSE) {
+		// Drivers are free to reject binaries they produced, e.g. after an
+		// update that didn't change the version string.
+		log_debug("Program binary %s rejected by the driver", path);
+		glDeleteProgram(prog);
+		gl_clear_err();
+		prog = 0;
+	}
+
+out:
+	if (f) {
+		fclose(f);
+	}
+	free(binary);
+	free(path);
+	return prog;
+}
+
+void gl_program_cache_store(GLuint prog, const char *vert_shader_str,
+                            const char *frag_shader_str) {
+	if (!gl_program_cache_supported()) {
+		return;
+	}
+
+	GLint length = 0;
+	glGetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0 || length > PROGRAM_CACHE_MAX_SIZE) {
+		gl_clear_err();
+		return;
+	}
+
+	auto binary = cvalloc((size_t)length);
+	GLenum format = 0;
+	GLsizei real_length = 0;
+	glGetProgramBinary(prog, length, &real_length, &format, binary);
+	auto key = program_cache_key(vert_shader_str, frag_shader_str);
+	char *path = NULL;
+	if (real_length <= 0 || !(path = program_cache_path(key, true))) {
+		gl_clear_err();
+		free(binary);
+		return;
+	}
+
+	struct program_cache_header header = {
+	    .key = key,
+	    .format = format,
+	    .length = (uint32_t)real_length,
+	};
+	memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic));
+
+	// Write to a temporary file first, so other instances never see a partially
+	// written binary.
+	char suffix[32];
+	snprintf(suffix, sizeof(suffix), ".%d.tmp", getpid());
+	auto tmp_path = mstrjoin(path, suffix);
+	FILE *f = fopen(tmp_path, "wb");
+	bool success = f && fwrite(&header, sizeof(header), 1, f) == 1 &&
+	               fwrite(binary, 1, header.length, f) == header.length;
+	if (f && fclose(f) != 0) {
+		success = false;
+	}
+	if (success && rename(tmp_path, path) == 0) {
+		log_debug("Saved program binary to %s", path);
+	} else {
+		log_debug("Failed to save program binary to %s", path);
+		unlink(tmp_path);
+	}
+
+	free(tmp_path);
+	free(path);
+	free(binary);
+}
@@ -0,0 +1,22 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (c) Yuxuan Shui <yshuiv7@gmail.com>
+
+#pragma once
+
+#include <GL/gl.h>
+#include <stdbool.h>
+
+/// Whether linked programs can be saved and restored as binaries in the current context
+bool gl_program_cache_supported(void);
+
+/// Load a program linked from the given shaders from the on-disk program binary cache,
+/// located in `$XDG_CACHE_HOME/picom`. Binaries are keyed by the shader sources and the
+/// GL vendor, renderer and version, so a driver update invalidates them.
+///
+/// @return the program, or 0 if there is no usable binary in the cache
+GLuint gl_program_cache_load(const char *vert_shader_str, const char *frag_shader_str);
+
+/// Save the binary of a linked program to the on-disk program binary cache. Failures
+/// are not fatal, the program just has to be compiled again the next time.
+void gl_program_cache_store(GLuint prog, const char *vert_shader_str,
+                            const char *frag_shader_str);
@@ -0,0 +1,164 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (c) Yuxuan Shui <yshuiv7@gmail.com>
+#include <GL/gl.h>
+#include <stdio.h>
+#include <string.h>
+#include <test.h>
+
+#include "log.h"
+#include "utils.h"
+
+#include "backend/gl/gl_common.h"
+#include "backend/gl/texture_pool.h"
+
+/// Estimated size of a texture in video memory. Drivers usually pad 3 component
+/// textures to 4 components.
+static size_t texture_size(GLenum internal_format, int width, int height) {
+	size_t bytes_per_pixel = internal_format == GL_R8 ? 1 : 4;
+	return bytes_per_pixel * (size_t)width * (size_t)height;
+}
+
+void gl_texture_pool_init(struct gl_texture_pool *pool) {
+	*pool = (struct gl_texture_pool){0};
+}
+
+void gl_texture_pool_deinit(struct gl_texture_pool *pool) {
+	gl_texture_pool_trim(pool, 0);
+	free(pool->textures);
+	*pool = (struct gl_texture_pool){0};
+}
+
+GLuint gl_texture_pool_get(struct gl_texture_pool *pool, GLenum internal_format,
+                           int width, int height) {
+	// Prefer the most recently released texture, it's the most likely one to be
+	// still resident.
+	for (int i = pool->ntextures - 1; i >= 0; i--) {
+		auto entry = &pool->textures[i];
+		if (entry->internal_format != internal_format || entry->width != width ||
+		    entry->height != height) {
+			continue;
+		}
+
+		GLuint texture = entry->texture;
+		pool->size -= texture_size(internal_format, width, height);
+		memmove(entry, entry + 1,
+		        sizeof(*entry) * (size_t)(pool->ntextures - i - 1));
+		pool->ntextures--;
+		pool->hits++;
+
+		// The previous user might have changed the parameters
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return texture;
+	}
+
+	pool->misses++;
+	GLuint texture = gl_new_texture(GL_TEXTURE_2D);
+	if (!texture) {
+		return 0;
+	}
+
+	// The format and type only matter when pixels are uploaded, but they still
+	// have to be compatible with the internal format.
+	GLenum format = GL_RED;
+	if (internal_format == GL_RGBA8 || internal_format == GL_RGB8) {
+		format = GL_BGRA;
+	}
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, (GLint)internal_format, width, height, 0, format,
+	             GL_UNSIGNED_BYTE, NULL);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return texture;
+}
+
+void gl_texture_pool_put(struct gl_texture_pool *pool, GLuint texture,
+                         GLenum internal_format, int width, int height, size_t budget) {
+	if (texture_size(internal_format, width, height) > budget) {
+		glDeleteTextures(1, &texture);
+		pool->evictions++;
+		return;
+	}
+
+	if (pool->ntextures == pool->capacity) {
+		pool->capacity = max2(pool->capacity * 2, 16);
+		pool->textures = crealloc(pool->textures, pool->capacity);
+	}
+	pool->textures[pool->ntextures++] = (struct gl_pooled_texture){
+	    .texture = texture,
+	    .internal_format = internal_format,
+	    .width = width,
+	    .height = height,
+	};
+	pool->size += texture_size(internal_format, width, height);
+	gl_texture_pool_trim(pool, budget);
+}
+
+void gl_texture_pool_trim(struct gl_texture_pool *pool, size_t budget) {
+	int nevicted = 0;
+	while (nevicted < pool->ntextures && pool->size > budget) {
+		auto entry = &pool->textures[nevicted++];
+		pool->size -= texture_size(entry->internal_format, entry->width,
+		                           entry->height);
+		glDeleteTextures(1, &entry->texture);
+	}
+	if (nevicted == 0) {
+		return;
+	}
+
+	log_trace("Evicted %d textures from the texture pool, %zu bytes left", nevicted,
+	          pool->size);
+	pool->evictions += (unsigned long)nevicted;
+	pool->ntextures -= nevicted;
+	memmove(pool->textures, pool->textures + nevicted,
+	        sizeof(*pool->textures) * (size_t)pool->ntextures);
+}
+
+void gl_texture_pool_print_stats(const struct gl_texture_pool *pool) {
+	unsigned long requests = pool->hits + pool->misses;
+	printf("* Texture pool:\n");
+	printf(" * Free textures: %d, %zu KiB\n", pool->ntextures, pool->size / 1024);
+	printf(" * Hits: %lu of %lu requests (%.1f%%)\n", pool->hits, requests,
+	       requests ? 100.0 * (double)pool->hits / (double)requests : 0.0);
+	printf(" * Evictions: %lu\n", pool->evictions);
+}
+
+TEST_CASE(gl_texture_pool) {
+	// Only reuses are tested, allocating new textures needs a GL context. The GL
+	// calls made for reused and evicted textures do nothing without one.
+	struct gl_texture_pool pool;
+	gl_texture_pool_init(&pool);
+	gl_texture_pool_put(&pool, 1, GL_RGBA8, 10, 10, 1000);
+	gl_texture_pool_put(&pool, 2, GL_R8, 10, 10, 1000);
+	gl_texture_pool_put(&pool, 3, GL_RGBA8, 10, 10, 1000);
+	TEST_EQUAL(pool.ntextures, 3);
+	TEST_EQUAL(pool.size, 900);
+
+	// The most recently released texture is reused first
+	TEST_EQUAL(gl_texture_pool_get(&pool, GL_RGBA8, 10, 10), 3);
+	TEST_EQUAL(pool.hits, 1);
+	TEST_EQUAL(pool.ntextures, 2);
+	TEST_EQUAL(pool.size, 500);
+
+	// The least recently released texture is evicted first
+	gl_texture_pool_put(&pool, 3, GL_RGBA8, 10, 10, 500);
+	TEST_EQUAL(pool.evictions, 1);
+	TEST_EQUAL(pool.ntextures, 2);
+	TEST_EQUAL(pool.size, 500);
+	TEST_EQUAL(pool.textures[0].texture, 2);
+	TEST_EQUAL(pool.textures[1].texture, 3);
+
+	// A texture bigger than the budget isn't kept
+	gl_texture_pool_put(&pool, 4, GL_RGBA8, 100, 100, 1000);
+	TEST_EQUAL(pool.evictions, 2);
+	TEST_EQUAL(pool.ntextures, 2);
+
+	gl_texture_pool_trim(&pool, 0);
+	TEST_EQUAL(pool.ntextures, 0);
+	TEST_EQUAL(pool.size, 0);
+	TEST_EQUAL(pool.evictions, 4);
+	gl_texture_pool_deinit(&pool);
+}
@@ -0,0 +1,51 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (c) Yuxuan Shui <yshuiv7@gmail.com>
+
+#pragma once
+
+#include <GL/gl.h>
+#include <stddef.h>
+
+struct gl_pooled_texture {
+	GLuint texture;
+	GLenum internal_format;
+	int width, height;
+};
+
+/// Textures that are no longer used, kept around so new textures of the same size and
+/// format don't have to be allocated again. Allocating textures is expensive for the
+/// driver, and images are created and released every frame during animations.
+struct gl_texture_pool {
+	/// Free textures, least recently released first
+	struct gl_pooled_texture *textures;
+	int ntextures, capacity;
+	/// Estimated video memory used by the free textures, in bytes
+	size_t size;
+
+	// Statistics, for diagnostics
+	unsigned long hits, misses, evictions;
+};
+
+void gl_texture_pool_init(struct gl_texture_pool *pool);
+/// Delete all the free textures of the pool
+void gl_texture_pool_deinit(struct gl_texture_pool *pool);
+
+/// Get a texture with storage of the given size and internal format, either from the
+/// pool or newly allocated. The content of the texture is undefined, and its
+/// parameters are the same as the ones set by `gl_new_texture`.
+///
+/// @return the texture, or 0 on failure
+GLuint gl_texture_pool_get(struct gl_texture_pool *pool, GLenum internal_format,
+                           int width, int height);
+
+/// Give a texture allocated by `gl_texture_pool_get` back to the pool, then delete the
+/// least recently released textures until the pool uses at most `budget` bytes.
+void gl_texture_pool_put(struct gl_texture_pool *pool, GLuint texture,
+                         GLenum internal_format, int width, int height, size_t budget);
+
+/// Delete the least recently released textures until the pool uses at most `budget`
+/// bytes.
+void gl_texture_pool_trim(struct gl_texture_pool *pool, size_t budget);
+
+/// Print the usage statistics of the pool to stdout
+void gl_texture_pool_print_stats(const struct gl_texture_pool *pool);
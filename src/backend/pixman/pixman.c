@@ -0,0 +1,1234 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (c) Yuxuan Shui <yshuiv7@gmail.com>
+#include <assert.h>
+#include <inttypes.h>
+#include <math.h>
+#include <pixman.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <xcb/shm.h>
+#include <xcb/xcb.h>
+#include <xcb/xcb_image.h>
+
+#include "backend/backend.h"
+#include "backend/backend_common.h"
+#include "backend/pixman/worker_pool.h"
+#include "common.h"
+#include "config.h"
+#include "kernel.h"
+#include "log.h"
+#include "picom.h"
+#include "region.h"
+#include "types.h"
+#include "utils.h"
+#include "win.h"
+#include "x.h"
+
+/// Operations on fewer pixels than this are done on the calling thread
+#define PIXMAN_PARALLEL_MIN_PIXELS (256 * 256)
+/// Smallest number of rows handed to a worker at once
+#define PIXMAN_MIN_BAND_HEIGHT 32
+/// Upper limit of the number of worker threads
+#define PIXMAN_MAX_THREADS 8
+/// Stale regions with more rectangles than this are fetched as a whole, through their
+/// extents, instead of one request per rectangle
+#define PIXMAN_FETCH_MAX_RECTS 16
+
+/// Pixels in client memory
+struct pixman_buffer {
+	pixman_format_code_t format;
+	int width, height;
+	/// Bytes per row
+	int stride;
+	uint32_t *bits;
+	/// The shared memory segment `bits` points into, if `bits` is shared with the X
+	/// server
+	struct x_shm_segment shm;
+};
+
+struct pixman_image_data {
+	struct pixman_buffer buf;
+	/// The pixmap the content of this image comes from, XCB_NONE if the image only
+	/// exists in client memory
+	xcb_pixmap_t pixmap;
+	bool owned;
+	/// Part of `buf` that has to be fetched from `pixmap` again before it is used
+	region_t stale;
+	// The effective size of the image
+	int ewidth, eheight;
+	bool has_alpha;
+	double opacity;
+};
+
+struct pixman_data {
+	backend_t base;
+	struct worker_pool *workers;
+	/// Whether images are exchanged with the X server through MIT-SHM
+	bool shm;
+	/// Target window
+	xcb_window_t target_win;
+	xcb_gcontext_t gc;
+	uint8_t depth;
+	/// The rendering buffer. Parts of it are copied to the target window when
+	/// presenting.
+	struct pixman_buffer back;
+	/// Intermediate buffers for blurring
+	struct pixman_buffer scratch[2];
+	/// Where parts of pixmaps are fetched into with MIT-SHM, before they are copied
+	/// into the buffers of their images
+	struct x_shm_segment fetch_shm;
+
+	/// Bytes fetched from pixmaps and sent to the target window, respectively
+	uint64_t fetched_bytes, presented_bytes;
+};
+
+struct pixman_blur_context {
+	enum blur_method method;
+	/// Blur kernels, in the same fixed point format pixman uses for convolution
+	/// filters
+	struct x_convolution_kernel **kernels;
+	int kernel_count;
+	int resize_width, resize_height;
+};
+
+struct pixman_round_context {
+	/// Background of the four corners of the window being painted, saved before
+	/// anything is painted on top of it. Each corner is `radius` x `radius` pixels.
+	uint32_t *corners;
+	size_t capacity;
+	int x, y, width, height, radius;
+};
+
+/// An input of a composite operation
+struct pixman_layer {
+	/// NULL if there is no such input
+	const struct pixman_buffer *buf;
+	/// Solid color used when `buf` is NULL, premultiplied
+	const pixman_color_t *color;
+	/// Where the origin of `buf` is placed, in destination coordinates
+	int x, y;
+	pixman_repeat_t repeat;
+	/// Parameters of a convolution filter applied to `buf`, NULL for no filter
+	const pixman_fixed_t *filter;
+	int filter_nparams;
+};
+
+/// A composite operation, split into bands of rows that are processed in parallel.
+struct pixman_composite {
+	pixman_op_t op;
+	struct pixman_layer src, mask;
+	/// Extra alpha multiplied into the mask, 1 for none
+	double alpha;
+	const struct pixman_buffer *dst;
+
+	// Filled in by pixman_composite_run
+	const rect_t *rects;
+	int nrects;
+	/// Task `i` handles rows starting from `y + i * band_height`
+	int y, band_height;
+};
+
+static bool pixman_buffer_init(struct pixman_data *pd, struct pixman_buffer *buf,
+                               pixman_format_code_t format, int width, int height,
+                               bool shared) {
+	*buf = (struct pixman_buffer){
+	    .format = format,
+	    .width = width,
+	    .height = height,
+	    // pixman wants rows aligned to 4 bytes, so does the X server
+	    .stride = (width * PIXMAN_FORMAT_BPP(format) / 8 + 3) & ~3,
+	};
+	auto size = (size_t)buf->stride * (size_t)max2(height, 1);
+	if (shared && pd->shm) {
+		if (x_shm_segment_create(pd->base.c, &buf->shm, size, false)) {
+			buf->bits = buf->shm.addr;
+			return true;
+		}
+		log_warn("Failed to use MIT-SHM, falling back to GetImage and PutImage.");
+		pd->shm = false;
+	}
+	buf->bits = calloc(1, size);
+	if (!buf->bits) {
+		log_error("Failed to allocate %zu bytes for a %dx%d image", size, width,
+		          height);
+		return false;
+	}
+	return true;
+}
+
+static void pixman_buffer_fini(struct pixman_data *pd, struct pixman_buffer *buf) {
+	if (buf->shm.addr) {
+		x_shm_segment_destroy(pd->base.c, &buf->shm);
+	} else {
+		free(buf->bits);
+	}
+	*buf = (struct pixman_buffer){0};
+}
+
+/// Make sure `buf` can hold a `width` x `height` image, used for temporary buffers.
+static bool pixman_buffer_reserve(struct pixman_data *pd, struct pixman_buffer *buf,
+                                  pixman_format_code_t format, int width, int height) {
+	if (buf->bits && buf->format == format && buf->width >= width &&
+	    buf->height >= height) {
+		return true;
+	}
+	width = max2(width, buf->width);
+	height = max2(height, buf->height);
+	pixman_buffer_fini(pd, buf);
+	return pixman_buffer_init(pd, buf, format, width, height, false);
+}
+
+static pixman_image_t *pixman_layer_image(const struct pixman_layer *layer) {
+	if (layer->buf) {
+		auto ret = pixman_image_create_bits(layer->buf->format, layer->buf->width,
+		                                    layer->buf->height, layer->buf->bits,
+		                                    layer->buf->stride);
+		pixman_image_set_repeat(ret, layer->repeat);
+		if (layer->filter) {
+			pixman_image_set_filter(ret, PIXMAN_FILTER_CONVOLUTION,
+			                        layer->filter, layer->filter_nparams);
+		}
+		return ret;
+	}
+	if (layer->color) {
+		return pixman_image_create_solid_fill(layer->color);
+	}
+	return NULL;
+}
+
+static void pixman_composite_task(void *data, int task) {
+	const struct pixman_composite *comp = data;
+	const int band_y1 = comp->y + task * comp->band_height;
+	const int band_y2 = band_y1 + comp->band_height;
+
+	// pixman images cache some state internally, so they can't be shared between
+	// threads. Each task creates its own, they are cheap to create anyway.
+	auto dst = pixman_image_create_bits(comp->dst->format, comp->dst->width,
+	                                    comp->dst->height, comp->dst->bits,
+	                                    comp->dst->stride);
+	auto src = pixman_layer_image(&comp->src);
+	auto mask = pixman_layer_image(&comp->mask);
+	pixman_image_t *alpha = NULL;
+	if (comp->alpha < 1) {
+		pixman_color_t alpha_color = {.alpha = (uint16_t)(comp->alpha * 0xffff)};
+		alpha = pixman_image_create_solid_fill(&alpha_color);
+	}
+
+	for (int i = 0; i < comp->nrects; i++) {
+		const rect_t *r = &comp->rects[i];
+		int y1 = max2(r->y1, band_y1), y2 = min2(r->y2, band_y2);
+		if (y1 >= y2) {
+			continue;
+		}
+		int width = r->x2 - r->x1, height = y2 - y1;
+		pixman_image_t *rect_mask = mask ? mask : alpha;
+		int mask_x = r->x1 - comp->mask.x, mask_y = y1 - comp->mask.y;
+		if (mask && alpha) {
+			// pixman takes a single mask, so the mask and the extra alpha
+			// have to be combined first
+			rect_mask =
+			    pixman_image_create_bits(PIXMAN_a8, width, height, NULL, 0);
+			pixman_image_composite32(PIXMAN_OP_SRC, mask, alpha, rect_mask,
+			                         mask_x, mask_y, 0, 0, 0, 0, width,
+			                         height);
+			mask_x = mask_y = 0;
+		}
+		pixman_image_composite32(comp->op, src, rect_mask, dst,
+		                         r->x1 - comp->src.x, y1 - comp->src.y, mask_x,
+		                         mask_y, r->x1, y1, width, height);
+		if (rect_mask != mask && rect_mask != alpha) {
+			pixman_image_unref(rect_mask);
+		}
+	}
+
+	pixman_image_unref(dst);
+	pixman_image_unref(src);
+	if (mask) {
+		pixman_image_unref(mask);
+	}
+	if (alpha) {
+		pixman_image_unref(alpha);
+	}
+}
+
+/// Run `comp` on the part of its destination in `reg`. Large regions are split into
+/// bands of rows, processed by the worker threads.
+static void
+pixman_composite_run(struct pixman_data *pd, struct pixman_composite *comp,
+                     const region_t *reg) {
+	comp->rects = pixman_region32_rectangles((region_t *)reg, &comp->nrects);
+	if (comp->nrects == 0) {
+		return;
+	}
+
+	const rect_t *extents = pixman_region32_extents((region_t *)reg);
+	const int height = extents->y2 - extents->y1;
+	int64_t area = 0;
+	for (int i = 0; i < comp->nrects; i++) {
+		area += (int64_t)(comp->rects[i].x2 - comp->rects[i].x1) *
+		        (comp->rects[i].y2 - comp->rects[i].y1);
+	}
+
+	int ntasks = 1;
+	if (area >= PIXMAN_PARALLEL_MIN_PIXELS) {
+		// More tasks than threads, so threads that got the cheap bands can pick
+		// up more work
+		ntasks = min2(worker_pool_concurrency(pd->workers) * 2,
+		              height / PIXMAN_MIN_BAND_HEIGHT);
+		ntasks = max2(ntasks, 1);
+	}
+	comp->y = extents->y1;
+	comp->band_height = (height + ntasks - 1) / ntasks;
+	worker_pool_run(pd->workers, ntasks, pixman_composite_task, comp);
+}
+
+/// Fetch the whole content of `img` from its pixmap, directly into its buffer.
+static bool pixman_image_fetch_all(struct pixman_data *pd, struct pixman_image_data *img,
+                                   xcb_generic_error_t **e) {
+	auto c = pd->base.c;
+	auto buf = &img->buf;
+	const auto width = to_u16_checked(buf->width);
+	const auto height = to_u16_checked(buf->height);
+	const auto size = (size_t)buf->stride * (size_t)buf->height;
+	if (buf->shm.addr) {
+		// The server writes directly into our buffer
+		auto r = xcb_shm_get_image_reply(
+		    c,
+		    xcb_shm_get_image(c, img->pixmap, 0, 0, width, height, ~0U,
+		                      XCB_IMAGE_FORMAT_Z_PIXMAP, buf->shm.seg, 0),
+		    e);
+		if (!r) {
+			return false;
+		}
+		free(r);
+	} else {
+		auto r = xcb_get_image_reply(
+		    c,
+		    xcb_get_image(c, XCB_IMAGE_FORMAT_Z_PIXMAP, img->pixmap, 0, 0,
+		                  width, height, ~0U),
+		    e);
+		if (!r) {
+			return false;
+		}
+		auto length = (size_t)xcb_get_image_data_length(r);
+		memcpy(buf->bits, xcb_get_image_data(r), min2(length, size));
+		free(r);
+	}
+	pd->fetched_bytes += size;
+	return true;
+}
+
+/// Copy `rect` of `buf` from `data`, in which the rows of `rect` are packed.
+static void pixman_buffer_copy_in(struct pixman_buffer *buf, const rect_t *rect,
+                                  const uint8_t *data, size_t length) {
+	const auto bpp = (size_t)PIXMAN_FORMAT_BPP(buf->format) / 8;
+	const auto row = (size_t)(rect->x2 - rect->x1) * bpp;
+	auto dst = (uint8_t *)buf->bits + (size_t)rect->y1 * (size_t)buf->stride +
+	           (size_t)rect->x1 * bpp;
+	for (int y = rect->y1; y < rect->y2 && length >= row; y++) {
+		memcpy(dst, data, row);
+		dst += buf->stride;
+		data += row;
+		length -= row;
+	}
+}
+
+/// Fetch `rects` of `img` from its pixmap. All the requests are sent before the first
+/// reply is waited for, so this costs a single round trip.
+static bool
+pixman_image_fetch_rects(struct pixman_data *pd, struct pixman_image_data *img,
+                         const rect_t *rects, int nrects, xcb_generic_error_t **e) {
+	auto c = pd->base.c;
+	auto buf = &img->buf;
+	const auto bpp = (size_t)PIXMAN_FORMAT_BPP(buf->format) / 8;
+	size_t total = 0;
+	for (int i = 0; i < nrects; i++) {
+		// Rows fetched with ZPixmap are padded to 4 bytes, which they already
+		// are with 32 bits per pixel
+		total += (size_t)(rects[i].x2 - rects[i].x1) *
+		         (size_t)(rects[i].y2 - rects[i].y1) * bpp;
+	}
+
+	bool use_shm = pd->shm;
+	if (use_shm && pd->fetch_shm.size < total) {
+		if (pd->fetch_shm.addr) {
+			x_shm_segment_destroy(c, &pd->fetch_shm);
+		}
+		use_shm = x_shm_segment_create(c, &pd->fetch_shm, total, false);
+	}
+
+	bool ret = true;
+	if (use_shm) {
+		auto cookies = ccalloc(nrects, xcb_shm_get_image_cookie_t);
+		uint32_t offset = 0;
+		for (int i = 0; i < nrects; i++) {
+			const rect_t *r = &rects[i];
+			cookies[i] = xcb_shm_get_image(
+			    c, img->pixmap, to_i16_checked(r->x1), to_i16_checked(r->y1),
+			    to_u16_checked(r->x2 - r->x1), to_u16_checked(r->y2 - r->y1),
+			    ~0U, XCB_IMAGE_FORMAT_Z_PIXMAP, pd->fetch_shm.seg, offset);
+			offset += (uint32_t)((size_t)(r->x2 - r->x1) *
+			                     (size_t)(r->y2 - r->y1) * bpp);
+		}
+		for (int i = 0; i < nrects; i++) {
+			auto r = xcb_shm_get_image_reply(c, cookies[i], ret ? e : NULL);
+			ret = ret && r;
+			free(r);
+		}
+		free(cookies);
+		if (ret) {
+			const uint8_t *data = pd->fetch_shm.addr;
+			for (int i = 0; i < nrects; i++) {
+				const rect_t *r = &rects[i];
+				const auto size = (size_t)(r->x2 - r->x1) *
+				                  (size_t)(r->y2 - r->y1) * bpp;
+				pixman_buffer_copy_in(buf, r, data, size);
+				data += size;
+			}
+		}
+	} else {
+		auto cookies = ccalloc(nrects, xcb_get_image_cookie_t);
+		for (int i = 0; i < nrects; i++) {
+			const rect_t *r = &rects[i];
+			cookies[i] = xcb_get_image(
+			    c, XCB_IMAGE_FORMAT_Z_PIXMAP, img->pixmap,
+			    to_i16_checked(r->x1), to_i16_checked(r->y1),
+			    to_u16_checked(r->x2 - r->x1),
+			    to_u16_checked(r->y2 - r->y1), ~0U);
+		}
+		for (int i = 0; i < nrects; i++) {
+			auto r = xcb_get_image_reply(c, cookies[i], ret ? e : NULL);
+			if (r) {
+				pixman_buffer_copy_in(
+				    buf, &rects[i], xcb_get_image_data(r),
+				    (size_t)xcb_get_image_data_length(r));
+			}
+			ret = ret && r;
+			free(r);
+		}
+		free(cookies);
+	}
+	if (ret) {
+		pd->fetched_bytes += total;
+	}
+	return ret;
+}
+
+/// Fetch the parts of `img` that have changed since the last time from its pixmap.
+static bool pixman_image_fetch(struct pixman_data *pd, struct pixman_image_data *img) {
+	pixman_region32_intersect_rect(&img->stale, &img->stale, 0, 0,
+	                               (uint)img->buf.width, (uint)img->buf.height);
+	if (!pixman_region32_not_empty(&img->stale)) {
+		return true;
+	}
+
+	int nrects;
+	const rect_t *rects = pixman_region32_rectangles(&img->stale, &nrects);
+	const rect_t *extents = pixman_region32_extents(&img->stale);
+	if (nrects > PIXMAN_FETCH_MAX_RECTS) {
+		// Too many requests, the extents likely aren't much larger anyway
+		rects = extents;
+		nrects = 1;
+	}
+
+	xcb_generic_error_t *e = NULL;
+	bool ret;
+	if (nrects == 1 && extents->x1 == 0 && extents->y1 == 0 &&
+	    extents->x2 == img->buf.width && extents->y2 == img->buf.height) {
+		ret = pixman_image_fetch_all(pd, img, &e);
+	} else {
+		ret = pixman_image_fetch_rects(pd, img, rects, nrects, &e);
+	}
+	pixman_region32_clear(&img->stale);
+	if (!ret) {
+		log_error_x_error(e, "Failed to fetch the content of pixmap %#010x",
+		                  img->pixmap);
+		free(e);
+	}
+	return ret;
+}
+
+static void compose(backend_t *base, struct managed_win *w attr_unused, void *image_data,
+                    void *mask_data, int dst_x, int dst_y, const region_t *reg_paint,
+                    const region_t *reg_visible) {
+	struct pixman_data *pd = (void *)base;
+	struct pixman_image_data *img = image_data;
+	struct pixman_image_data *mask = mask_data;
+	if (!pixman_image_fetch(pd, img)) {
+		return;
+	}
+
+	region_t reg;
+	pixman_region32_init(&reg);
+	pixman_region32_intersect(&reg, (region_t *)reg_paint, (region_t *)reg_visible);
+	pixman_region32_intersect_rect(&reg, &reg, dst_x, dst_y, (uint)img->ewidth,
+	                               (uint)img->eheight);
+
+	// The image is tiled to fill its effective size
+	const bool tiled = img->ewidth > img->buf.width || img->eheight > img->buf.height;
+	struct pixman_composite comp = {
+	    // Parts of the image outside of the mask must leave the target alone,
+	    // which the SRC operator doesn't do.
+	    .op = img->has_alpha || img->opacity < 1 || mask ? PIXMAN_OP_OVER
+	                                                      : PIXMAN_OP_SRC,
+	    .src =
+	        {
+	            .buf = &img->buf,
+	            .x = dst_x,
+	            .y = dst_y,
+	            .repeat = tiled ? PIXMAN_REPEAT_NORMAL : PIXMAN_REPEAT_NONE,
+	        },
+	    .mask = {.buf = mask ? &mask->buf : NULL, .x = dst_x, .y = dst_y},
+	    .alpha = img->opacity,
+	    .dst = &pd->back,
+	};
+	pixman_composite_run(pd, &comp, &reg);
+	pixman_region32_fini(&reg);
+}
+
+static void fill(backend_t *base, struct color c, const region_t *clip) {
+	struct pixman_data *pd = (void *)base;
+	// Same as the xrender backend, the color is used as is
+	pixman_color_t color = {
+	    .red = (uint16_t)(c.red * 0xffff),
+	    .green = (uint16_t)(c.green * 0xffff),
+	    .blue = (uint16_t)(c.blue * 0xffff),
+	    .alpha = (uint16_t)(c.alpha * 0xffff),
+	};
+	struct pixman_composite comp = {
+	    .op = PIXMAN_OP_OVER,
+	    .src = {.color = &color},
+	    .alpha = 1,
+	    .dst = &pd->back,
+	};
+	pixman_composite_run(pd, &comp, clip);
+}
+
+static bool blur(backend_t *base, double opacity, void *ctx_, const region_t *reg_blur,
+                 const region_t *reg_visible) {
+	struct pixman_blur_context *bctx = ctx_;
+	if (bctx->method == BLUR_METHOD_NONE) {
+		return true;
+	}
+
+	struct pixman_data *pd = (void *)base;
+	region_t reg_op;
+	pixman_region32_init(&reg_op);
+	pixman_region32_intersect(&reg_op, (region_t *)reg_blur, (region_t *)reg_visible);
+	if (!pixman_region32_not_empty(&reg_op)) {
+		pixman_region32_fini(&reg_op);
+		return true;
+	}
+
+	region_t reg_op_resized =
+	    resize_region(&reg_op, bctx->resize_width, bctx->resize_height);
+	const rect_t extent_resized = *pixman_region32_extents(&reg_op_resized);
+	const int width_resized = extent_resized.x2 - extent_resized.x1;
+	const int height_resized = extent_resized.y2 - extent_resized.y1;
+
+	// The intermediate buffers are at least as big as the blur region, (0, 0) in
+	// them is the top left corner of the resized blur region. They are kept from
+	// earlier, bigger blurs, so only a view of the size of the blur region is used,
+	// otherwise PAD repeat would read stale pixels past its edges.
+	struct pixman_buffer scratch[2];
+	for (int i = 0; i < 2; i++) {
+		if (!pixman_buffer_reserve(pd, &pd->scratch[i], pd->back.format,
+		                           width_resized, height_resized)) {
+			log_error("Failed to allocate buffers for blurring.");
+			pixman_region32_fini(&reg_op);
+			pixman_region32_fini(&reg_op_resized);
+			return false;
+		}
+		scratch[i] = pd->scratch[i];
+		scratch[i].width = width_resized;
+		scratch[i].height = height_resized;
+	}
+
+	region_t clip;
+	pixman_region32_init(&clip);
+	pixman_region32_copy(&clip, &reg_op_resized);
+	pixman_region32_translate(&clip, -extent_resized.x1, -extent_resized.y1);
+
+	// For more than 1 pass, we do:
+	//   back -(pass 1)-> scratch0 -(pass 2)-> scratch1 ...
+	//   -(pass n-1)-> scratch0 or scratch1 -(pass n)-> back
+	// For 1 pass, we do
+	//   back -(pass 1)-> scratch0 -(copy)-> back
+	// Each pass has to finish before the next one starts, but the rows of a single
+	// pass are blurred in parallel.
+	int current = 0;
+	for (int i = 0; i < bctx->kernel_count; i++) {
+		auto kernel = bctx->kernels[i];
+		struct pixman_composite comp = {
+		    .op = PIXMAN_OP_SRC,
+		    .src =
+		        {
+		            .buf = i == 0 ? &pd->back : &scratch[current],
+		            .x = i == 0 ? -extent_resized.x1 : 0,
+		            .y = i == 0 ? -extent_resized.y1 : 0,
+		            .repeat = PIXMAN_REPEAT_PAD,
+		            .filter = (const pixman_fixed_t *)kernel->kernel,
+		            .filter_nparams = kernel->size,
+		        },
+		    .alpha = 1,
+		    .dst = &scratch[i == 0 ? 0 : !current],
+		};
+		if (i == 0) {
+			pixman_composite_run(pd, &comp, &clip);
+			continue;
+		}
+		if (i == bctx->kernel_count - 1) {
+			// This is the last pass, write the result back
+			comp.op = PIXMAN_OP_OVER;
+			comp.src.x = extent_resized.x1;
+			comp.src.y = extent_resized.y1;
+			comp.alpha = opacity;
+			comp.dst = &pd->back;
+			pixman_composite_run(pd, &comp, &reg_op);
+			break;
+		}
+		pixman_composite_run(pd, &comp, &clip);
+		current = !current;
+	}
+
+	if (bctx->kernel_count == 1) {
+		// There is only 1 pass
+		struct pixman_composite comp = {
+		    .op = PIXMAN_OP_OVER,
+		    .src = {.buf = &scratch[0],
+		            .x = extent_resized.x1,
+		            .y = extent_resized.y1},
+		    .alpha = opacity,
+		    .dst = &pd->back,
+		};
+		pixman_composite_run(pd, &comp, &reg_op);
+	}
+
+	pixman_region32_fini(&clip);
+	pixman_region32_fini(&reg_op);
+	pixman_region32_fini(&reg_op_resized);
+	return true;
+}
+
+static inline uint32_t pixel_at(const struct pixman_buffer *buf, int x, int y);
+
+/// Start of the corner `i` of a `width` x `height` rectangle at (`x`, `y`). Corners are
+/// numbered clockwise from the top left, the same order as the bits of
+/// `managed_win::corner_type`.
+static inline void corner_origin(int i, int x, int y, int width, int height, int radius,
+                                 int *cx, int *cy) {
+	*cx = (i == 1 || i == 2) ? x + width - radius : x;
+	*cy = (i == 2 || i == 3) ? y + height - radius : y;
+}
+
+static bool store_back_texture(backend_t *base, struct managed_win *w, void *ctx_,
+                               const region_t *reg_tgt attr_unused, int x, int y,
+                               int width, int height) {
+	struct pixman_data *pd = (void *)base;
+	struct pixman_round_context *ctx = ctx_;
+	ctx->x = x;
+	ctx->y = y;
+	ctx->width = width;
+	ctx->height = height;
+	ctx->radius = min2(w->corner_radius, min2(width, height) / 2);
+	if (ctx->radius <= 0) {
+		return true;
+	}
+
+	auto size = 4 * (size_t)ctx->radius * (size_t)ctx->radius;
+	if (ctx->capacity < size) {
+		ctx->corners = crealloc(ctx->corners, size);
+		ctx->capacity = size;
+	}
+
+	// Only the corners are needed, the rest of the window is painted over anyway
+	const int r = ctx->radius;
+	for (int i = 0; i < 4; i++) {
+		int cx, cy;
+		corner_origin(i, x, y, width, height, r, &cx, &cy);
+		uint32_t *corner = ctx->corners + (size_t)i * (size_t)(r * r);
+		for (int row = 0; row < r; row++) {
+			for (int col = 0; col < r; col++) {
+				int px = cx + col, py = cy + row;
+				bool inside = px >= 0 && py >= 0 && px < pd->back.width &&
+				              py < pd->back.height;
+				corner[row * r + col] =
+				    inside ? pixel_at(&pd->back, px, py) : 0;
+			}
+		}
+	}
+	return true;
+}
+
+static inline uint32_t pixel_at(const struct pixman_buffer *buf, int x, int y) {
+	return buf->bits[y * buf->stride / 4 + x];
+}
+
+/// Mix two premultiplied pixels, `coverage` is the weight of `a`, out of 255.
+static inline uint32_t mix_pixel(uint32_t a, uint32_t b, uint32_t coverage) {
+	uint32_t ret = 0;
+	for (int shift = 0; shift < 32; shift += 8) {
+		uint32_t ca = (a >> shift) & 0xff, cb = (b >> shift) & 0xff;
+		ret |= ((ca * coverage + cb * (255 - coverage) + 127) / 255) << shift;
+	}
+	return ret;
+}
+
+static bool pixman_round(backend_t *base, struct managed_win *w, void *ctx_,
+                         void *image_data attr_unused, const region_t *reg_round,
+                         const region_t *reg_visible) {
+	struct pixman_data *pd = (void *)base;
+	struct pixman_round_context *ctx = ctx_;
+	const int r = ctx->radius;
+	if (r <= 0) {
+		return true;
+	}
+
+	region_t reg;
+	pixman_region32_init(&reg);
+	pixman_region32_intersect(&reg, (region_t *)reg_round, (region_t *)reg_visible);
+	pixman_region32_intersect_rect(&reg, &reg, 0, 0, (uint)pd->back.width,
+	                               (uint)pd->back.height);
+
+	// Put the saved background back where the window is cut off by its rounded
+	// corners, mixed with the window on the edge of the arc for anti-aliasing.
+	for (int i = 0; i < 4; i++) {
+		if (!(w->corner_type & (1 << i))) {
+			continue;
+		}
+		int cx, cy;
+		corner_origin(i, ctx->x, ctx->y, ctx->width, ctx->height, r, &cx, &cy);
+		// Center of the arc
+		const double center_x = (i == 1 || i == 2) ? cx : cx + r;
+		const double center_y = (i == 2 || i == 3) ? cy : cy + r;
+		const uint32_t *corner = ctx->corners + (size_t)i * (size_t)(r * r);
+
+		region_t reg_corner;
+		pixman_region32_init(&reg_corner);
+		pixman_region32_intersect_rect(&reg_corner, &reg, cx, cy, (uint)r,
+		                               (uint)r);
+		int nrects;
+		const rect_t *rects = pixman_region32_rectangles(&reg_corner, &nrects);
+		for (int j = 0; j < nrects; j++) {
+			for (int py = rects[j].y1; py < rects[j].y2; py++) {
+				uint32_t *row = pd->back.bits + py * pd->back.stride / 4;
+				const double dy = py + 0.5 - center_y;
+				for (int px = rects[j].x1; px < rects[j].x2; px++) {
+					const double dx = px + 0.5 - center_x;
+					double coverage =
+					    r + 0.5 - sqrt(dx * dx + dy * dy);
+					if (coverage >= 1) {
+						continue;
+					}
+					coverage = max2(coverage, 0);
+					auto bg = corner[(py - cy) * r + (px - cx)];
+					row[px] = mix_pixel(row[px], bg,
+					                    (uint32_t)(coverage * 255));
+				}
+			}
+		}
+		pixman_region32_fini(&reg_corner);
+	}
+	pixman_region32_fini(&reg);
+	return true;
+}
+
+static void *
+bind_pixmap(backend_t *base, xcb_pixmap_t pixmap, struct xvisual_info fmt, bool owned) {
+	struct pixman_data *pd = (void *)base;
+	pixman_format_code_t format;
+	if (fmt.visual_depth == 32) {
+		format = PIXMAN_a8r8g8b8;
+	} else if (fmt.visual_depth == 24) {
+		format = PIXMAN_x8r8g8b8;
+	} else {
+		log_error("Pixmap %#010x has unsupported depth %d", pixmap,
+		          fmt.visual_depth);
+		return NULL;
+	}
+
+	xcb_generic_error_t *e;
+	auto r = xcb_get_geometry_reply(base->c, xcb_get_geometry(base->c, pixmap), &e);
+	if (!r) {
+		log_error("Invalid pixmap: %#010x", pixmap);
+		x_print_error(e->full_sequence, e->major_code, e->minor_code,
+		              e->error_code);
+		return NULL;
+	}
+
+	auto img = ccalloc(1, struct pixman_image_data);
+	img->ewidth = r->width;
+	img->eheight = r->height;
+	img->pixmap = pixmap;
+	img->owned = owned;
+	img->opacity = 1;
+	img->has_alpha = fmt.alpha_size != 0;
+	// The content is fetched lazily, when the image is first used
+	pixman_region32_init_rect(&img->stale, 0, 0, r->width, r->height);
+	if (!pixman_buffer_init(pd, &img->buf, format, r->width, r->height, true)) {
+		pixman_region32_fini(&img->stale);
+		free(img);
+		free(r);
+		return NULL;
+	}
+	free(r);
+	return img;
+}
+
+static void *render_shadow(backend_t *base, int width, int height, const conv *kernel,
+                           double r, double g, double b, double a) {
+	struct pixman_data *pd = (void *)base;
+	auto shadow_image = make_shadow(base->c, kernel, a, width, height);
+	if (!shadow_image) {
+		log_error("Failed to make shadow");
+		return NULL;
+	}
+	if (shadow_image->stride % 4 != 0) {
+		// pixman can't use the rows as they are, let the X server deal with it
+		xcb_image_destroy(shadow_image);
+		return default_backend_render_shadow(base, width, height, kernel, r, g,
+		                                     b, a);
+	}
+
+	auto img = ccalloc(1, struct pixman_image_data);
+	img->ewidth = shadow_image->width;
+	img->eheight = shadow_image->height;
+	img->opacity = 1;
+	img->has_alpha = true;
+	pixman_region32_init(&img->stale);
+	if (!pixman_buffer_init(pd, &img->buf, PIXMAN_a8r8g8b8, shadow_image->width,
+	                        shadow_image->height, false)) {
+		xcb_image_destroy(shadow_image);
+		pixman_region32_fini(&img->stale);
+		free(img);
+		return NULL;
+	}
+
+	// Colorize the shadow, which is an alpha only image
+	const struct pixman_buffer shadow_buf = {
+	    .format = PIXMAN_a8,
+	    .width = shadow_image->width,
+	    .height = shadow_image->height,
+	    .stride = (int)shadow_image->stride,
+	    .bits = (uint32_t *)shadow_image->data,
+	};
+	pixman_color_t color = {
+	    .red = (uint16_t)(r * 0xffff),
+	    .green = (uint16_t)(g * 0xffff),
+	    .blue = (uint16_t)(b * 0xffff),
+	    .alpha = 0xffff,
+	};
+	struct pixman_composite comp = {
+	    .op = PIXMAN_OP_SRC,
+	    .src = {.color = &color},
+	    .mask = {.buf = &shadow_buf},
+	    .alpha = 1,
+	    .dst = &img->buf,
+	};
+	region_t reg;
+	pixman_region32_init_rect(&reg, 0, 0, shadow_image->width, shadow_image->height);
+	pixman_composite_run(pd, &comp, &reg);
+	pixman_region32_fini(&reg);
+	xcb_image_destroy(shadow_image);
+	return img;
+}
+
+static void *make_mask(backend_t *base, int width, int height, const region_t *reg) {
+	struct pixman_data *pd = (void *)base;
+	auto img = ccalloc(1, struct pixman_image_data);
+	img->ewidth = width;
+	img->eheight = height;
+	img->opacity = 1;
+	img->has_alpha = true;
+	pixman_region32_init(&img->stale);
+	if (!pixman_buffer_init(pd, &img->buf, PIXMAN_a8, width, height, false)) {
+		pixman_region32_fini(&img->stale);
+		free(img);
+		return NULL;
+	}
+
+	pixman_color_t opaque = {.alpha = 0xffff};
+	struct pixman_composite comp = {
+	    .op = PIXMAN_OP_SRC,
+	    .src = {.color = &opaque},
+	    .alpha = 1,
+	    .dst = &img->buf,
+	};
+	pixman_composite_run(pd, &comp, reg);
+	return img;
+}
+
+static void release_image(backend_t *base, void *image) {
+	struct pixman_data *pd = (void *)base;
+	struct pixman_image_data *img = image;
+	pixman_buffer_fini(pd, &img->buf);
+	pixman_region32_fini(&img->stale);
+	if (img->owned) {
+		xcb_free_pixmap(base->c, img->pixmap);
+	}
+	free(img);
+}
+
+static void deinit(backend_t *base) {
+	struct pixman_data *pd = (void *)base;
+	log_debug("Fetched %" PRIu64 " bytes from pixmaps, presented %" PRIu64 " bytes",
+	          pd->fetched_bytes, pd->presented_bytes);
+	if (pd->workers) {
+		worker_pool_free(pd->workers);
+	}
+	for (int i = 0; i < 2; i++) {
+		pixman_buffer_fini(pd, &pd->scratch[i]);
+	}
+	pixman_buffer_fini(pd, &pd->back);
+	if (pd->fetch_shm.addr) {
+		x_shm_segment_destroy(base->c, &pd->fetch_shm);
+	}
+	if (pd->gc != XCB_NONE) {
+		xcb_free_gc(base->c, pd->gc);
+	}
+	free(pd);
+}
+
+static void prepare(backend_t *base, const region_t *reg_damage attr_unused) {
+	struct pixman_data *pd = (void *)base;
+	// The X server might still be reading the last frame from the rendering buffer
+	if (pd->back.shm.addr) {
+		x_shm_segment_wait(base->c, &pd->back.shm);
+	}
+}
+
+/// Unlike the other backends, we keep a copy of the content of the pixmaps, the
+/// damaged parts of which are fetched again when the image is next used.
+static void image_damaged(backend_t *base attr_unused, void *image,
+                          const region_t *reg_damage) {
+	struct pixman_image_data *img = image;
+	pixman_region32_union(&img->stale, &img->stale, (region_t *)reg_damage);
+}
+
+static void present(backend_t *base, const region_t *region) {
+	struct pixman_data *pd = (void *)base;
+	int nrects;
+	const rect_t *rects = pixman_region32_rectangles((region_t *)region, &nrects);
+	for (int i = 0; i < nrects; i++) {
+		const auto x = to_i16_checked(rects[i].x1);
+		const auto y = to_i16_checked(rects[i].y1);
+		const auto width = to_u16_checked(rects[i].x2 - rects[i].x1);
+		const auto height = to_u16_checked(rects[i].y2 - rects[i].y1);
+		pd->presented_bytes += (uint64_t)width * height * 4;
+		if (pd->back.shm.addr) {
+			xcb_shm_put_image(base->c, pd->target_win, pd->gc,
+			                  to_u16_checked(pd->back.width),
+			                  to_u16_checked(pd->back.height), (uint16_t)x,
+			                  (uint16_t)y, width, height, x, y, pd->depth,
+			                  XCB_IMAGE_FORMAT_Z_PIXMAP, 0,
+			                  pd->back.shm.seg, 0);
+			continue;
+		}
+
+		auto image = xcb_image_create_native(base->c, width, height,
+		                                     XCB_IMAGE_FORMAT_Z_PIXMAP, pd->depth,
+		                                     NULL, 0, NULL);
+		if (!image) {
+			log_error("Failed to create image for presenting");
+			return;
+		}
+		auto src = (uint8_t *)pd->back.bits + (size_t)x * 4;
+		for (int row = 0; row < height; row++) {
+			memcpy(image->data + (size_t)row * image->stride,
+			       src + (size_t)(y + row) * (size_t)pd->back.stride,
+			       (size_t)width * 4);
+		}
+		x_put_image(base->c, NULL, pd->target_win, pd->gc, image, x, y);
+		xcb_image_destroy(image);
+	}
+
+	if (pd->back.shm.addr && nrects > 0) {
+		// We can't render into the buffer again until the server is done with it
+		pd->back.shm.fence = xcb_get_input_focus(base->c);
+		pd->back.shm.busy = true;
+	}
+	xcb_flush(base->c);
+}
+
+static int buffer_age(backend_t *backend_data attr_unused) {
+	// Only the target window really holds the screen content, and its content is
+	// always up to date. So buffer age is always 1.
+	return 1;
+}
+
+static bool is_image_transparent(backend_t *base attr_unused, void *image) {
+	struct pixman_image_data *img = image;
+	return img->has_alpha;
+}
+
+/// Invert the colors of the part of `buf` in `reg`, keeping the alpha
+static void invert_color(const struct pixman_buffer *buf, const region_t *reg) {
+	const bool has_alpha = PIXMAN_FORMAT_A(buf->format) != 0;
+	int nrects;
+	const rect_t *rects = pixman_region32_rectangles((region_t *)reg, &nrects);
+	for (int i = 0; i < nrects; i++) {
+		for (int y = rects[i].y1; y < rects[i].y2; y++) {
+			uint32_t *row = buf->bits + y * buf->stride / 4;
+			for (int x = rects[i].x1; x < rects[i].x2; x++) {
+				// Colors are premultiplied, so they are inverted
+				// against the alpha, not against 255
+				uint32_t alpha = has_alpha ? row[x] >> 24 : 0xff;
+				uint32_t rgb = (alpha << 16 | alpha << 8 | alpha) -
+				               (row[x] & 0xffffff);
+				row[x] = alpha << 24 | rgb;
+			}
+		}
+	}
+}
+
+static bool image_op(backend_t *base, enum image_operations op, void *image,
+                     const region_t *reg_op, const region_t *reg_visible, void *arg) {
+	struct pixman_data *pd = (void *)base;
+	struct pixman_image_data *img = image;
+	double *dargs = arg;
+	int *iargs = arg;
+	if (op == IMAGE_OP_APPLY_ALPHA_ALL) {
+		img->opacity *= dargs[0];
+		img->has_alpha = true;
+		return true;
+	}
+	if (op == IMAGE_OP_RESIZE_TILE) {
+		img->ewidth = iargs[0];
+		img->eheight = iargs[1];
+		return true;
+	}
+	if (!pixman_image_fetch(pd, img)) {
+		return false;
+	}
+
+	region_t reg;
+	pixman_region32_init(&reg);
+	pixman_region32_intersect_rect(&reg, (region_t *)reg_visible, 0, 0,
+	                               (uint)img->buf.width, (uint)img->buf.height);
+	switch (op) {
+	case IMAGE_OP_INVERT_COLOR_ALL: invert_color(&img->buf, &reg); break;
+	case IMAGE_OP_DIM_ALL: {
+		pixman_color_t black = {.alpha = (uint16_t)(0xffff * dargs[0])};
+		struct pixman_composite dim = {
+		    .op = PIXMAN_OP_OVER,
+		    .src = {.color = &black},
+		    .alpha = 1,
+		    .dst = &img->buf,
+		};
+		pixman_composite_run(pd, &dim, &reg);
+		break;
+	}
+	case IMAGE_OP_APPLY_ALPHA:
+		assert(reg_op);
+		pixman_region32_intersect(&reg, &reg, (region_t *)reg_op);
+		if (!pixman_region32_not_empty(&reg) || dargs[0] == 1) {
+			break;
+		}
+
+		pixman_color_t alpha = {.alpha = (uint16_t)(0xffff * (1 - dargs[0]))};
+		struct pixman_composite apply_alpha = {
+		    .op = PIXMAN_OP_OUT_REVERSE,
+		    .src = {.color = &alpha},
+		    .alpha = 1,
+		    .dst = &img->buf,
+		};
+		pixman_composite_run(pd, &apply_alpha, &reg);
+		img->has_alpha = true;
+		break;
+	case IMAGE_OP_APPLY_ALPHA_ALL:
+	case IMAGE_OP_RESIZE_TILE: assert(false);
+	case IMAGE_OP_MAX_BRIGHTNESS: assert(false);
+	}
+	pixman_region32_fini(&reg);
+	return true;
+}
+
+static void *copy(backend_t *base, const void *image, const region_t *reg_visible) {
+	struct pixman_data *pd = (void *)base;
+	struct pixman_image_data *img = (void *)image;
+	if (!pixman_image_fetch(pd, img)) {
+		return NULL;
+	}
+
+	auto new_img = ccalloc(1, struct pixman_image_data);
+	new_img->ewidth = img->ewidth;
+	new_img->eheight = img->eheight;
+	new_img->has_alpha = img->has_alpha;
+	new_img->opacity = 1;
+	pixman_region32_init(&new_img->stale);
+	// Always keep an alpha channel, the copy is usually made to change its alpha
+	if (!pixman_buffer_init(pd, &new_img->buf, PIXMAN_a8r8g8b8, img->buf.width,
+	                        img->buf.height, false)) {
+		pixman_region32_fini(&new_img->stale);
+		free(new_img);
+		return NULL;
+	}
+
+	region_t reg;
+	pixman_region32_init(&reg);
+	pixman_region32_intersect_rect(&reg, (region_t *)reg_visible, 0, 0,
+	                               (uint)img->buf.width, (uint)img->buf.height);
+	struct pixman_composite comp = {
+	    .op = PIXMAN_OP_SRC,
+	    .src = {.buf = &img->buf},
+	    .alpha = img->opacity,
+	    .dst = &new_img->buf,
+	};
+	pixman_composite_run(pd, &comp, &reg);
+	pixman_region32_fini(&reg);
+	return new_img;
+}
+
+static void *create_blur_context(backend_t *base attr_unused, enum blur_method method,
+                                 void *args) {
+	auto ret = ccalloc(1, struct pixman_blur_context);
+	if (!method || method >= BLUR_METHOD_INVALID) {
+		ret->method = BLUR_METHOD_NONE;
+		return ret;
+	}
+	if (method == BLUR_METHOD_DUAL_KAWASE || method == BLUR_METHOD_ALT_KAWASE) {
+		log_warn("Blur method 'dual_kawase' is not compatible with the 'pixman' "
+		         "backend.");
+		ret->method = BLUR_METHOD_NONE;
+		return ret;
+	}
+
+	ret->method = BLUR_METHOD_KERNEL;
+	struct conv **kernels;
+	int kernel_count;
+	if (method == BLUR_METHOD_KERNEL) {
+		kernels = ((struct kernel_blur_args *)args)->kernels;
+		kernel_count = ((struct kernel_blur_args *)args)->kernel_count;
+	} else {
+		kernels = generate_blur_kernel(method, args, &kernel_count);
+	}
+
+	// pixman implements the convolution filter of X Render, and takes the same
+	// parameters
+	ret->kernels = ccalloc(kernel_count, struct x_convolution_kernel *);
+	for (int i = 0; i < kernel_count; i++) {
+		int center = kernels[i]->h * kernels[i]->w / 2;
+		x_create_convolution_kernel(kernels[i], kernels[i]->data[center],
+		                            &ret->kernels[i]);
+		ret->resize_width += kernels[i]->w / 2;
+		ret->resize_height += kernels[i]->h / 2;
+	}
+	ret->kernel_count = kernel_count;
+
+	if (method != BLUR_METHOD_KERNEL) {
+		// Kernels generated by generate_blur_kernel, so we need to free them.
+		for (int i = 0; i < kernel_count; i++) {
+			free(kernels[i]);
+		}
+		free(kernels);
+	}
+	return ret;
+}
+
+static void destroy_blur_context(backend_t *base attr_unused, void *ctx_) {
+	struct pixman_blur_context *ctx = ctx_;
+	for (int i = 0; i < ctx->kernel_count; i++) {
+		free(ctx->kernels[i]);
+	}
+	free(ctx->kernels);
+	free(ctx);
+}
+
+static void get_blur_size(void *blur_context, int *width, int *height) {
+	struct pixman_blur_context *ctx = blur_context;
+	*width = ctx->resize_width;
+	*height = ctx->resize_height;
+}
+
+static void *create_round_context(backend_t *base attr_unused, void *args attr_unused) {
+	return ccalloc(1, struct pixman_round_context);
+}
+
+static void destroy_round_context(backend_t *base attr_unused, void *ctx_) {
+	struct pixman_round_context *ctx = ctx_;
+	free(ctx->corners);
+	free(ctx);
+}
+
+static void diagnostics(backend_t *base) {
+	struct pixman_data *pd = (void *)base;
+	printf("* Rendering threads: %d\n", worker_pool_concurrency(pd->workers));
+	printf("* MIT-SHM: %s\n", pd->shm ? "Yes" : "No");
+}
+
+static backend_t *backend_pixman_init(session_t *ps) {
+	auto pd = ccalloc(1, struct pixman_data);
+	init_backend_base(&pd->base, ps);
+
+	pixman_format_code_t format;
+	if (ps->depth == 24) {
+		format = PIXMAN_x8r8g8b8;
+	} else if (ps->depth == 32) {
+		format = PIXMAN_a8r8g8b8;
+	} else {
+		log_error("The pixman backend doesn't support screens with depth %d",
+		          ps->depth);
+		free(pd);
+		return NULL;
+	}
+	pd->depth = (uint8_t)ps->depth;
+	pd->shm = ps->shm_pool.enabled;
+
+	pd->target_win = session_get_target_window(ps);
+	pd->gc = x_new_id(ps->c);
+	// Draw over the children of the root window too, when it is the target
+	xcb_create_gc(ps->c, pd->gc, pd->target_win, XCB_GC_SUBWINDOW_MODE,
+	              (const uint32_t[]){XCB_SUBWINDOW_MODE_INCLUDE_INFERIORS});
+
+	if (!pixman_buffer_init(pd, &pd->back, format, ps->root_width, ps->root_height,
+	                        true)) {
+		log_error("Cannot create the rendering buffer");
+		goto err;
+	}
+
+	// Leave one CPU for the X server, it has to copy our frames too
+	auto ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int nthreads = (int)clamp(ncpus - 2, 0, PIXMAN_MAX_THREADS);
+	pd->workers = worker_pool_new(nthreads);
+	log_info("The pixman backend renders with %d threads, %s MIT-SHM",
+	         worker_pool_concurrency(pd->workers), pd->shm ? "with" : "without");
+	return &pd->base;
+
+err:
+	deinit(&pd->base);
+	return NULL;
+}
+
+struct backend_operations pixman_ops = {
+    .init = backend_pixman_init,
+    .deinit = deinit,
+    .prepare = prepare,
+    .image_damaged = image_damaged,
+    .blur = blur,
+    .round = pixman_round,
+    .present = present,
+    .compose = compose,
+    .fill = fill,
+    .bind_pixmap = bind_pixmap,
+    .release_image = release_image,
+    .render_shadow = render_shadow,
+    .make_mask = make_mask,
+    .is_image_transparent = is_image_transparent,
+    .buffer_age = buffer_age,
+    .max_buffer_age = 2,
+
+    .image_op = image_op,
+    .copy = copy,
+    .create_blur_context = create_blur_context,
+    .destroy_blur_context = destroy_blur_context,
+    .get_blur_size = get_blur_size,
+    .store_back_texture = store_back_texture,
+    .create_round_context = create_round_context,
+    .destroy_round_context = destroy_round_context,
+    .diagnostics = diagnostics,
+};
+
+// vim: set noet sw=8 ts=8:
@@ -0,0 +1,139 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (c) Yuxuan Shui <yshuiv7@gmail.com>
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "log.h"
+#include "utils.h"
+
+#include "backend/pixman/worker_pool.h"
+
+struct worker_pool {
+	pthread_mutex_t lock;
+	/// Signaled when a new batch of tasks is available, or when the pool is freed
+	pthread_cond_t work;
+	/// Signaled when the last task of a batch is done
+	pthread_cond_t done;
+
+	pthread_t *threads;
+	int nthreads;
+
+	// The current batch of tasks, protected by `lock`
+	worker_pool_fn fn;
+	void *data;
+	int ntasks;
+	/// Index of the next task to be picked up
+	int next_task;
+	/// Number of tasks that are not finished yet
+	int pending;
+	/// Incremented for every batch, so workers can tell new batches apart
+	unsigned int generation;
+	bool quit;
+};
+
+/// Run tasks of the current batch until there are none left to pick up. Must be
+/// called with `pool->lock` held.
+static void worker_pool_drain(struct worker_pool *pool) {
+	while (pool->next_task < pool->ntasks) {
+		int task = pool->next_task++;
+		auto fn = pool->fn;
+		auto data = pool->data;
+		pthread_mutex_unlock(&pool->lock);
+		fn(data, task);
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->pending == 0) {
+			pthread_cond_signal(&pool->done);
+		}
+	}
+}
+
+static void *worker_pool_thread(void *arg) {
+	struct worker_pool *pool = arg;
+	unsigned int generation = 0;
+	pthread_mutex_lock(&pool->lock);
+	while (true) {
+		while (!pool->quit && pool->generation == generation) {
+			pthread_cond_wait(&pool->work, &pool->lock);
+		}
+		if (pool->quit) {
+			break;
+		}
+		generation = pool->generation;
+		worker_pool_drain(pool);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+struct worker_pool *worker_pool_new(int nthreads) {
+	auto pool = ccalloc(1, struct worker_pool);
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work, NULL);
+	pthread_cond_init(&pool->done, NULL);
+
+	pool->threads = ccalloc(nthreads > 0 ? nthreads : 1, pthread_t);
+	for (int i = 0; i < nthreads; i++) {
+		auto ret = pthread_create(&pool->threads[i], NULL, worker_pool_thread,
+		                          pool);
+		if (ret != 0) {
+			log_warn("Failed to create worker thread, using %d threads.", i);
+			break;
+		}
+		pool->nthreads++;
+	}
+	return pool;
+}
+
+void worker_pool_free(struct worker_pool *pool) {
+	pthread_mutex_lock(&pool->lock);
+	pool->quit = true;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+	for (int i = 0; i < pool->nthreads; i++) {
+		pthread_join(pool->threads[i], NULL);
+	}
+
+	pthread_cond_destroy(&pool->done);
+	pthread_cond_destroy(&pool->work);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->threads);
+	free(pool);
+}
+
+int worker_pool_concurrency(const struct worker_pool *pool) {
+	return pool->nthreads + 1;
+}
+
+void worker_pool_run(struct worker_pool *pool, int ntasks, worker_pool_fn fn,
+                     void *data) {
+	if (ntasks <= 0) {
+		return;
+	}
+	if (ntasks == 1 || pool->nthreads == 0) {
+		// Not worth waking up the workers
+		for (int i = 0; i < ntasks; i++) {
+			fn(data, i);
+		}
+		return;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->fn = fn;
+	pool->data = data;
+	pool->ntasks = ntasks;
+	pool->next_task = 0;
+	pool->pending = ntasks;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->work);
+
+	worker_pool_drain(pool);
+	while (pool->pending > 0) {
+		pthread_cond_wait(&pool->done, &pool->lock);
+	}
+	pool->fn = NULL;
+	pool->data = NULL;
+	pool->ntasks = 0;
+	pthread_mutex_unlock(&pool->lock);
+}
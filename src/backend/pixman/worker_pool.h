@@ -0,0 +1,22 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (c) Yuxuan Shui <yshuiv7@gmail.com>
+
+#pragma once
+
+struct worker_pool;
+
+typedef void (*worker_pool_fn)(void *data, int task);
+
+/// Create a pool of `nthreads` worker threads. A pool without threads is valid, it
+/// just runs everything on the calling thread.
+struct worker_pool *worker_pool_new(int nthreads);
+void worker_pool_free(struct worker_pool *pool);
+
+/// Number of threads that can run tasks at the same time, including the caller of
+/// `worker_pool_run`.
+int worker_pool_concurrency(const struct worker_pool *pool);
+
+/// Run `fn(data, i)` for every `i` in `[0, ntasks)`, and wait for all of them to
+/// finish. The calling thread runs tasks too. Tasks can run in any order, and must
+/// not call `worker_pool_run` themselves.
+void worker_pool_run(struct worker_pool *pool, int ntasks, worker_pool_fn fn, void *data);
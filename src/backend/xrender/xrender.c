@@ -88,7 +88,8 @@ struct _xrender_image_data {
 
 uint32_t make_rounded_window_shape(xcb_render_trapezoid_t traps[], uint32_t max_ntraps, int cr, int ct, int wid, int hei);
 
-static void compose(backend_t *base, struct managed_win *w, void *img_data, int dst_x, int dst_y,
+static void compose(backend_t *base, struct managed_win *w, void *img_data,
+                    void *mask attr_unused, int dst_x, int dst_y,
                     const region_t *reg_paint, const region_t *reg_visible) {
 	struct _xrender_data *xd = (void *)base;
 	struct _xrender_image_data *img = img_data;
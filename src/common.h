@@ -52,6 +52,7 @@
 
 // FIXME This list of includes should get shorter
 #include "backend/backend.h"
+#include "backend/command_list.h"
 #include "backend/driver.h"
 #include "compiler.h"
 #include "config.h"
@@ -78,6 +79,16 @@
 /// @brief Maximum passes for blur.
 #define MAX_BLUR_PASS 6
 
+/// @brief Maximum number of rectangles in a damage region before it is coarsened.
+#define DAMAGE_MAX_RECTS 64
+
+/// @brief Initial tile size used when coarsening damage regions.
+#define DAMAGE_TILE_SIZE 32
+
+/// @brief Minimum number of rectangles in a bounding shape before a mask is used to
+/// paint the window.
+#define SHAPE_MASK_MIN_RECTS 32
+
 // Window flags
 
 // === Types ===
@@ -142,6 +153,19 @@ typedef struct session {
 	ev_timer unredir_timer;
 	/// Timer for fading
 	ev_timer fade_timer;
+	/// Timer to finish the resize of windows once they stop being resized. See
+	/// `managed_win::resize_pending`.
+	ev_timer resize_timer;
+	/// Timer to reload the configuration after the config file changed. Gives the
+	/// editor time to finish writing the file.
+	ev_timer reload_timer;
+	/// Timer to update the window statistics, and to log the windows that cost the
+	/// most
+	ev_timer win_stats_timer;
+	/// Number of times `win_stats_timer` fired since the statistics were last logged
+	int win_stats_ticks;
+	/// Whether painting time is measured for the window statistics
+	bool win_stats_enabled;
 	/// Timer for delayed drawing, right now only used by
 	/// swopti
 	ev_timer delayed_draw_timer;
@@ -225,12 +249,26 @@ typedef struct session {
 	xcb_sync_fence_t sync_fence;
 	/// Whether we are rendering the first frame after screen is redirected
 	bool first_frame;
+	/// When the session started, and when the last step of the startup was
+	/// reported. For --startup-profile
+	struct timespec startup_time, startup_last_step;
+	/// Whether the first frame of the session has been rendered
+	bool startup_done;
+	/// Records the handled X events, for --record-events
+	struct event_recorder *event_recorder;
+	/// Replays recorded X events, for --replay-events
+	struct event_replayer *event_replayer;
 
 	// === Operation related ===
 	/// Flags related to the root window
 	uint64_t root_flags;
 	/// Program options.
 	options_t o;
+	/// Command line arguments and the config file given on the command line (NULL
+	/// if none), kept to parse the configuration again when it changes.
+	int argc;
+	char **argv;
+	char *config_file;
 	/// Whether we have hit unredirection timeout.
 	bool tmout_unredir_hit;
 	/// Whether we need to redraw the screen
@@ -241,10 +279,17 @@ typedef struct session {
 	xcb_xfixes_region_t damaged_region;
 	/// The region needs to painted on next paint.
 	region_t *damage;
-	/// The region damaged on the last paint.
+	/// The damage ring. Starting from `damage`, the i-th entry is the union of
+	/// the damage of the current frame and the i-1 frames before it, so a
+	/// buffer age query is a single lookup.
 	region_t *damage_ring;
 	/// Number of damage regions we track
 	int ndamage;
+	/// Render commands of the frame being painted. Kept around to reuse the
+	/// allocation.
+	struct command_list frame_commands;
+	/// Render commands of the last painted frame.
+	struct command_list last_frame_commands;
 	/// Whether all windows are currently redirected.
 	bool redirected;
 	/// Pre-generated alpha pictures.
@@ -279,6 +324,17 @@ typedef struct session {
 	struct win *windows;
 	/// Windows in their stacking order
 	struct list_node window_stack;
+	/// The managed windows of `window_stack`, in the same order. Rebuilt lazily
+	/// when the stack changes, see `win_stack_managed`.
+	struct managed_win **managed_stack;
+	int managed_stack_len, managed_stack_capacity;
+	/// Whether `managed_stack` is up to date with `window_stack`
+	bool managed_stack_valid;
+	/// Incremented every time the state of a window changes, so D-Bus clients can
+	/// ask for the changes since the last time they looked.
+	uint64_t win_generation;
+	/// Estimated memory used by the images of all windows, in bytes
+	size_t win_image_bytes;
 	/// Pointer to <code>win</code> of current active window. Used by
 	/// EWMH <code>_NET_ACTIVE_WINDOW</code> focus detection. In theory,
 	/// it's more reliable to store the window ID directly here, just in
@@ -369,6 +425,8 @@ typedef struct session {
 	int xsync_error;
 	/// Whether X Render convolution filter exists.
 	bool xrfilter_convolution_exists;
+	/// Shared memory segments for uploading images, e.g. shadows, to the X server.
+	struct x_shm_pool shm_pool;
 
 	// === Atoms ===
 	struct atom *atoms;
@@ -380,6 +438,8 @@ typedef struct session {
 #ifdef CONFIG_DBUS
 	// === DBus related ===
 	void *dbus_data;
+	/// Whether D-Bus was asked for but couldn't be initialized
+	bool dbus_init_failed;
 #endif
 
 	int (*vsync_wait)(session_t *);
@@ -454,6 +514,15 @@ static inline struct timespec get_time_timespec(void) {
 	return tm;
 }
 
+/**
+ * Get current system clock in milliseconds.
+ */
+static inline int64_t get_time_ms(void) {
+	struct timespec tp;
+	clock_gettime(CLOCK_MONOTONIC, &tp);
+	return (int64_t)tp.tv_sec * 1000 + (int64_t)tp.tv_nsec / 1000000;
+}
+
 /**
  * Return the painting target window.
  */
@@ -34,6 +34,7 @@ enum backend {
 	BKEND_GLX,
 	BKEND_XR_GLX_HYBRID,
 	BKEND_DUMMY,
+	BKEND_PIXMAN,
 	NUM_BKEND,
 };
 
@@ -87,8 +88,17 @@ typedef struct options {
 	// === Debugging ===
 	bool monitor_repaint;
 	bool print_diagnostics;
+	/// Print the time spent on each step of the startup
+	bool startup_profile;
+	/// Log the windows that cost the most to composite every this many seconds, 0
+	/// to disable
+	int window_stats_interval;
 	/// Render to a separate window instead of taking over the screen
 	bool debug_mode;
+	/// Record the handled X events into this file
+	char *record_events_path;
+	/// Replay the X events recorded in this file
+	char *replay_events_path;
 	// === General ===
 	/// Use the experimental new backends?
 	bool experimental_backends;
@@ -104,6 +114,11 @@ typedef struct options {
 	bool glx_no_stencil;
 	/// Whether to avoid rebinding pixmap on window damage.
 	bool glx_no_rebind_pixmap;
+	/// Size limit of the pool of released textures kept for reuse, in MiB.
+	int glx_texture_pool_size;
+	/// Memory the images of windows can use before the images of hidden windows
+	/// are released, in MiB. 0 for no limit.
+	int image_memory_budget;
 	/// Custom fragment shader for painting windows, as a string.
 	char *glx_fshader_win_str;
 	/// Whether to detect rounded corners.
@@ -560,6 +560,8 @@ char *parse_config_libconfig(options_t *opt, const char *config_file, bool *shad
 	lcfg_lookup_bool(&cfg, "no-ewmh-fullscreen", &opt->no_ewmh_fullscreen);
 	// --transparent-clipping
 	lcfg_lookup_bool(&cfg, "transparent-clipping", &opt->transparent_clipping);
+	// --window-stats-interval
+	config_lookup_int(&cfg, "window-stats-interval", &opt->window_stats_interval);
 	// --shadow-exclude
 	parse_cfg_condlst(&cfg, &opt->shadow_blacklist, "shadow-exclude");
 	// --fade-exclude
@@ -617,6 +619,10 @@ char *parse_config_libconfig(options_t *opt, const char *config_file, bool *shad
 	lcfg_lookup_bool(&cfg, "glx-no-stencil", &opt->glx_no_stencil);
 	// --glx-no-rebind-pixmap
 	lcfg_lookup_bool(&cfg, "glx-no-rebind-pixmap", &opt->glx_no_rebind_pixmap);
+	// --glx-texture-pool-size
+	config_lookup_int(&cfg, "glx-texture-pool-size", &opt->glx_texture_pool_size);
+	// --image-memory-budget
+	config_lookup_int(&cfg, "image-memory-budget", &opt->image_memory_budget);
 	lcfg_lookup_bool(&cfg, "force-win-blend", &opt->force_win_blend);
 	// --glx-swap-method
 	if (config_lookup_string(&cfg, "glx-swap-method", &sval)) {
@@ -31,13 +31,6 @@
 
 #include "dbus.h"
 
-struct cdbus_data {
-	/// DBus connection.
-	DBusConnection *dbus_conn;
-	/// DBus service name.
-	char *dbus_service;
-};
-
 // Window type
 typedef uint32_t cdbus_window_t;
 #define CDBUS_TYPE_WINDOW DBUS_TYPE_UINT32
@@ -47,6 +40,43 @@ typedef uint32_t cdbus_enum_t;
 #define CDBUS_TYPE_ENUM DBUS_TYPE_UINT32
 #define CDBUS_TYPE_ENUM_STR DBUS_TYPE_UINT32_AS_STRING
 
+/// Type of the window state structs returned by win_state_all and win_state_changes:
+/// id, client_win, leader, state, window_type, mode, mapped, focused, x, y, width,
+/// height, opacity, opacity_target, shadow, invert_color, blur_background, name,
+/// class_instance, class_general, role, generation
+#define CDBUS_TYPE_WIN_STATE_STR                                                         \
+	"(" CDBUS_TYPE_WINDOW_STR CDBUS_TYPE_WINDOW_STR CDBUS_TYPE_WINDOW_STR            \
+	    CDBUS_TYPE_ENUM_STR CDBUS_TYPE_ENUM_STR CDBUS_TYPE_ENUM_STR                  \
+	    "bbiiiiddbbbsssst)"
+
+/// Type of the structs returned by win_stats: the window id, followed by the rates of
+/// the window statistics, in the order of `enum win_stat`
+#define CDBUS_TYPE_WIN_STATS_STR "(" CDBUS_TYPE_WINDOW_STR "dddddd)"
+static_assert(NUM_WIN_STATS == 6, "CDBUS_TYPE_WIN_STATS_STR is out of date");
+
+/// Number of destroyed windows remembered for win_state_changes
+#define CDBUS_DESTROYED_MAX 256
+
+struct cdbus_destroyed_win {
+	cdbus_window_t wid;
+	uint64_t generation;
+};
+
+struct cdbus_data {
+	/// DBus connection.
+	DBusConnection *dbus_conn;
+	/// DBus service name.
+	char *dbus_service;
+	/// Recently destroyed windows, a ring buffer with its oldest entry at
+	/// `destroyed_head` once it's full.
+	struct cdbus_destroyed_win destroyed[CDBUS_DESTROYED_MAX];
+	int destroyed_head;
+	int ndestroyed;
+	/// Windows destroyed after this generation might have been dropped from
+	/// `destroyed`, changes since an earlier generation can't be computed.
+	uint64_t destroyed_since;
+};
+
 #define CDBUS_SERVICE_NAME "com.github.chjj.compton"
 #define CDBUS_INTERFACE_NAME CDBUS_SERVICE_NAME
 #define CDBUS_OBJECT_NAME "/com/github/chjj/compton"
@@ -92,6 +122,9 @@ static void cdbus_callback_watch_toggled(DBusWatch *watch, void *data);
 bool cdbus_init(session_t *ps, const char *uniq) {
 	auto cd = cmalloc(struct cdbus_data);
 	cd->dbus_service = NULL;
+	cd->destroyed_head = 0;
+	cd->ndestroyed = 0;
+	cd->destroyed_since = ps->win_generation;
 
 	// Set ps->dbus_data here because add_watch functions need it
 	ps->dbus_data = cd;
@@ -504,6 +537,174 @@ static bool cdbus_apdarg_wids(session_t *ps, DBusMessage *msg, const void *data
 	free(arr);
 	return true;
 }
+
+/// Append the state of a window to an array of window state structs
+static bool cdbus_append_win_state(DBusMessageIter *arr, const struct managed_win *w) {
+	cdbus_window_t id = w->base.id, client_win = w->client_win, leader = w->leader;
+	cdbus_enum_t state = w->state, window_type = w->window_type, mode = w->mode;
+	dbus_bool_t mapped = w->a.map_state == XCB_MAP_STATE_VIEWABLE,
+	            focused = w->focused, shadow = w->shadow,
+	            invert_color = w->invert_color, blur_background = w->blur_background;
+	int32_t x = w->g.x, y = w->g.y, width = w->g.width, height = w->g.height;
+	double opacity = w->opacity, opacity_target = w->opacity_target;
+	const char *name = w->name ?: "", *class_instance = w->class_instance ?: "",
+	           *class_general = w->class_general ?: "", *role = w->role ?: "";
+	dbus_uint64_t generation = w->generation;
+
+	const struct {
+		int type;
+		const void *value;
+	} fields[] = {
+	    {CDBUS_TYPE_WINDOW, &id},          {CDBUS_TYPE_WINDOW, &client_win},
+	    {CDBUS_TYPE_WINDOW, &leader},      {CDBUS_TYPE_ENUM, &state},
+	    {CDBUS_TYPE_ENUM, &window_type},   {CDBUS_TYPE_ENUM, &mode},
+	    {DBUS_TYPE_BOOLEAN, &mapped},      {DBUS_TYPE_BOOLEAN, &focused},
+	    {DBUS_TYPE_INT32, &x},             {DBUS_TYPE_INT32, &y},
+	    {DBUS_TYPE_INT32, &width},         {DBUS_TYPE_INT32, &height},
+	    {DBUS_TYPE_DOUBLE, &opacity},      {DBUS_TYPE_DOUBLE, &opacity_target},
+	    {DBUS_TYPE_BOOLEAN, &shadow},      {DBUS_TYPE_BOOLEAN, &invert_color},
+	    {DBUS_TYPE_BOOLEAN, &blur_background},
+	    {DBUS_TYPE_STRING, &name},         {DBUS_TYPE_STRING, &class_instance},
+	    {DBUS_TYPE_STRING, &class_general}, {DBUS_TYPE_STRING, &role},
+	    {DBUS_TYPE_UINT64, &generation},
+	};
+
+	DBusMessageIter st;
+	if (!dbus_message_iter_open_container(arr, DBUS_TYPE_STRUCT, NULL, &st)) {
+		return false;
+	}
+	for (size_t i = 0; i < ARR_SIZE(fields); i++) {
+		auto field = &fields[i];
+		if (!dbus_message_iter_append_basic(&st, field->type, field->value)) {
+			dbus_message_iter_abandon_container(arr, &st);
+			return false;
+		}
+	}
+	return dbus_message_iter_close_container(arr, &st);
+}
+
+/**
+ * Callback to append the statistics of all windows to a message.
+ */
+static bool
+cdbus_apdarg_win_stats(session_t *ps, DBusMessage *msg, const void *data attr_unused) {
+	DBusMessageIter iter, arr, st;
+	dbus_message_iter_init_append(msg, &iter);
+	if (!dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+	                                      CDBUS_TYPE_WIN_STATS_STR, &arr)) {
+		goto err;
+	}
+	win_stack_foreach_managed(w, &ps->window_stack) {
+		if (w->state == WSTATE_DESTROYING) {
+			continue;
+		}
+		cdbus_window_t wid = w->base.id;
+		if (!dbus_message_iter_open_container(&arr, DBUS_TYPE_STRUCT, NULL,
+		                                      &st)) {
+			dbus_message_iter_abandon_container(&iter, &arr);
+			goto err;
+		}
+		bool success =
+		    dbus_message_iter_append_basic(&st, CDBUS_TYPE_WINDOW, &wid);
+		for (int i = 0; i < NUM_WIN_STATS && success; i++) {
+			success = dbus_message_iter_append_basic(&st, DBUS_TYPE_DOUBLE,
+			                                         &w->stats.rate[i]);
+		}
+		if (!success) {
+			dbus_message_iter_abandon_container(&arr, &st);
+		}
+		if (!success || !dbus_message_iter_close_container(&arr, &st)) {
+			dbus_message_iter_abandon_container(&iter, &arr);
+			goto err;
+		}
+	}
+	if (!dbus_message_iter_close_container(&iter, &arr)) {
+		goto err;
+	}
+	return true;
+
+err:
+	log_error("Failed to append argument.");
+	return false;
+}
+
+struct cdbus_win_state_query {
+	/// Only include windows that changed after this generation
+	uint64_t since;
+	bool mapped_only;
+	/// Whether this is a win_state_changes query
+	bool changes;
+};
+
+/**
+ * Callback to append the state of windows to a message. `data` is a
+ * `struct cdbus_win_state_query`.
+ */
+static bool cdbus_apdarg_win_states(session_t *ps, DBusMessage *msg, const void *data) {
+	const struct cdbus_win_state_query *query = data;
+	struct cdbus_data *cd = ps->dbus_data;
+	dbus_uint64_t generation = ps->win_generation;
+	uint64_t since = query->since;
+
+	// A generation we can't compute changes from, e.g. one from before a reset,
+	// gets all the windows instead
+	dbus_bool_t complete = !query->changes || since < cd->destroyed_since ||
+	                       since > ps->win_generation;
+	if (complete) {
+		since = 0;
+	}
+
+	DBusMessageIter iter, arr;
+	dbus_message_iter_init_append(msg, &iter);
+	if (!dbus_message_iter_append_basic(&iter, DBUS_TYPE_UINT64, &generation) ||
+	    (query->changes &&
+	     !dbus_message_iter_append_basic(&iter, DBUS_TYPE_BOOLEAN, &complete))) {
+		goto err;
+	}
+
+	if (!dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+	                                      CDBUS_TYPE_WIN_STATE_STR, &arr)) {
+		goto err;
+	}
+	win_stack_foreach_managed(w, &ps->window_stack) {
+		if (w->state == WSTATE_DESTROYING || w->generation <= since ||
+		    (query->mapped_only && w->a.map_state != XCB_MAP_STATE_VIEWABLE)) {
+			continue;
+		}
+		if (!cdbus_append_win_state(&arr, w)) {
+			dbus_message_iter_abandon_container(&iter, &arr);
+			goto err;
+		}
+	}
+	if (!dbus_message_iter_close_container(&iter, &arr)) {
+		goto err;
+	}
+
+	if (query->changes) {
+		if (!dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+		                                      CDBUS_TYPE_WINDOW_STR, &arr)) {
+			goto err;
+		}
+		for (int i = 0; i < cd->ndestroyed && !complete; i++) {
+			int index = (cd->destroyed_head + i) % CDBUS_DESTROYED_MAX;
+			auto d = &cd->destroyed[index];
+			if (d->generation > since &&
+			    !dbus_message_iter_append_basic(&arr, CDBUS_TYPE_WINDOW,
+			                                    &d->wid)) {
+				dbus_message_iter_abandon_container(&iter, &arr);
+				goto err;
+			}
+		}
+		if (!dbus_message_iter_close_container(&iter, &arr)) {
+			goto err;
+		}
+	}
+	return true;
+
+err:
+	log_error("Failed to append argument.");
+	return false;
+}
 ///@}
 
 /**
@@ -732,6 +933,41 @@ static bool cdbus_process_list_win(session_t *ps, DBusMessage *msg) {
 	return true;
 }
 
+/**
+ * Process a win_state_all D-Bus request. Replies with the current generation, and the
+ * state of all windows, or only the mapped ones.
+ */
+static bool cdbus_process_win_state_all(session_t *ps, DBusMessage *msg) {
+	dbus_bool_t mapped_only = false;
+	if (!cdbus_msg_get_arg(msg, 0, DBUS_TYPE_BOOLEAN, &mapped_only)) {
+		return false;
+	}
+
+	struct cdbus_win_state_query query = {.mapped_only = mapped_only};
+	cdbus_reply(ps, msg, cdbus_apdarg_win_states, &query);
+	return true;
+}
+
+/**
+ * Process a win_state_changes D-Bus request. Replies with the current generation,
+ * whether the reply is complete, the state of the windows that changed since the
+ * given generation, and the windows destroyed since then.
+ *
+ * A complete reply includes all windows, and clients should discard the windows they
+ * know of but are not in it. That happens when the changes since the given generation
+ * are no longer known.
+ */
+static bool cdbus_process_win_state_changes(session_t *ps, DBusMessage *msg) {
+	dbus_uint64_t since = 0;
+	if (!cdbus_msg_get_arg(msg, 0, DBUS_TYPE_UINT64, &since)) {
+		return false;
+	}
+
+	struct cdbus_win_state_query query = {.since = since, .changes = true};
+	cdbus_reply(ps, msg, cdbus_apdarg_win_states, &query);
+	return true;
+}
+
 /**
  * Process a win_get D-Bus request.
  */
@@ -1239,6 +1475,13 @@ cdbus_process(DBusConnection *c attr_unused, DBusMessage *msg, void *ud) {
 		handled = true;
 	} else if (cdbus_m_ismethod("list_win")) {
 		handled = cdbus_process_list_win(ps, msg);
+	} else if (cdbus_m_ismethod("win_state_all")) {
+		handled = cdbus_process_win_state_all(ps, msg);
+	} else if (cdbus_m_ismethod("win_state_changes")) {
+		handled = cdbus_process_win_state_changes(ps, msg);
+	} else if (cdbus_m_ismethod("win_stats")) {
+		cdbus_reply(ps, msg, cdbus_apdarg_win_stats, NULL);
+		handled = true;
 	} else if (cdbus_m_ismethod("win_get")) {
 		handled = cdbus_process_win_get(ps, msg);
 	} else if (cdbus_m_ismethod("win_set")) {
@@ -1310,6 +1553,20 @@ void cdbus_ev_win_added(session_t *ps, struct win *w) {
 
 void cdbus_ev_win_destroyed(session_t *ps, struct win *w) {
 	struct cdbus_data *cd = ps->dbus_data;
+
+	// Remember the window for win_state_changes
+	int index = (cd->destroyed_head + cd->ndestroyed) % CDBUS_DESTROYED_MAX;
+	if (cd->ndestroyed == CDBUS_DESTROYED_MAX) {
+		cd->destroyed_since = cd->destroyed[cd->destroyed_head].generation;
+		cd->destroyed_head = (cd->destroyed_head + 1) % CDBUS_DESTROYED_MAX;
+	} else {
+		cd->ndestroyed++;
+	}
+	cd->destroyed[index] = (struct cdbus_destroyed_win){
+	    .wid = w->id,
+	    .generation = ++ps->win_generation,
+	};
+
 	if (cd->dbus_conn)
 		cdbus_signal_wid(ps, "win_destroyed", w->id);
 }
@@ -2,6 +2,7 @@
 // Copyright (c) 2019, Yuxuan Shui <yshuiv7@gmail.com>
 
 #include <stdio.h>
+#include <test.h>
 
 #include <X11/Xlibint.h>
 #include <X11/extensions/sync.h>
@@ -13,6 +14,7 @@
 #include "compiler.h"
 #include "config.h"
 #include "event.h"
+#include "event_record.h"
 #include "log.h"
 #include "picom.h"
 #include "region.h"
@@ -232,6 +234,8 @@ static void configure_win(session_t *ps, xcb_configure_notify_event_t *ce) {
 			mw->pending_g.width = ce->width;
 			mw->pending_g.height = ce->height;
 			mw->pending_g.border_width = ce->border_width;
+			// Damages received from now on are drawn at the new size
+			mw->resize_pending = mw->state == WSTATE_MAPPED;
 			win_set_flags(mw, WIN_FLAGS_SIZE_STALE);
 		}
 
@@ -401,6 +405,8 @@ static inline void ev_circulate_notify(session_t *ps, xcb_circulate_notify_event
 static inline void expose_root(session_t *ps, const rect_t *rects, int nrects) {
 	region_t region;
 	pixman_region32_init_rects(&region, rects, nrects);
+	// Exposed content is lost, whatever was painted last frame
+	command_list_invalidate(&ps->last_frame_commands);
 	add_damage(ps, &region);
 	pixman_region32_fini(&region);
 }
@@ -573,6 +579,51 @@ static inline void ev_property_notify(session_t *ps, xcb_property_notify_event_t
 	}
 }
 
+/// How often the damage rate of a window is looked at, in milliseconds
+#define DAMAGE_RATE_PERIOD 1000
+/// Damage events per second above which a window might be switched to coarse damage
+#define COARSE_DAMAGE_MIN_RATE 30
+/// Damage events per second below which a window is switched back to fine damage
+#define COARSE_DAMAGE_QUIET_RATE 10
+/// Damaged rectangles per damage event above which the damaged region is considered
+/// fragmented
+#define COARSE_DAMAGE_MIN_RECTS 4
+
+/// Decide whether the damage of a window is worth fetching, from the damage it received
+/// over the last period. Fetching the damaged region takes a round trip to the X
+/// server for every damage event, and a fragmented region makes painting slower, so
+/// for windows that update many times per second, with a fragmented damaged region
+/// or one that covers most of the window, the whole window is considered damaged
+/// instead.
+static void update_damage_mode(struct managed_win *w, int64_t now) {
+	auto elapsed = now - w->damage_period_start;
+	double rate = (double)w->damage_period_events * 1000.0 / (double)elapsed;
+	double avg_rects = w->damage_period_events > 0
+	                       ? (double)w->damage_period_rects / w->damage_period_events
+	                       : 0;
+	double avg_pixels = w->damage_period_events > 0
+	                        ? w->damage_period_pixels / w->damage_period_events
+	                        : 0;
+	if (!w->coarse_damage && rate >= COARSE_DAMAGE_MIN_RATE &&
+	    (avg_rects >= COARSE_DAMAGE_MIN_RECTS ||
+	     avg_pixels * 2 >= (double)w->widthb * w->heightb)) {
+		log_debug("Window %#010x (%s) is damaged %.0f times per second, "
+		          "considering the whole window damaged from now on",
+		          w->base.id, w->name, rate);
+		w->coarse_damage = true;
+	} else if (w->coarse_damage && rate < COARSE_DAMAGE_QUIET_RATE) {
+		log_debug("Window %#010x (%s) is damaged %.0f times per second, "
+		          "fetching its damaged region again",
+		          w->base.id, w->name, rate);
+		w->coarse_damage = false;
+	}
+
+	w->damage_period_start = now;
+	w->damage_period_events = 0;
+	w->damage_period_rects = 0;
+	w->damage_period_pixels = 0;
+}
+
 static inline void repair_win(session_t *ps, struct managed_win *w) {
 	// Only mapped window can receive damages
 	assert(win_is_mapped_in_x(w));
@@ -580,21 +631,60 @@ static inline void repair_win(session_t *ps, struct managed_win *w) {
 	region_t parts;
 	pixman_region32_init(&parts);
 
+	auto now = get_time_ms();
+	if (now - w->damage_period_start >= DAMAGE_RATE_PERIOD) {
+		update_damage_mode(w, now);
+	}
+	w->damage_period_events++;
+
 	if (!w->ever_damaged) {
 		win_extents(w, &parts);
 		set_ignore_cookie(
 		    ps, xcb_damage_subtract(ps->c, w->damage, XCB_NONE, XCB_NONE));
+	} else if (w->coarse_damage) {
+		set_ignore_cookie(
+		    ps, xcb_damage_subtract(ps->c, w->damage, XCB_NONE, XCB_NONE));
+		pixman_region32_copy(&parts, &w->bounding_shape);
+		pixman_region32_translate(&parts, w->g.x, w->g.y);
 	} else {
 		set_ignore_cookie(
 		    ps, xcb_damage_subtract(ps->c, w->damage, XCB_NONE, ps->damaged_region));
 		x_fetch_region(ps->c, ps->damaged_region, &parts);
 		pixman_region32_translate(&parts, w->g.x + w->g.border_width,
 		                          w->g.y + w->g.border_width);
+		w->damage_period_rects += (unsigned int)pixman_region32_n_rects(&parts);
+		w->damage_period_pixels += (double)region_area(&parts);
+	}
+
+	if (ps->backend_data && ps->backend_data->ops->image_damaged) {
+		// `parts` might include the shadow, the backend only looks at the part
+		// inside of the pixmap
+		pixman_region32_translate(&parts, -w->g.x, -w->g.y);
+		pixman_region32_union(&w->pixmap_damage, &w->pixmap_damage, &parts);
+		pixman_region32_translate(&parts, w->g.x, w->g.y);
 	}
 
 	log_trace("Mark window %#010x (%s) as having received damage", w->base.id, w->name);
+	win_stats_add(&w->stats, WIN_STAT_DAMAGE_EVENTS, 1);
+	win_stats_add(&w->stats, WIN_STAT_DAMAGED_PIXELS, (double)region_area(&parts));
 	w->ever_damaged = true;
 	w->pixmap_damaged = true;
+	if (w->resize_pending) {
+		// The client redrew the window after it was resized, the image we
+		// kept drawing has the old size. Rebinding is done once per frame, no
+		// matter how many times the window is resized and damaged meanwhile.
+		w->resize_pending = false;
+		w->reg_ignore_valid = false;
+		win_set_flags(w, WIN_FLAGS_PIXMAP_STALE);
+		ps->pending_updates = true;
+	}
+#ifdef CONFIG_OPENGL
+	if (w->border_col_valid &&
+	    pixman_region32_contains_point(&parts, w->border_sample_x,
+	                                   w->border_sample_y, NULL)) {
+		w->border_col_valid = false;
+	}
+#endif
 
 	// Why care about damage when screen is unredirected?
 	// We will force full-screen repaint on redirection.
@@ -646,6 +736,8 @@ static inline void ev_shape_notify(session_t *ps, xcb_shape_notify_event_t *ev)
 		add_damage(ps, &tmp);
 		pixman_region32_fini(&tmp);
 	}
+	// The shape is not part of the render commands
+	command_list_invalidate(&ps->last_frame_commands);
 	w->reg_ignore_valid = false;
 
 	win_set_flags(w, WIN_FLAGS_SIZE_STALE);
@@ -662,6 +754,9 @@ ev_selection_clear(session_t *ps, xcb_selection_clear_event_t attr_unused *ev) {
 }
 
 void ev_handle(session_t *ps, xcb_generic_event_t *ev) {
+	if (ps->event_recorder) {
+		event_recorder_add(ps->event_recorder, ev);
+	}
 	if ((ev->response_type & 0x7f) != KeymapNotify) {
 		discard_ignore(ps, ev->full_sequence);
 	}
@@ -744,3 +839,19 @@ void ev_handle(session_t *ps, xcb_generic_event_t *ev) {
 		}
 	}
 }
+
+TEST_CASE(region_area) {
+	region_t region;
+	pixman_region32_init(&region);
+	TEST_EQUAL(region_area(&region), 0);
+
+	// Overlapping parts are counted once
+	pixman_region32_union_rect(&region, &region, 0, 0, 10, 10);
+	pixman_region32_union_rect(&region, &region, 5, 5, 10, 10);
+	TEST_EQUAL(region_area(&region), 175);
+
+	// The area of a big region doesn't fit into 32 bits
+	pixman_region32_union_rect(&region, &region, 0, 0, 70000, 70000);
+	TEST_EQUAL(region_area(&region), 4900000000);
+	pixman_region32_fini(&region);
+}
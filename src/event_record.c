@@ -0,0 +1,1212 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (c) Yuxuan Shui <yshuiv7@gmail.com>
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <test.h>
+#include <uthash.h>
+#include <xcb/damage.h>
+#include <xcb/shape.h>
+#include <xcb/xcb.h>
+#include <xcb/xcbext.h>
+
+#include "atom.h"
+#include "common.h"
+#include "compiler.h"
+#include "list.h"
+#include "log.h"
+#include "picom.h"
+#include "utils.h"
+#include "x.h"
+
+#include "event_record.h"
+
+#define EVENT_RECORD_MAGIC "picomEV3"
+/// Longest property value recorded, in 32-bit units. Longer values, like icons, are
+/// cut short, picom doesn't read them.
+#define EVENT_RECORD_MAX_PROPERTY_LENGTH 16384
+
+/// Numbers are in the byte order of the machine the events were recorded on.
+struct event_record_header {
+	char magic[8];
+	xcb_window_t root;
+	/// First event code of the damage extension, which differs between X servers
+	uint8_t damage_event;
+	uint8_t pad[3];
+};
+
+struct event_record {
+	/// Microseconds passed since the previous record
+	uint32_t delay_us;
+	/// The event, as it was sent by the X server. Or, if the response type is 0,
+	/// which is never recorded since errors aren't, one of the `event_record_*`
+	/// structs below.
+	uint8_t data[32];
+};
+
+enum event_record_kind {
+	EVENT_RECORD_WINDOW = 1,
+	EVENT_RECORD_PROPERTY,
+	EVENT_RECORD_SHAPE,
+};
+
+enum {
+	EVENT_RECORD_WINDOW_MAPPED = 1,
+	EVENT_RECORD_WINDOW_OVERRIDE_REDIRECT = 2,
+	EVENT_RECORD_WINDOW_INPUT_ONLY = 4,
+};
+
+/// A window that existed when the recording started, or was just created
+struct event_record_window {
+	uint8_t zero, kind;
+	uint8_t depth, flags;
+	xcb_window_t window, parent;
+	int16_t x, y;
+	uint16_t width, height, border_width;
+};
+
+/// The new value of a property. The property name, the type name and the value
+/// follow the record, in that order. The type and the value are empty if the property
+/// was deleted. Atoms differ between X servers, so the value of an ATOM property is
+/// the names of the atoms instead, each followed by a NUL.
+struct event_record_property {
+	uint8_t zero, kind;
+	uint8_t format, pad;
+	xcb_window_t window;
+	uint16_t name_len, type_len;
+	uint32_t value_len;
+};
+
+/// The new bounding shape of a window, `nrects` xcb_rectangle_t follow the record
+struct event_record_shape {
+	uint8_t zero, kind;
+	bool shaped;
+	uint8_t pad;
+	xcb_window_t window;
+	uint32_t nrects;
+};
+
+static_assert(sizeof(struct event_record_window) <= 32, "window record too big");
+static_assert(sizeof(struct event_record_property) <= 32, "property record too big");
+static_assert(sizeof(struct event_record_shape) <= 32, "shape record too big");
+
+/// Window properties picom reads, besides the ones window rules are matched against.
+/// Only these are recorded, not the titles, or WM_COMMAND, or anything else picom has
+/// no use for.
+static const char *const event_record_atoms[] = {
+    "_NET_WM_WINDOW_OPACITY",
+    "_NET_FRAME_EXTENTS",
+    "WM_STATE",
+    "WM_CLASS",
+    "WM_TRANSIENT_FOR",
+    "WM_WINDOW_ROLE",
+    "WM_CLIENT_LEADER",
+    "_COMPTON_SHADOW",
+    "_NET_WM_WINDOW_TYPE",
+    "_NET_WM_STATE",
+    "_NET_WM_BYPASS_COMPOSITOR",
+};
+
+/// Records, in the format they are stored in
+struct event_record_buf {
+	uint8_t *data;
+	size_t size, capacity;
+};
+
+static void
+event_record_buf_append(struct event_record_buf *buf, const void *data, size_t size) {
+	if (size == 0) {
+		return;
+	}
+	if (buf->size + size > buf->capacity) {
+		buf->capacity = max2(buf->capacity * 2, buf->size + size);
+		buf->data = crealloc(buf->data, buf->capacity);
+	}
+	memcpy(buf->data + buf->size, data, size);
+	buf->size += size;
+}
+
+/// Append a record, filled with `size` bytes of `data`
+static void event_record_buf_add(struct event_record_buf *buf, uint32_t delay_us,
+                                 const void *data, size_t size) {
+	struct event_record record = {.delay_us = delay_us};
+	assert(size <= sizeof(record.data));
+	memcpy(record.data, data, size);
+	event_record_buf_append(buf, &record, sizeof(record));
+}
+
+/// Append a property record. `type` is NULL if the property was deleted.
+static void
+event_record_encode_property(struct event_record_buf *buf, xcb_window_t window,
+                             const char *name, const char *type, uint8_t format,
+                             const void *value, uint32_t value_len) {
+	struct event_record_property record = {
+	    .kind = EVENT_RECORD_PROPERTY,
+	    .window = window,
+	    .name_len = (uint16_t)strlen(name),
+	};
+	if (type) {
+		record.format = format;
+		record.type_len = (uint16_t)strlen(type);
+		record.value_len = value_len;
+	}
+	event_record_buf_add(buf, 0, &record, sizeof(record));
+	event_record_buf_append(buf, name, record.name_len);
+	if (type) {
+		event_record_buf_append(buf, type, record.type_len);
+		event_record_buf_append(buf, value, record.value_len);
+	}
+}
+
+static void event_record_encode_shape(struct event_record_buf *buf, xcb_window_t window,
+                                      bool shaped, const xcb_rectangle_t *rects,
+                                      uint32_t nrects) {
+	struct event_record_shape record = {
+	    .kind = EVENT_RECORD_SHAPE,
+	    .shaped = shaped,
+	    .window = window,
+	    .nrects = shaped ? nrects : 0,
+	};
+	event_record_buf_add(buf, 0, &record, sizeof(record));
+	event_record_buf_append(buf, rects, record.nrects * sizeof(xcb_rectangle_t));
+}
+
+/// A record read back from a recording
+struct event_record_decoded {
+	struct event_record record;
+	/// The data following a property or a shape record. The names aren't NUL
+	/// terminated, and nothing is aligned.
+	const uint8_t *name, *type, *value;
+	const uint8_t *rects;
+};
+
+/// Decode the record at `*pos` in `data`, with the data following it, and move `*pos`
+/// to the next record.
+///
+/// @return false if there are no more records, or the recording is truncated
+static bool event_record_decode(const uint8_t *data, size_t size, size_t *pos,
+                                struct event_record_decoded *out) {
+	*out = (struct event_record_decoded){0};
+	if (size - *pos < sizeof(out->record)) {
+		return false;
+	}
+	memcpy(&out->record, data + *pos, sizeof(out->record));
+	size_t next = *pos + sizeof(out->record);
+	if (out->record.data[0] == 0 && out->record.data[1] == EVENT_RECORD_PROPERTY) {
+		struct event_record_property p;
+		memcpy(&p, out->record.data, sizeof(p));
+		if (size - next < (size_t)p.name_len + p.type_len + p.value_len) {
+			return false;
+		}
+		out->name = data + next;
+		out->type = out->name + p.name_len;
+		out->value = out->type + p.type_len;
+		next += (size_t)p.name_len + p.type_len + p.value_len;
+	} else if (out->record.data[0] == 0 &&
+	           out->record.data[1] == EVENT_RECORD_SHAPE) {
+		struct event_record_shape s;
+		memcpy(&s, out->record.data, sizeof(s));
+		if ((size - next) / sizeof(xcb_rectangle_t) < s.nrects) {
+			return false;
+		}
+		out->rects = data + next;
+		next += s.nrects * sizeof(xcb_rectangle_t);
+	}
+	*pos = next;
+	return true;
+}
+
+/// The name of an atom of the X server being recorded
+struct atom_name {
+	UT_hash_handle hh;
+	xcb_atom_t atom;
+	/// NULL if the atom doesn't exist, or the name hasn't arrived yet
+	char *name;
+	/// Sequence number of the request for the name, 0 once it is answered
+	unsigned int sequence;
+};
+
+enum pending_record_kind {
+	PENDING_EVENT,
+	PENDING_WINDOW,
+	PENDING_PROPERTY,
+	PENDING_SHAPE,
+};
+
+/// A record that can only be written once the replies to its requests arrive. Records
+/// are written in the order they are made, so a record also waits for the records
+/// before it.
+struct pending_record {
+	struct list_node siblings;
+	enum pending_record_kind kind;
+	uint32_t delay_us;
+	/// The event, for PENDING_EVENT
+	uint8_t event[32];
+	xcb_window_t window, parent;
+	xcb_atom_t atom;
+	int nrequests;
+	unsigned int sequences[2];
+	/// NULL if the request failed, e.g. because the window is gone
+	void *replies[2];
+	bool answered[2];
+};
+
+struct event_recorder {
+	char *path;
+	FILE *f;
+	/// The session being recorded, NULL between sessions
+	session_t *ps;
+	/// Atoms of `event_record_atoms`
+	xcb_atom_t atoms[ARR_SIZE(event_record_atoms)];
+	/// When the previous event was recorded
+	struct timespec last;
+	unsigned int nevents;
+	bool started;
+	bool failed;
+	struct list_node pending;
+	/// Names of the atoms met so far, the atoms stay the same across sessions
+	struct atom_name *atom_names;
+	/// Records made but not written yet
+	struct event_record_buf buf;
+};
+
+/// A window created on the replay server in place of a recorded one
+struct stand_in_window {
+	UT_hash_handle hh;
+	/// Id of the recorded window
+	xcb_window_t recorded;
+	xcb_window_t id;
+};
+
+struct event_replayer {
+	char *path;
+	/// The replay has a connection of its own, so the stand-in windows outlive the
+	/// sessions, and the errors its requests cause don't reach picom.
+	xcb_connection_t *c;
+	xcb_window_t root;
+	struct atom *atoms;
+	bool shape_exists;
+	ev_timer timer;
+	/// The session the events are replayed to, NULL between sessions
+	session_t *ps;
+	/// The whole recording
+	uint8_t *data;
+	size_t size, pos;
+	struct event_record_header header;
+	/// The next record to replay, valid if `has_next` is set
+	struct event_record_decoded next;
+	bool has_next;
+	unsigned int nevents;
+	/// Stand-in windows, keyed by the recorded window id
+	struct stand_in_window *windows;
+	/// Colormap for 32-bit stand-in windows, created when first needed
+	xcb_colormap_t argb_colormap;
+};
+
+/// Collect the reply to request `sequence`, or wait for it if `wait` is set.
+///
+/// @return whether the request is answered, `*reply` is NULL if it failed
+static bool event_recorder_reply(xcb_connection_t *c, unsigned int sequence, bool wait,
+                                 void **reply) {
+	xcb_generic_error_t *e = NULL;
+	*reply = NULL;
+	if (wait) {
+		*reply = xcb_wait_for_reply(c, sequence, &e);
+	} else if (!xcb_poll_for_reply(c, sequence, reply, &e)) {
+		return false;
+	}
+	free(e);
+	return true;
+}
+
+/// Find the name of `atom`, asking the X server for it if it's not known yet.
+///
+/// @return whether the name is known, or will never be. `*name` is NULL in the latter
+///         case.
+static bool event_recorder_atom_name(struct event_recorder *r, xcb_atom_t atom,
+                                     bool wait, const char **name) {
+	auto c = r->ps->c;
+	struct atom_name *entry = NULL;
+	HASH_FIND_INT(r->atom_names, &atom, entry);
+	if (!entry) {
+		entry = ccalloc(1, struct atom_name);
+		entry->atom = atom;
+		entry->sequence = xcb_get_atom_name(c, atom).sequence;
+		HASH_ADD_INT(r->atom_names, atom, entry);
+	}
+	if (entry->sequence) {
+		xcb_get_atom_name_reply_t *reply;
+		if (!event_recorder_reply(c, entry->sequence, wait, (void **)&reply)) {
+			return false;
+		}
+		entry->sequence = 0;
+		if (reply) {
+			auto len = (size_t)xcb_get_atom_name_name_length(reply);
+			entry->name = strndup(xcb_get_atom_name_name(reply), len);
+			free(reply);
+		}
+	}
+	*name = entry->name;
+	return true;
+}
+
+static struct pending_record *
+event_recorder_push(struct event_recorder *r, enum pending_record_kind kind,
+                    xcb_window_t window) {
+	auto p = ccalloc(1, struct pending_record);
+	p->kind = kind;
+	p->window = window;
+	list_insert_before(&r->pending, &p->siblings);
+	return p;
+}
+
+static bool event_recorder_is_recorded_atom(struct event_recorder *r, xcb_atom_t atom) {
+	for (size_t i = 0; i < ARR_SIZE(r->atoms); i++) {
+		if (r->atoms[i] == atom) {
+			return true;
+		}
+	}
+	for (latom_t *platom = r->ps->track_atom_lst; platom; platom = platom->next) {
+		if (platom->atom == atom) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/// Request the current value of property `atom` of window `wid`
+static void
+event_recorder_request_property(struct event_recorder *r, xcb_window_t wid,
+                                xcb_atom_t atom) {
+	auto c = r->ps->c;
+	auto p = event_recorder_push(r, PENDING_PROPERTY, wid);
+	p->atom = atom;
+	p->nrequests = 1;
+	p->sequences[0] = xcb_get_property(c, 0, wid, atom, XCB_GET_PROPERTY_TYPE_ANY, 0,
+	                                   EVENT_RECORD_MAX_PROPERTY_LENGTH)
+	                      .sequence;
+}
+
+/// Request the bounding shape of window `wid`
+static void event_recorder_request_shape(struct event_recorder *r, xcb_window_t wid) {
+	auto c = r->ps->c;
+	if (!r->ps->shape_exists) {
+		return;
+	}
+	auto p = event_recorder_push(r, PENDING_SHAPE, wid);
+	p->nrequests = 2;
+	p->sequences[0] = xcb_shape_query_extents(c, wid).sequence;
+	p->sequences[1] =
+	    xcb_shape_get_rectangles(c, wid, XCB_SHAPE_SK_BOUNDING).sequence;
+}
+
+/// Request window `wid`, with the properties picom reads and its shape
+static void event_recorder_request_window(struct event_recorder *r, xcb_window_t wid,
+                                          xcb_window_t parent) {
+	auto c = r->ps->c;
+	auto p = event_recorder_push(r, PENDING_WINDOW, wid);
+	p->parent = parent;
+	p->nrequests = 2;
+	p->sequences[0] = xcb_get_window_attributes(c, wid).sequence;
+	p->sequences[1] = xcb_get_geometry(c, wid).sequence;
+
+	for (size_t i = 0; i < ARR_SIZE(r->atoms); i++) {
+		event_recorder_request_property(r, wid, r->atoms[i]);
+	}
+	for (latom_t *platom = r->ps->track_atom_lst; platom; platom = platom->next) {
+		event_recorder_request_property(r, wid, platom->atom);
+	}
+	event_recorder_request_shape(r, wid);
+}
+
+/// Request window `wid` and all the windows below it in the window tree. Only called
+/// when a session starts, so waiting for the children of the windows is fine.
+static void event_recorder_request_tree(struct event_recorder *r, xcb_window_t wid) {
+	auto ps = r->ps;
+	auto tree = xcb_query_tree_reply(ps->c, xcb_query_tree(ps->c, wid), NULL);
+	if (!tree) {
+		return;
+	}
+	// Children are listed from the bottom of the stack to the top, which is the
+	// order they are created in on replay
+	auto child = xcb_query_tree_children(tree);
+	for (int i = 0; i < xcb_query_tree_children_length(tree); i++) {
+		if (child[i] == ps->reg_win || child[i] == ps->debug_window) {
+			continue;
+		}
+		event_recorder_request_window(r, child[i], wid);
+		event_recorder_request_tree(r, child[i]);
+	}
+	free(tree);
+}
+
+static void event_recorder_write_window(struct event_recorder *r,
+                                        const struct pending_record *p) {
+	const xcb_get_window_attributes_reply_t *attr = p->replies[0];
+	const xcb_get_geometry_reply_t *geom = p->replies[1];
+	if (!attr || !geom) {
+		// The window is already gone
+		return;
+	}
+	struct event_record_window record = {
+	    .kind = EVENT_RECORD_WINDOW,
+	    .depth = geom->depth,
+	    .window = p->window,
+	    .parent = p->parent,
+	    .x = geom->x,
+	    .y = geom->y,
+	    .width = geom->width,
+	    .height = geom->height,
+	    .border_width = geom->border_width,
+	};
+	if (attr->map_state != XCB_MAP_STATE_UNMAPPED) {
+		record.flags |= EVENT_RECORD_WINDOW_MAPPED;
+	}
+	if (attr->override_redirect) {
+		record.flags |= EVENT_RECORD_WINDOW_OVERRIDE_REDIRECT;
+	}
+	if (attr->_class == XCB_WINDOW_CLASS_INPUT_ONLY) {
+		record.flags |= EVENT_RECORD_WINDOW_INPUT_ONLY;
+	}
+	event_record_buf_add(&r->buf, 0, &record, sizeof(record));
+}
+
+/// Write a property record, once the names of the atoms in it are known
+///
+/// @return false if a name hasn't arrived yet
+static bool event_recorder_write_property(struct event_recorder *r,
+                                          const struct pending_record *p, bool wait) {
+	const xcb_get_property_reply_t *prop = p->replies[0];
+	const char *name, *type = NULL;
+	if (!event_recorder_atom_name(r, p->atom, wait, &name)) {
+		return false;
+	}
+	if (prop && prop->type != XCB_NONE &&
+	    !event_recorder_atom_name(r, prop->type, wait, &type)) {
+		return false;
+	}
+	if (!name || (prop && prop->type != XCB_NONE && !type)) {
+		return true;
+	}
+	if (!prop || !type) {
+		event_record_encode_property(&r->buf, p->window, name, NULL, 0, NULL, 0);
+		return true;
+	}
+
+	const void *value = xcb_get_property_value(prop);
+	auto value_len = (uint32_t)xcb_get_property_value_length(prop);
+	if (prop->type != XCB_ATOM_ATOM) {
+		event_record_encode_property(&r->buf, p->window, name, type,
+		                             prop->format, value, value_len);
+		return true;
+	}
+
+	// Request all the names first, so the rest of them arrive together
+	const xcb_atom_t *atoms = value;
+	const uint32_t natoms = prop->format == 32 ? value_len / 4 : 0;
+	bool ready = true;
+	for (uint32_t i = 0; i < natoms; i++) {
+		const char *atom_name;
+		ready = event_recorder_atom_name(r, atoms[i], wait, &atom_name) && ready;
+	}
+	if (!ready) {
+		return false;
+	}
+	struct event_record_buf names = {0};
+	for (uint32_t i = 0; i < natoms; i++) {
+		const char *atom_name;
+		event_recorder_atom_name(r, atoms[i], wait, &atom_name);
+		if (atom_name) {
+			event_record_buf_append(&names, atom_name, strlen(atom_name) + 1);
+		}
+	}
+	event_record_encode_property(&r->buf, p->window, name, type, 32, names.data,
+	                             (uint32_t)names.size);
+	free(names.data);
+	return true;
+}
+
+static void event_recorder_write_shape(struct event_recorder *r,
+                                       const struct pending_record *p) {
+	const xcb_shape_query_extents_reply_t *extents = p->replies[0];
+	const xcb_shape_get_rectangles_reply_t *rects = p->replies[1];
+	if (!extents || !rects) {
+		return;
+	}
+	event_record_encode_shape(
+	    &r->buf, p->window, extents->bounding_shaped,
+	    xcb_shape_get_rectangles_rectangles(rects),
+	    (uint32_t)xcb_shape_get_rectangles_rectangles_length(rects));
+}
+
+/// Write `p` once the replies it needs have arrived, or wait for them if `wait` is set
+///
+/// @return whether `p` is done
+static bool event_recorder_write_pending(struct event_recorder *r,
+                                         struct pending_record *p, bool wait) {
+	for (int i = 0; i < p->nrequests; i++) {
+		if (!p->answered[i]) {
+			if (!event_recorder_reply(r->ps->c, p->sequences[i], wait,
+			                          &p->replies[i])) {
+				return false;
+			}
+			p->answered[i] = true;
+		}
+	}
+
+	switch (p->kind) {
+	case PENDING_EVENT:
+		event_record_buf_add(&r->buf, p->delay_us, p->event, sizeof(p->event));
+		break;
+	case PENDING_WINDOW: event_recorder_write_window(r, p); break;
+	case PENDING_PROPERTY: return event_recorder_write_property(r, p, wait);
+	case PENDING_SHAPE: event_recorder_write_shape(r, p); break;
+	}
+	return true;
+}
+
+/// Write the records that are ready, or all of them if `wait` is set
+static void event_recorder_write(struct event_recorder *r, bool wait) {
+	list_foreach_safe(struct pending_record, p, &r->pending, siblings) {
+		if (!event_recorder_write_pending(r, p, wait)) {
+			break;
+		}
+		list_remove(&p->siblings);
+		for (int i = 0; i < p->nrequests; i++) {
+			free(p->replies[i]);
+		}
+		free(p);
+	}
+
+	if (!r->failed && r->buf.size > 0 &&
+	    fwrite(r->buf.data, r->buf.size, 1, r->f) != 1) {
+		log_error("Failed to record events: %s, stopping the recording",
+		          strerror(errno));
+		r->failed = true;
+	}
+	r->buf.size = 0;
+}
+
+struct event_recorder *event_recorder_new(const char *path) {
+	FILE *f = fopen(path, "wb");
+	if (!f) {
+		log_error("Cannot open %s to record events: %s", path, strerror(errno));
+		return NULL;
+	}
+
+	auto r = ccalloc(1, struct event_recorder);
+	r->path = strdup(path);
+	r->f = f;
+	list_init_head(&r->pending);
+	log_info("Recording events to %s", path);
+	return r;
+}
+
+const char *event_recorder_path(const struct event_recorder *r) {
+	return r->path;
+}
+
+void event_recorder_attach(struct event_recorder *r, session_t *ps) {
+	assert(!r->ps);
+	r->ps = ps;
+	if (!r->started) {
+		struct event_record_header header = {
+		    .root = ps->root,
+		    .damage_event = (uint8_t)ps->damage_event,
+		};
+		memcpy(header.magic, EVENT_RECORD_MAGIC, sizeof(header.magic));
+		event_record_buf_append(&r->buf, &header, sizeof(header));
+		r->started = true;
+	}
+	for (size_t i = 0; i < ARR_SIZE(r->atoms); i++) {
+		r->atoms[i] = get_atom(ps->atoms, event_record_atoms[i]);
+	}
+
+	// Record the windows that exist. After a reset, they are recorded again, they
+	// might have changed while no session was running.
+	event_recorder_request_tree(r, ps->root);
+	event_recorder_request_property(r, ps->root, ps->atoms->a_NET_ACTIVE_WINDOW);
+	event_recorder_write(r, false);
+	r->last = get_time_timespec();
+}
+
+void event_recorder_add(struct event_recorder *r, const xcb_generic_event_t *ev) {
+	if (r->failed || ev->response_type == 0) {
+		// Errors are caused by our own requests, which are made again when the
+		// events are replayed
+		return;
+	}
+
+	auto now = get_time_timespec();
+	int64_t delay = (int64_t)(now.tv_sec - r->last.tv_sec) * 1000000 +
+	                (now.tv_nsec - r->last.tv_nsec) / 1000;
+	r->last = now;
+	auto p = event_recorder_push(r, PENDING_EVENT, XCB_NONE);
+	p->delay_us = (uint32_t)clamp(delay, 0, (int64_t)UINT32_MAX);
+	memcpy(p->event, ev, sizeof(p->event));
+	r->nevents++;
+
+	// The replay needs more than what is in the events to recreate the windows.
+	// Only the requests are sent here, the replies are collected later by
+	// event_recorder_flush, so the events are handled with their usual timing.
+	auto ps = r->ps;
+	int type = ev->response_type & 0x7f;
+	if (type == XCB_CREATE_NOTIFY) {
+		auto cev = (xcb_create_notify_event_t *)ev;
+		event_recorder_request_window(r, cev->window, cev->parent);
+	} else if (type == XCB_PROPERTY_NOTIFY) {
+		auto pev = (xcb_property_notify_event_t *)ev;
+		if (event_recorder_is_recorded_atom(r, pev->atom) ||
+		    (pev->window == ps->root &&
+		     pev->atom == ps->atoms->a_NET_ACTIVE_WINDOW)) {
+			event_recorder_request_property(r, pev->window, pev->atom);
+		}
+	} else if (ps->shape_exists && type == ps->shape_event) {
+		event_recorder_request_shape(
+		    r, ((xcb_shape_notify_event_t *)ev)->affected_window);
+	}
+}
+
+void event_recorder_flush(struct event_recorder *r) {
+	if (!list_is_empty(&r->pending)) {
+		event_recorder_write(r, false);
+	}
+}
+
+void event_recorder_detach(struct event_recorder *r) {
+	event_recorder_write(r, true);
+	fflush(r->f);
+	r->ps = NULL;
+}
+
+void event_recorder_free(struct event_recorder *r) {
+	assert(!r->ps);
+	assert(list_is_empty(&r->pending));
+	if (fclose(r->f) != 0) {
+		log_error("Failed to finish the event recording: %s", strerror(errno));
+	} else {
+		log_info("Recorded %u events", r->nevents);
+	}
+	struct atom_name *entry, *tmp;
+	HASH_ITER(hh, r->atom_names, entry, tmp) {
+		HASH_DEL(r->atom_names, entry);
+		free(entry->name);
+		free(entry);
+	}
+	free(r->buf.data);
+	free(r->path);
+	free(r);
+}
+
+/// Find the stand-in of a recorded window
+static xcb_window_t event_replayer_window(const struct event_replayer *r,
+                                          xcb_window_t recorded) {
+	if (recorded == r->header.root) {
+		return r->root;
+	}
+	struct stand_in_window *w = NULL;
+	HASH_FIND_INT(r->windows, &recorded, w);
+	return w ? w->id : XCB_NONE;
+}
+
+/// Move window `wid` and map or unmap it, to match `record`
+static void event_replayer_update_window(struct event_replayer *r, xcb_window_t wid,
+                                         const struct event_record_window *record) {
+	uint32_t values[] = {
+	    (uint32_t)record->x,          (uint32_t)record->y,
+	    max2(record->width, 1),       max2(record->height, 1),
+	    record->border_width,
+	};
+	xcb_configure_window(r->c, wid,
+	                     XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y |
+	                         XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT |
+	                         XCB_CONFIG_WINDOW_BORDER_WIDTH,
+	                     values);
+	if (record->flags & EVENT_RECORD_WINDOW_MAPPED) {
+		xcb_map_window(r->c, wid);
+	} else {
+		xcb_unmap_window(r->c, wid);
+	}
+}
+
+static void event_replayer_create_window(struct event_replayer *r,
+                                         const struct event_record_window *record) {
+	auto existing = event_replayer_window(r, record->window);
+	if (existing != XCB_NONE) {
+		// Recorded again when a new session started
+		event_replayer_update_window(r, existing, record);
+		return;
+	}
+	auto parent = event_replayer_window(r, record->parent);
+	if (parent == XCB_NONE) {
+		log_debug("Parent %#010x of window %#010x wasn't recorded",
+		          record->parent, record->window);
+		return;
+	}
+
+	auto w = ccalloc(1, struct stand_in_window);
+	w->recorded = record->window;
+	w->id = x_new_id(r->c);
+	HASH_ADD_INT(r->windows, recorded, w);
+
+	// Windows can't be created with a size of 0
+	auto width = (uint16_t)max2(record->width, 1);
+	auto height = (uint16_t)max2(record->height, 1);
+	uint32_t override_redirect =
+	    (record->flags & EVENT_RECORD_WINDOW_OVERRIDE_REDIRECT) != 0;
+	if (record->flags & EVENT_RECORD_WINDOW_INPUT_ONLY) {
+		xcb_create_window(r->c, 0, w->id, parent, record->x, record->y, width,
+		                  height, 0, XCB_WINDOW_CLASS_INPUT_ONLY,
+		                  XCB_COPY_FROM_PARENT, XCB_CW_OVERRIDE_REDIRECT,
+		                  (uint32_t[]){override_redirect});
+	} else {
+		// Give every window a different color, so they can be told apart
+		uint32_t color = 0xff000000 | ((record->window * 2654435761U) >> 8);
+		uint8_t depth = XCB_COPY_FROM_PARENT;
+		xcb_visualid_t visual = XCB_COPY_FROM_PARENT;
+		uint32_t mask = XCB_CW_BACK_PIXEL | XCB_CW_BORDER_PIXEL |
+		                XCB_CW_OVERRIDE_REDIRECT;
+		if (record->depth == 32) {
+			depth = 32;
+			visual =
+			    x_get_visual_for_standard(r->c, XCB_PICT_STANDARD_ARGB_32);
+			if (!r->argb_colormap) {
+				r->argb_colormap = x_new_id(r->c);
+				xcb_create_colormap(r->c, XCB_COLORMAP_ALLOC_NONE,
+				                    r->argb_colormap, r->root, visual);
+			}
+			mask |= XCB_CW_COLORMAP;
+		}
+		xcb_create_window(r->c, depth, w->id, parent, record->x, record->y,
+		                  width, height, record->border_width,
+		                  XCB_WINDOW_CLASS_INPUT_OUTPUT, visual, mask,
+		                  (uint32_t[]){color, color, override_redirect,
+		                               r->argb_colormap});
+	}
+	if (record->flags & EVENT_RECORD_WINDOW_MAPPED) {
+		xcb_map_window(r->c, w->id);
+	}
+}
+
+static void
+event_replayer_destroy_window(struct event_replayer *r, xcb_window_t recorded) {
+	struct stand_in_window *w = NULL;
+	HASH_FIND_INT(r->windows, &recorded, w);
+	if (w) {
+		xcb_destroy_window(r->c, w->id);
+		HASH_DEL(r->windows, w);
+		free(w);
+	}
+}
+
+static void event_replayer_set_property(struct event_replayer *r,
+                                        const struct event_record_decoded *decoded) {
+	struct event_record_property record;
+	memcpy(&record, decoded->record.data, sizeof(record));
+	auto wid = event_replayer_window(r, record.window);
+	if (wid == XCB_NONE || record.name_len == 0) {
+		return;
+	}
+
+	char *name = strndup((const char *)decoded->name, record.name_len);
+	char *type_name = strndup((const char *)decoded->type, record.type_len);
+	auto atom = get_atom(r->atoms, name);
+	auto type = get_atom(r->atoms, type_name);
+	uint32_t *value = NULL;
+	uint32_t length = 0;
+	if (record.type_len == 0) {
+		xcb_delete_property(r->c, wid, atom);
+		goto out;
+	}
+	if (type == XCB_ATOM_PIXMAP) {
+		// Pixmaps of the recorded X server don't exist here
+		goto out;
+	}
+
+	if (type == XCB_ATOM_ATOM) {
+		// Atoms are recorded by their names
+		value = ccalloc(record.value_len + 1, uint32_t);
+		const char *atom_name = (const char *)decoded->value;
+		const char *end = atom_name + record.value_len;
+		while (atom_name < end) {
+			auto len = strnlen(atom_name, (size_t)(end - atom_name));
+			char *value_name = strndup(atom_name, len);
+			value[length++] = get_atom(r->atoms, value_name);
+			free(value_name);
+			atom_name += len + 1;
+		}
+		xcb_change_property(r->c, XCB_PROP_MODE_REPLACE, wid, atom, type, 32,
+		                    length, value);
+		goto out;
+	}
+
+	value = ccalloc(record.value_len / 4 + 1, uint32_t);
+	memcpy(value, decoded->value, record.value_len);
+	if (type == XCB_ATOM_WINDOW && record.format == 32) {
+		for (uint32_t i = 0; i < record.value_len / 4; i++) {
+			value[i] = event_replayer_window(r, value[i]);
+		}
+	}
+	if (record.format == 8 || record.format == 16 || record.format == 32) {
+		length = record.value_len / (record.format / 8U);
+		xcb_change_property(r->c, XCB_PROP_MODE_REPLACE, wid, atom, type,
+		                    record.format, length, value);
+	}
+
+out:
+	free(value);
+	free(name);
+	free(type_name);
+}
+
+static void event_replayer_set_shape(struct event_replayer *r,
+                                     const struct event_record_decoded *decoded) {
+	struct event_record_shape record;
+	memcpy(&record, decoded->record.data, sizeof(record));
+	auto wid = event_replayer_window(r, record.window);
+	if (wid == XCB_NONE || !r->shape_exists) {
+		return;
+	}
+	if (!record.shaped) {
+		xcb_shape_mask(r->c, XCB_SHAPE_SO_SET, XCB_SHAPE_SK_BOUNDING, wid, 0, 0,
+		               XCB_NONE);
+		return;
+	}
+	auto rects = ccalloc(record.nrects + 1, xcb_rectangle_t);
+	memcpy(rects, decoded->rects, record.nrects * sizeof(xcb_rectangle_t));
+	xcb_shape_rectangles(r->c, XCB_SHAPE_SO_SET, XCB_SHAPE_SK_BOUNDING,
+	                     XCB_CLIP_ORDERING_UNSORTED, wid, 0, 0, record.nrects, rects);
+	free(rects);
+}
+
+/// Make the same changes the recorded record describes to the stand-in windows. The X
+/// server then sends picom the events, just like it did when they were recorded.
+static void event_replayer_replay(struct event_replayer *r,
+                                  const struct event_record_decoded *decoded) {
+	auto c = r->c;
+	const uint8_t *data = decoded->record.data;
+	int type = data[0] & 0x7f;
+	if (type == 0) {
+		switch (data[1]) {
+		case EVENT_RECORD_WINDOW: {
+			struct event_record_window record;
+			memcpy(&record, data, sizeof(record));
+			event_replayer_create_window(r, &record);
+			break;
+		}
+		case EVENT_RECORD_PROPERTY:
+			event_replayer_set_property(r, decoded);
+			break;
+		case EVENT_RECORD_SHAPE: event_replayer_set_shape(r, decoded); break;
+		}
+		return;
+	}
+
+	if (r->header.damage_event &&
+	    type == r->header.damage_event + XCB_DAMAGE_NOTIFY) {
+		// Clearing the damaged area to the background color damages it again
+		auto ev = (const xcb_damage_notify_event_t *)data;
+		auto wid = event_replayer_window(r, ev->drawable);
+		if (wid != XCB_NONE && wid != r->root) {
+			xcb_clear_area(c, 0, wid, ev->area.x, ev->area.y,
+			               (uint16_t)max2(ev->area.width, 1),
+			               (uint16_t)max2(ev->area.height, 1));
+		}
+		return;
+	}
+
+	// Creations, property changes and shape changes are replayed from the records
+	// following their events.
+	switch (type) {
+	case XCB_DESTROY_NOTIFY:
+		event_replayer_destroy_window(
+		    r, ((xcb_destroy_notify_event_t *)data)->window);
+		break;
+	case XCB_MAP_NOTIFY: {
+		auto wid =
+		    event_replayer_window(r, ((xcb_map_notify_event_t *)data)->window);
+		if (wid != XCB_NONE && wid != r->root) {
+			xcb_map_window(c, wid);
+		}
+		break;
+	}
+	case XCB_UNMAP_NOTIFY: {
+		auto wid =
+		    event_replayer_window(r, ((xcb_unmap_notify_event_t *)data)->window);
+		if (wid != XCB_NONE && wid != r->root) {
+			xcb_unmap_window(c, wid);
+		}
+		break;
+	}
+	case XCB_REPARENT_NOTIFY: {
+		auto ev = (xcb_reparent_notify_event_t *)data;
+		auto wid = event_replayer_window(r, ev->window);
+		auto parent = event_replayer_window(r, ev->parent);
+		if (wid != XCB_NONE && wid != r->root && parent != XCB_NONE) {
+			xcb_reparent_window(c, wid, parent, ev->x, ev->y);
+		}
+		break;
+	}
+	case XCB_CONFIGURE_NOTIFY: {
+		// Changes of the root window, i.e. of the screen, aren't replayed
+		auto ev = (xcb_configure_notify_event_t *)data;
+		auto wid = event_replayer_window(r, ev->window);
+		if (wid == XCB_NONE || wid == r->root) {
+			break;
+		}
+		uint32_t values[] = {
+		    (uint32_t)ev->x,
+		    (uint32_t)ev->y,
+		    (uint32_t)max2(ev->width, 1),
+		    (uint32_t)max2(ev->height, 1),
+		    ev->border_width,
+		    XCB_NONE,
+		    XCB_STACK_MODE_ABOVE,
+		};
+		uint16_t mask = XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y |
+		                XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT |
+		                XCB_CONFIG_WINDOW_BORDER_WIDTH;
+		if (ev->above_sibling == XCB_NONE) {
+			// The window is at the bottom of the stack. The values are in the
+			// order of the mask bits, so the sibling is skipped.
+			values[5] = XCB_STACK_MODE_BELOW;
+			mask |= XCB_CONFIG_WINDOW_STACK_MODE;
+		} else {
+			auto sibling = event_replayer_window(r, ev->above_sibling);
+			if (sibling != XCB_NONE) {
+				values[5] = sibling;
+				mask |= XCB_CONFIG_WINDOW_SIBLING |
+				        XCB_CONFIG_WINDOW_STACK_MODE;
+			}
+			// Otherwise the window is kept where it is in the stack, it
+			// can't be placed relative to a window that wasn't recorded
+		}
+		xcb_configure_window(c, wid, mask, values);
+		break;
+	}
+	case XCB_CIRCULATE_NOTIFY: {
+		auto ev = (xcb_circulate_notify_event_t *)data;
+		auto wid = event_replayer_window(r, ev->window);
+		if (wid != XCB_NONE && wid != r->root) {
+			uint32_t mode = XCB_STACK_MODE_BELOW;
+			if (ev->place == XCB_PLACE_ON_TOP) {
+				mode = XCB_STACK_MODE_ABOVE;
+			}
+			xcb_configure_window(c, wid, XCB_CONFIG_WINDOW_STACK_MODE, &mode);
+		}
+		break;
+	}
+	default:
+		// Other events, e.g. screen changes, can't be recreated
+		break;
+	}
+}
+
+static bool event_replayer_read(struct event_replayer *r) {
+	return event_record_decode(r->data, r->size, &r->pos, &r->next);
+}
+
+static void event_replayer_callback(EV_P_ ev_timer *w, int revents attr_unused) {
+	auto r = container_of(w, struct event_replayer, timer);
+	// Our requests fail when the windows they are about are gone on the replay
+	// server too, these errors are expected
+	xcb_generic_event_t *ev;
+	while ((ev = xcb_poll_for_event(r->c))) {
+		free(ev);
+	}
+
+	// Replay the records that are due, the timer is set again for the next one
+	do {
+		if (!r->has_next) {
+			log_info("Replayed %u events, quitting", r->nevents);
+			quit(r->ps);
+			return;
+		}
+
+		event_replayer_replay(r, &r->next);
+		if (r->next.record.data[0] != 0) {
+			r->nevents++;
+		}
+		r->has_next = event_replayer_read(r);
+	} while (!r->has_next || r->next.record.delay_us == 0);
+	xcb_flush(r->c);
+
+	ev_timer_set(w, r->next.record.delay_us / 1000000.0, 0);
+	ev_timer_start(EV_A_ w);
+}
+
+/// Read all of `f`
+static uint8_t *read_whole_file(FILE *f, size_t *size) {
+	uint8_t *data = NULL;
+	size_t capacity = 0;
+	*size = 0;
+	do {
+		if (*size == capacity) {
+			capacity = max2(capacity * 2, (size_t)65536);
+			data = crealloc(data, capacity);
+		}
+		*size += fread(data + *size, 1, capacity - *size, f);
+	} while (!feof(f) && !ferror(f));
+	return data;
+}
+
+struct event_replayer *event_replayer_new(const char *path) {
+	FILE *f = fopen(path, "rb");
+	if (!f) {
+		log_error("Cannot open the event recording %s: %s", path,
+		          strerror(errno));
+		return NULL;
+	}
+
+	auto r = ccalloc(1, struct event_replayer);
+	r->data = read_whole_file(f, &r->size);
+	fclose(f);
+	if (r->size < sizeof(r->header)) {
+		goto invalid;
+	}
+	memcpy(&r->header, r->data, sizeof(r->header));
+	if (memcmp(r->header.magic, EVENT_RECORD_MAGIC, sizeof(r->header.magic)) != 0) {
+		goto invalid;
+	}
+	r->pos = sizeof(r->header);
+
+	int screen;
+	r->c = xcb_connect(NULL, &screen);
+	if (xcb_connection_has_error(r->c)) {
+		log_error("Cannot connect to the X server to replay events");
+		xcb_disconnect(r->c);
+		free(r->data);
+		free(r);
+		return NULL;
+	}
+	r->root = x_screen_of_display(r->c, screen)->root;
+	r->atoms = init_atoms(r->c);
+	auto shape = xcb_get_extension_data(r->c, &xcb_shape_id);
+	r->shape_exists = shape && shape->present;
+
+	r->path = strdup(path);
+	r->has_next = event_replayer_read(r);
+	ev_init(&r->timer, event_replayer_callback);
+	log_info("Replaying events from %s", path);
+	return r;
+
+invalid:
+	log_error("%s is not an event recording", path);
+	free(r->data);
+	free(r);
+	return NULL;
+}
+
+const char *event_replayer_path(const struct event_replayer *r) {
+	return r->path;
+}
+
+void event_replayer_attach(struct event_replayer *r, session_t *ps) {
+	assert(!r->ps);
+	r->ps = ps;
+	// Time passed between the sessions isn't made up for
+	ev_timer_set(&r->timer, r->has_next ? r->next.record.delay_us / 1000000.0 : 0, 0);
+	ev_timer_start(ps->loop, &r->timer);
+}
+
+void event_replayer_detach(struct event_replayer *r) {
+	ev_timer_stop(r->ps->loop, &r->timer);
+	r->ps = NULL;
+}
+
+void event_replayer_free(struct event_replayer *r) {
+	assert(!r->ps);
+	// The stand-in windows are destroyed by the X server when we disconnect
+	struct stand_in_window *w, *tmp;
+	HASH_ITER(hh, r->windows, w, tmp) {
+		HASH_DEL(r->windows, w);
+		free(w);
+	}
+	destroy_atoms(r->atoms);
+	xcb_disconnect(r->c);
+	free(r->data);
+	free(r->path);
+	free(r);
+}
+
+TEST_CASE(event_record_round_trip) {
+	struct event_record_buf buf = {0};
+	xcb_map_notify_event_t map = {
+	    .response_type = XCB_MAP_NOTIFY,
+	    .window = 0x1234,
+	};
+	event_record_buf_add(&buf, 1500, &map, sizeof(map));
+	struct event_record_window window = {
+	    .kind = EVENT_RECORD_WINDOW,
+	    .depth = 32,
+	    .flags = EVENT_RECORD_WINDOW_MAPPED,
+	    .window = 0x1234,
+	    .parent = 0x100,
+	    .x = -10,
+	    .width = 640,
+	};
+	event_record_buf_add(&buf, 0, &window, sizeof(window));
+	const char types[] = "_NET_WM_WINDOW_TYPE_DOCK\0_NET_WM_WINDOW_TYPE_NORMAL";
+	event_record_encode_property(&buf, 0x1234, "_NET_WM_WINDOW_TYPE", "ATOM", 32,
+	                             types, sizeof(types));
+	event_record_encode_property(&buf, 0x1234, "WM_CLASS", NULL, 0, NULL, 0);
+	const xcb_rectangle_t rects[] = {{0, 0, 10, 10}, {5, 10, 20, 3}};
+	event_record_encode_shape(&buf, 0x1234, true, rects, 2);
+	event_record_encode_shape(&buf, 0x1234, false, rects, 2);
+
+	size_t pos = 0;
+	struct event_record_decoded decoded;
+	TEST_TRUE(event_record_decode(buf.data, buf.size, &pos, &decoded));
+	TEST_EQUAL(decoded.record.delay_us, 1500);
+	TEST_TRUE(memcmp(decoded.record.data, &map, sizeof(map)) == 0);
+
+	TEST_TRUE(event_record_decode(buf.data, buf.size, &pos, &decoded));
+	struct event_record_window window_out;
+	memcpy(&window_out, decoded.record.data, sizeof(window_out));
+	TEST_EQUAL(decoded.record.delay_us, 0);
+	TEST_TRUE(memcmp(&window_out, &window, sizeof(window)) == 0);
+
+	TEST_TRUE(event_record_decode(buf.data, buf.size, &pos, &decoded));
+	struct event_record_property property;
+	memcpy(&property, decoded.record.data, sizeof(property));
+	TEST_EQUAL(property.kind, EVENT_RECORD_PROPERTY);
+	TEST_EQUAL(property.window, 0x1234);
+	TEST_EQUAL(property.format, 32);
+	TEST_EQUAL(property.name_len, strlen("_NET_WM_WINDOW_TYPE"));
+	TEST_TRUE(memcmp(decoded.name, "_NET_WM_WINDOW_TYPE", property.name_len) == 0);
+	TEST_EQUAL(property.type_len, 4);
+	TEST_TRUE(memcmp(decoded.type, "ATOM", 4) == 0);
+	TEST_EQUAL(property.value_len, sizeof(types));
+	TEST_TRUE(memcmp(decoded.value, types, sizeof(types)) == 0);
+
+	// A deleted property has neither a type nor a value
+	TEST_TRUE(event_record_decode(buf.data, buf.size, &pos, &decoded));
+	memcpy(&property, decoded.record.data, sizeof(property));
+	TEST_EQUAL(property.name_len, strlen("WM_CLASS"));
+	TEST_EQUAL(property.type_len, 0);
+	TEST_EQUAL(property.value_len, 0);
+
+	TEST_TRUE(event_record_decode(buf.data, buf.size, &pos, &decoded));
+	struct event_record_shape shape;
+	memcpy(&shape, decoded.record.data, sizeof(shape));
+	TEST_TRUE(shape.shaped);
+	TEST_EQUAL(shape.nrects, 2);
+	TEST_TRUE(memcmp(decoded.rects, rects, sizeof(rects)) == 0);
+
+	// An unshaped window has no rectangles
+	TEST_TRUE(event_record_decode(buf.data, buf.size, &pos, &decoded));
+	memcpy(&shape, decoded.record.data, sizeof(shape));
+	TEST_TRUE(!shape.shaped);
+	TEST_EQUAL(shape.nrects, 0);
+
+	TEST_EQUAL(pos, buf.size);
+	TEST_TRUE(!event_record_decode(buf.data, buf.size, &pos, &decoded));
+
+	// A record cut short isn't decoded
+	pos = 0;
+	TEST_TRUE(!event_record_decode(buf.data, sizeof(struct event_record) - 1, &pos,
+	                               &decoded));
+	free(buf.data);
+}
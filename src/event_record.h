@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (c) Yuxuan Shui <yshuiv7@gmail.com>
+
+#pragma once
+
+#include <xcb/xcb.h>
+
+typedef struct session session_t;
+struct event_recorder;
+struct event_replayer;
+
+/// Start recording the X events handled by picom into `path`, for --record-events.
+/// Every event is stored with the time passed since the previous one. The existing
+/// windows, and the windows, properties and shapes the events report changes of, are
+/// recorded too, so the windows can be recreated on replay. Only the properties picom
+/// reads are recorded, not e.g. the window titles.
+///
+/// The recorder outlives the sessions, so a reset doesn't start a new recording.
+///
+/// @return the recorder, or NULL if the file can't be written
+struct event_recorder *event_recorder_new(const char *path);
+const char *event_recorder_path(const struct event_recorder *r);
+/// Record the events of session `ps`, starting with the windows that exist
+void event_recorder_attach(struct event_recorder *r, session_t *ps);
+/// Record event `ev`. What else is needed to replay it is requested from the X server,
+/// without waiting for the replies.
+void event_recorder_add(struct event_recorder *r, const xcb_generic_event_t *ev);
+/// Write the records whose replies have arrived, without waiting for the others
+void event_recorder_flush(struct event_recorder *r);
+/// Stop recording the current session, after waiting for all the replies
+void event_recorder_detach(struct event_recorder *r);
+/// Close the recording
+void event_recorder_free(struct event_recorder *r);
+
+/// Start replaying the recording in `path`, for --replay-events. Stand-in windows are
+/// created for the recorded ones, and the recorded changes are made to them with the
+/// timing they were recorded with, so the X server sends picom the recorded events,
+/// and answers its requests about the windows. picom quits when all the events are
+/// replayed.
+///
+/// The replayer outlives the sessions, a reset doesn't restart the replay.
+///
+/// @return the replayer, or NULL if the file isn't a valid recording
+struct event_replayer *event_replayer_new(const char *path);
+const char *event_replayer_path(const struct event_replayer *r);
+/// Replay the events to session `ps`
+void event_replayer_attach(struct event_replayer *r, session_t *ps);
+/// Pause the replay until the next session
+void event_replayer_detach(struct event_replayer *r);
+void event_replayer_free(struct event_replayer *r);
@@ -1,5 +1,9 @@
 #include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
 #include <stdarg.h>
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -20,12 +24,65 @@
 
 thread_local struct log *tls_logger;
 
+#ifdef UNIT_TEST
+/// Tests run before main(), give them a logger, so the code they test can log
+static void log_unittest_setup(void) {
+	log_init_tls();
+}
+void (*test_h_unittest_setup)(void) = log_unittest_setup;
+#endif
+
 struct log_target;
 
+/// Number of records in the ring buffer of an asynchronous logger
+#define LOG_RING_SIZE 256
+/// Messages up to this long (including the NUL) are stored in the ring buffer itself
+#define LOG_RECORD_MSG_SIZE 480
+/// Number of records written out when picom crashes
+#define LOG_CRASH_DUMP_RECORDS 32
+
+/// A log message whose timestamp hasn't been formatted yet
+struct log_record {
+	struct timespec ts;
+	/// Name of the function that logged the message. Always a string literal
+	const char *func;
+	int level;
+	/// Length of the message, not including the NUL
+	int len;
+	/// The message, if it's too long for `msg`. Freed by the writer.
+	char *long_msg;
+	char msg[LOG_RECORD_MSG_SIZE];
+};
+
+/// Single producer, single consumer ring buffer of log records. The producer is the
+/// thread owning the logger, the consumer is the writer thread. Each side only
+/// writes to its own index, so neither needs a lock.
+struct log_ring {
+	struct log_record records[LOG_RING_SIZE];
+	/// Number of records ever added, only written by the producer
+	atomic_uint head;
+	/// Number of records ever written out, only written by the consumer
+	atomic_uint tail;
+	/// Number of records dropped because the ring was full
+	atomic_uint dropped;
+
+	pthread_t writer;
+	/// Protects `quit`, and is used with `wakeup` to put the writer to sleep
+	pthread_mutex_t lock;
+	pthread_cond_t wakeup;
+	bool quit;
+};
+
 struct log {
 	struct log_target *head;
+	/// Protects the list of targets against the writer thread
+	pthread_mutex_t targets_lock;
 
 	int log_level;
+	/// Non-NULL if messages are written out by a writer thread
+	struct log_ring *ring;
+	/// Whether any target has `synchronous` set
+	bool has_synchronous_targets;
 };
 
 struct log_target {
@@ -41,6 +98,13 @@ struct log_ops {
 	/// Additional strings to print around the log_level string
 	const char *(*colorize_begin)(enum log_level);
 	const char *(*colorize_end)(enum log_level);
+
+	/// File descriptor the target writes to, used to dump the last messages when
+	/// picom crashes. Optional.
+	int (*fd)(struct log_target *);
+	/// Whether the target has to be written to from the thread that logged the
+	/// message, e.g. because it needs the OpenGL context of that thread.
+	bool synchronous;
 };
 
 /// Fallback writev for targets don't implement it
@@ -55,14 +119,18 @@ log_default_writev(struct log_target *tgt, const struct iovec *vec, int vcnt) {
 		// Nothing to write
 		return;
 	}
-	char *buf = ccalloc(total, char);
+	// Most log lines fit on the stack
+	char stack_buf[1024];
+	char *buf = total <= sizeof(stack_buf) ? stack_buf : ccalloc(total, char);
 	total = 0;
 	for (int i = 0; i < vcnt; i++) {
 		memcpy(buf + total, vec[i].iov_base, vec[i].iov_len);
 		total += vec[i].iov_len;
 	}
 	tgt->ops->write(tgt, buf, total);
-	free(buf);
+	if (buf != stack_buf) {
+		free(buf);
+	}
 }
 
 static attr_const const char *log_level_to_string(enum log_level level) {
@@ -95,18 +163,25 @@ struct log *log_new(void) {
 	auto ret = cmalloc(struct log);
 	ret->log_level = LOG_LEVEL_WARN;
 	ret->head = NULL;
+	ret->ring = NULL;
+	ret->has_synchronous_targets = false;
+	pthread_mutex_init(&ret->targets_lock, NULL);
 	return ret;
 }
 
 void log_add_target(struct log *l, struct log_target *tgt) {
 	assert(tgt->ops->writev);
+	pthread_mutex_lock(&l->targets_lock);
 	tgt->next = l->head;
 	l->head = tgt;
+	l->has_synchronous_targets |= tgt->ops->synchronous;
+	pthread_mutex_unlock(&l->targets_lock);
 }
 
 /// Remove a previously added log target for a log struct, and destroy it. If the log
 /// target was never added, nothing happens.
 void log_remove_target(struct log *l, struct log_target *tgt) {
+	pthread_mutex_lock(&l->targets_lock);
 	struct log_target *now = l->head, **prev = &l->head;
 	while (now) {
 		if (now == tgt) {
@@ -117,10 +192,17 @@ void log_remove_target(struct log *l, struct log_target *tgt) {
 		prev = &now->next;
 		now = now->next;
 	}
+	l->has_synchronous_targets = false;
+	for (now = l->head; now; now = now->next) {
+		l->has_synchronous_targets |= now->ops->synchronous;
+	}
+	pthread_mutex_unlock(&l->targets_lock);
 }
 
 /// Destroy a log struct and every log target added to it
 void log_destroy(struct log *l) {
+	log_stop_async(l);
+
 	// free all tgt
 	struct log_target *head = l->head;
 	while (head) {
@@ -128,6 +210,7 @@ void log_destroy(struct log *l) {
 		head->ops->destroy(head);
 		head = next;
 	}
+	pthread_mutex_destroy(&l->targets_lock);
 	free(l);
 }
 
@@ -140,75 +223,319 @@ enum log_level log_get_level(const struct log *l) {
 	return l->log_level;
 }
 
-attr_printf(4, 5) void log_printf(struct log *l, int level, const char *func,
-                                  const char *fmt, ...) {
-	assert(level <= LOG_LEVEL_FATAL && level >= 0);
-	if (level < l->log_level)
-		return;
-
-	char *buf = NULL;
-	va_list args;
-
-	va_start(args, fmt);
-	int blen = vasprintf(&buf, fmt, args);
-	va_end(args);
-
-	if (blen < 0 || !buf) {
-		free(buf);
-		return;
-	}
+enum log_target_filter {
+	LOG_TARGETS_ALL,
+	/// Only targets that must be written to by the thread that logged the message
+	LOG_TARGETS_SYNCHRONOUS,
+	LOG_TARGETS_ASYNCHRONOUS,
+};
 
-	struct timespec ts;
-	timespec_get(&ts, TIME_UTC);
+/// Format a log record and write it to the targets of `l` selected by `filter`.
+static void log_write_record(struct log *l, const struct log_record *rec,
+                             enum log_target_filter filter) {
+	const char *msg = rec->long_msg ? rec->long_msg : rec->msg;
 	struct tm now;
-	localtime_r(&ts.tv_sec, &now);
+	localtime_r(&rec->ts.tv_sec, &now);
 	char time_buf[100];
-	strftime(time_buf, sizeof time_buf, "%x %T", &now);
+	size_t tlen = strftime(time_buf, sizeof time_buf, "%x %T", &now);
+	tlen += (size_t)snprintf(time_buf + tlen, sizeof time_buf - tlen, ".%03ld",
+	                         rec->ts.tv_nsec / 1000000);
+	tlen = min2(tlen, sizeof time_buf - 1);
 
-	char *time = NULL;
-	int tlen = asprintf(&time, "%s.%03ld", time_buf, ts.tv_nsec / 1000000);
-	if (tlen < 0 || !time) {
-		free(buf);
-		free(time);
-		return;
-	}
-
-	const char *log_level_str = log_level_to_string(level);
+	const char *log_level_str = log_level_to_string(rec->level);
 	size_t llen = strlen(log_level_str);
-	size_t flen = strlen(func);
+	size_t flen = strlen(rec->func);
 
+	pthread_mutex_lock(&l->targets_lock);
 	struct log_target *head = l->head;
-	while (head) {
+	for (; head; head = head->next) {
+		if ((filter == LOG_TARGETS_SYNCHRONOUS && !head->ops->synchronous) ||
+		    (filter == LOG_TARGETS_ASYNCHRONOUS && head->ops->synchronous)) {
+			continue;
+		}
+
 		const char *p = "", *s = "";
 		size_t plen = 0, slen = 0;
 
 		if (head->ops->colorize_begin) {
 			// construct target specific prefix
-			p = head->ops->colorize_begin(level);
+			p = head->ops->colorize_begin(rec->level);
 			plen = strlen(p);
 			if (head->ops->colorize_end) {
-				s = head->ops->colorize_end(level);
+				s = head->ops->colorize_end(rec->level);
 				slen = strlen(s);
 			}
 		}
 		head->ops->writev(
 		    head,
 		    (struct iovec[]){{.iov_base = "[ ", .iov_len = 2},
-		                     {.iov_base = time, .iov_len = (size_t)tlen},
+		                     {.iov_base = time_buf, .iov_len = tlen},
 		                     {.iov_base = " ", .iov_len = 1},
-		                     {.iov_base = (void *)func, .iov_len = flen},
+		                     {.iov_base = (void *)rec->func, .iov_len = flen},
 		                     {.iov_base = " ", .iov_len = 1},
 		                     {.iov_base = (void *)p, .iov_len = plen},
 		                     {.iov_base = (void *)log_level_str, .iov_len = llen},
 		                     {.iov_base = (void *)s, .iov_len = slen},
 		                     {.iov_base = " ] ", .iov_len = 3},
-		                     {.iov_base = buf, .iov_len = (size_t)blen},
+		                     {.iov_base = (void *)msg,
+		                      .iov_len = (size_t)rec->len},
 		                     {.iov_base = "\n", .iov_len = 1}},
 		    11);
-		head = head->next;
 	}
-	free(time);
-	free(buf);
+	pthread_mutex_unlock(&l->targets_lock);
+}
+
+/// Format the message into `rec`. Only messages that don't fit in the record itself
+/// need an allocation.
+static bool attr_printf(3, 0)
+    log_record_format(struct log_record *rec, int level, const char *fmt, va_list args) {
+	va_list args2;
+	va_copy(args2, args);
+	int len = vsnprintf(rec->msg, sizeof(rec->msg), fmt, args);
+	rec->long_msg = NULL;
+	if (len >= (int)sizeof(rec->msg) && vasprintf(&rec->long_msg, fmt, args2) < 0) {
+		rec->long_msg = NULL;
+		// Keep the truncated message
+		len = (int)sizeof(rec->msg) - 1;
+	}
+	va_end(args2);
+	if (len < 0) {
+		return false;
+	}
+	rec->len = len;
+	rec->level = level;
+	timespec_get(&rec->ts, TIME_UTC);
+	return true;
+}
+
+attr_printf(4, 5) void log_printf(struct log *l, int level, const char *func,
+                                  const char *fmt, ...) {
+	assert(level <= LOG_LEVEL_FATAL && level >= 0);
+	if (level < l->log_level)
+		return;
+
+	va_list args;
+	auto ring = l->ring;
+	if (!ring) {
+		struct log_record rec = {.func = func};
+		va_start(args, fmt);
+		bool ok = log_record_format(&rec, level, fmt, args);
+		va_end(args);
+		if (ok) {
+			log_write_record(l, &rec, LOG_TARGETS_ALL);
+		}
+		free(rec.long_msg);
+		return;
+	}
+
+	unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+	while (head - tail == LOG_RING_SIZE) {
+		if (level < LOG_LEVEL_WARN) {
+			// Debugging messages are not worth stalling for
+			atomic_fetch_add_explicit(&ring->dropped, 1,
+			                          memory_order_relaxed);
+			return;
+		}
+		pthread_cond_signal(&ring->wakeup);
+		sched_yield();
+		tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+	}
+
+	auto rec = &ring->records[head % LOG_RING_SIZE];
+	rec->func = func;
+	va_start(args, fmt);
+	bool ok = log_record_format(rec, level, fmt, args);
+	va_end(args);
+	if (!ok) {
+		return;
+	}
+	if (unlikely(l->has_synchronous_targets)) {
+		log_write_record(l, rec, LOG_TARGETS_SYNCHRONOUS);
+	}
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+	// The writer wakes up periodically anyway, only wake it up early when the
+	// message is important, or the ring is filling up.
+	if (level >= LOG_LEVEL_WARN || head + 1 - tail >= LOG_RING_SIZE / 2) {
+		pthread_cond_signal(&ring->wakeup);
+	}
+}
+
+/// Write out all the records in the ring. Returns whether there were any.
+static bool log_ring_drain(struct log *l) {
+	auto ring = l->ring;
+	unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	unsigned int head = atomic_load_explicit(&ring->head, memory_order_acquire);
+	if (head == tail) {
+		return false;
+	}
+
+	unsigned int dropped =
+	    atomic_exchange_explicit(&ring->dropped, 0, memory_order_relaxed);
+	if (dropped) {
+		struct log_record rec = {.func = __func__, .level = LOG_LEVEL_WARN};
+		rec.len = snprintf(rec.msg, sizeof(rec.msg),
+		                   "%u log messages were dropped", dropped);
+		timespec_get(&rec.ts, TIME_UTC);
+		log_write_record(l, &rec, LOG_TARGETS_ASYNCHRONOUS);
+	}
+	for (; tail != head; tail++) {
+		auto rec = &ring->records[tail % LOG_RING_SIZE];
+		log_write_record(l, rec, LOG_TARGETS_ASYNCHRONOUS);
+		free(rec->long_msg);
+		rec->long_msg = NULL;
+		atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+	}
+	return true;
+}
+
+static void *log_writer_thread(void *arg) {
+	struct log *l = arg;
+	auto ring = l->ring;
+	while (true) {
+		if (log_ring_drain(l)) {
+			continue;
+		}
+		pthread_mutex_lock(&ring->lock);
+		if (ring->quit) {
+			pthread_mutex_unlock(&ring->lock);
+			break;
+		}
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += 50 * 1000000;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+		pthread_cond_timedwait(&ring->wakeup, &ring->lock, &deadline);
+		pthread_mutex_unlock(&ring->lock);
+	}
+	// Write out whatever was logged before we were asked to quit
+	log_ring_drain(l);
+	return NULL;
+}
+
+/// The logger with a writer thread. Its messages are dumped when picom crashes, and
+/// written out when picom exits without destroying it.
+static struct log *async_logger;
+static const int crash_signals[] = {SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT};
+
+/// Write `str` to `fd`, from a signal handler
+static void crash_write(int fd, const char *str, size_t len) {
+	while (len > 0) {
+		auto ret = write(fd, str, len);
+		if (ret <= 0) {
+			return;
+		}
+		str += ret;
+		len -= (size_t)ret;
+	}
+}
+
+static void log_atexit(void) {
+	if (async_logger) {
+		log_stop_async(async_logger);
+	}
+}
+
+static void log_crash_handler(int sig) {
+	auto l = async_logger;
+	auto ring = l ? l->ring : NULL;
+	if (ring) {
+		// Only async-signal-safe functions from here on. The records are
+		// written without timestamps, as formatting them isn't.
+		static const char header[] = "picom crashed, last log messages:\n";
+		unsigned int head =
+		    atomic_load_explicit(&ring->head, memory_order_acquire);
+		unsigned int first =
+		    head > LOG_CRASH_DUMP_RECORDS ? head - LOG_CRASH_DUMP_RECORDS : 0;
+		for (auto tgt = l->head; tgt; tgt = tgt->next) {
+			int fd = tgt->ops->fd ? tgt->ops->fd(tgt) : -1;
+			if (fd < 0) {
+				continue;
+			}
+			crash_write(fd, header, sizeof(header) - 1);
+			for (unsigned int i = first; i != head; i++) {
+				auto rec = &ring->records[i % LOG_RING_SIZE];
+				const char *level = log_level_to_string(rec->level);
+				crash_write(fd, "[ ", 2);
+				crash_write(fd, rec->func, strlen(rec->func));
+				crash_write(fd, " ", 1);
+				crash_write(fd, level, strlen(level));
+				crash_write(fd, " ] ", 3);
+				crash_write(fd, rec->msg,
+				            strnlen(rec->msg, sizeof(rec->msg)));
+				crash_write(fd, "\n", 1);
+			}
+		}
+	}
+	// The handler was installed with SA_RESETHAND, so this invokes the default
+	// action
+	raise(sig);
+}
+
+void log_start_async(struct log *l) {
+	if (l->ring) {
+		return;
+	}
+	auto ring = ccalloc(1, struct log_ring);
+	pthread_mutex_init(&ring->lock, NULL);
+	pthread_cond_init(&ring->wakeup, NULL);
+	l->ring = ring;
+	if (pthread_create(&ring->writer, NULL, log_writer_thread, l) != 0) {
+		l->ring = NULL;
+		pthread_cond_destroy(&ring->wakeup);
+		pthread_mutex_destroy(&ring->lock);
+		free(ring);
+		log_printf(l, LOG_LEVEL_WARN, __func__,
+		           "Failed to start the log writer thread, logging "
+		           "synchronously.");
+		return;
+	}
+
+	static bool atexit_registered = false;
+	if (!atexit_registered) {
+		atexit(log_atexit);
+		atexit_registered = true;
+	}
+
+	async_logger = l;
+	struct sigaction sa = {
+	    .sa_handler = log_crash_handler,
+	    .sa_flags = (int)SA_RESETHAND,
+	};
+	sigemptyset(&sa.sa_mask);
+	for (size_t i = 0; i < ARR_SIZE(crash_signals); i++) {
+		sigaction(crash_signals[i], &sa, NULL);
+	}
+}
+
+void log_stop_async(struct log *l) {
+	auto ring = l->ring;
+	if (!ring) {
+		return;
+	}
+
+	pthread_mutex_lock(&ring->lock);
+	ring->quit = true;
+	pthread_cond_signal(&ring->wakeup);
+	pthread_mutex_unlock(&ring->lock);
+	pthread_join(ring->writer, NULL);
+
+	if (async_logger == l) {
+		async_logger = NULL;
+		struct sigaction sa = {.sa_handler = SIG_DFL};
+		sigemptyset(&sa.sa_mask);
+		for (size_t i = 0; i < ARR_SIZE(crash_signals); i++) {
+			sigaction(crash_signals[i], &sa, NULL);
+		}
+	}
+	l->ring = NULL;
+	pthread_cond_destroy(&ring->wakeup);
+	pthread_mutex_destroy(&ring->lock);
+	free(ring);
 }
 
 /// A trivial deinitializer that simply frees the memory
@@ -283,10 +610,16 @@ static const char *terminal_colorize_end(enum log_level level attr_unused) {
 }
 #undef PREFIX
 
+static int file_logger_fd(struct log_target *tgt) {
+	auto f = (struct file_logger *)tgt;
+	return fileno(f->f);
+}
+
 static const struct log_ops file_logger_ops = {
     .write = file_logger_write,
     .writev = file_logger_writev,
     .destroy = file_logger_destroy,
+    .fd = file_logger_fd,
 };
 
 struct log_target *file_logger_new(const char *filename) {
@@ -350,6 +683,8 @@ static const struct log_ops gl_string_marker_logger_ops = {
     .write = gl_string_marker_logger_write,
     .writev = log_default_writev,
     .destroy = logger_trivial_destroy,
+    // Needs the OpenGL context of the rendering thread
+    .synchronous = true,
 };
 
 struct log_target *gl_string_marker_logger_new(void) {
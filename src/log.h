@@ -55,6 +55,19 @@ attr_pure enum log_level string_to_log_level(const char *);
 /// Remove a previously added log target for a log struct, and destroy it. If the log
 /// target was never added, nothing happens.
 void log_remove_target(struct log *l, struct log_target *tgt);
+/// Hand messages over to a writer thread, instead of writing them out in
+/// `log_printf`. The message is still formatted by the caller, but the timestamp
+/// formatting and the writes to the log targets happen in the background.
+///
+/// Messages are kept in a ring buffer, and the last few of them are written to the
+/// log files if picom crashes. Debug messages are dropped when the writer can't
+/// keep up, more important messages wait for space in the ring buffer.
+///
+/// Only the thread that created the logger may log to it while this is in effect.
+attr_nonnull_all void log_start_async(struct log *l);
+/// Write out all pending messages, stop the writer thread and go back to writing
+/// messages out synchronously.
+attr_nonnull_all void log_stop_async(struct log *l);
 
 extern thread_local struct log *tls_logger;
 
@@ -82,6 +95,16 @@ static inline attr_pure enum log_level log_get_level_tls(void) {
 	return log_get_level(tls_logger);
 }
 
+static inline void log_start_async_tls(void) {
+	assert(tls_logger);
+	log_start_async(tls_logger);
+}
+
+static inline void log_stop_async_tls(void) {
+	assert(tls_logger);
+	log_stop_async(tls_logger);
+}
+
 static inline void log_deinit_tls(void) {
 	assert(tls_logger);
 	log_destroy(tls_logger);
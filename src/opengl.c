@@ -190,6 +190,16 @@ bool glx_init(session_t *ps, bool need_render) {
 		psglx->has_texture_non_power_of_two =
 		    gl_has_extension("GL_ARB_texture_non_power_of_two");
 
+	// Fences are core since OpenGL 3.2, pixel buffer objects since 2.1
+	if (need_render) {
+		int major = 0, minor = 0;
+		sscanf((const char *)glGetString(GL_VERSION), "%d.%d", &major, &minor);
+		const int version = major * 10 + minor;
+		psglx->has_async_readback =
+		    (version >= 32 || gl_has_extension("GL_ARB_sync")) &&
+		    (version >= 21 || gl_has_extension("GL_ARB_pixel_buffer_object"));
+	}
+
 	// Render preparations
 	if (need_render) {
 		glx_on_root_change(ps);
@@ -1622,9 +1632,9 @@ glx_conv_blur_dst_end:
 // I tried looking for a notify event for XCB_CW_BORDER_PIXEL (in xcb_create_window())
 // or a way to get the pixels from xcb_render_picture_t but the documentation for
 // the xcb_xrender extension is literaly non existent...
-bool glx_read_border_pixel(struct managed_win *w, int root_height, int x, int y,
-						int width attr_unused, int height, int cr, float *ppixel)
-{
+bool glx_read_border_pixel(struct managed_win *w, bool async, int root_height, int x,
+                           int y, int width attr_unused, int height, int cr,
+                           float *ppixel) {
 	if (!ppixel) return false;
 
 	// First try bottom left corner past the
@@ -1644,20 +1654,63 @@ bool glx_read_border_pixel(struct managed_win *w, int root_height, int x, int y,
 	}
 
 	// bottom left corner is out of bounds
-	// use top border line instead
-	if (openglx < 0 || opengly < 0) {
+	// clamp it to the screen instead
+	const int read_x = openglx < 0 ? 0 : openglx;
+	const int read_y = opengly < 0 ? 0 : opengly;
+
+	// Reading the pixel back right away would stall until the GPU has rendered
+	// everything before it. So it's read into a pixel buffer instead, and picked up
+	// in a later frame, once the GPU is done. The previous color is used until then.
+	if (w->border_fence) {
+		auto status = glClientWaitSync(w->border_fence, 0, 0);
+		if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+			glDeleteSync(w->border_fence);
+			w->border_fence = NULL;
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, w->border_pbo);
+			glGetBufferSubData(GL_PIXEL_PACK_BUFFER, 0, sizeof(float[4]),
+			                   ppixel);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		}
+	}
 
-		//log_warn("OUT OF BOUNDS: xy(%d, %d), glxy(%d %d) wh(%d %d), border_col(%.2f, %.2f, %.2f, %.2f)",
-		//	x, y, openglx, opengly, width, height,
-		//	(float)w->border_col[0], (float)w->border_col[1], (float)w->border_col[2], (float)w->border_col[3]);
+	// The sampled color stays valid until the pixel is damaged (see repair_win), or
+	// the window is moved or changes opacity.
+	const int sample_x = read_x, sample_y = root_height - 1 - read_y;
+	if (sample_x != w->border_sample_x || sample_y != w->border_sample_y ||
+	    w->opacity != w->border_sample_opacity) {
+		w->border_col_valid = false;
+	}
+	if (w->border_col_valid || w->border_fence) {
+		return true;
+	}
 
-		// Reset the color so the shader doesn't use it
-		w->border_col[0] = w->border_col[1] = w->border_col[2] = w->border_col[3] = -1.0;
+	if (!async) {
+		// Without fences and pixel buffers, the pixel has to be read right away
+		glReadPixels(read_x, read_y, 1, 1, GL_RGBA, GL_FLOAT, ppixel);
+		w->border_col_valid = true;
+		w->border_sample_x = sample_x;
+		w->border_sample_y = sample_y;
+		w->border_sample_opacity = w->opacity;
+		gl_check_err();
+		return true;
 	}
 
+	if (!w->border_pbo) {
+		glGenBuffers(1, &w->border_pbo);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, w->border_pbo);
+		glBufferData(GL_PIXEL_PACK_BUFFER, sizeof(float[4]), NULL,
+		             GL_STREAM_READ);
+	} else {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, w->border_pbo);
+	}
 	// Invert Y-axis so we can query border color from texture (0,0)
-	glReadPixels((openglx < 0) ? 0 : openglx, (opengly < 0) ? 0 : opengly, 1, 1,
-				GL_RGBA, GL_FLOAT, (void*)&w->border_col[0]);
+	glReadPixels(read_x, read_y, 1, 1, GL_RGBA, GL_FLOAT, NULL);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	w->border_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	w->border_col_valid = true;
+	w->border_sample_x = sample_x;
+	w->border_sample_y = sample_y;
+	w->border_sample_opacity = w->opacity;
 
 	//log_warn("xy(%d, %d), glxy(%d %d) wh(%d %d), border_col(%.2f, %.2f, %.2f, %.2f)",
 	//	x, y, openglx, opengly, width, height,
@@ -1679,7 +1732,9 @@ bool glx_round_corners_dst(session_t *ps, struct managed_win *w, const glx_textu
 	// w->focused);
 
 	if (w->g.border_width >= 1 || w->border_width > 0) {
-		glx_read_border_pixel(w, ps->root_height, dx, dy, width, height, w->corner_radius, &w->border_col[0]);
+		glx_read_border_pixel(w, ps->psglx->has_async_readback, ps->root_height,
+		                      dx, dy, width, height, w->corner_radius,
+		                      &w->border_col[0]);
 	}
 
 	int mdx = dx, mdy = dy, mwidth = width, mheight = height;
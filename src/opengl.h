@@ -80,6 +80,9 @@ typedef struct glx_session {
 	GLXContext context;
 	/// Whether we have GL_ARB_texture_non_power_of_two.
 	bool has_texture_non_power_of_two;
+	/// Whether we have fences and pixel buffer objects, to read pixels back without
+	/// waiting for the GPU.
+	bool has_async_readback;
 	/// Current GLX Z value.
 	int z;
 	/// Cached blur textures for every pass
@@ -260,5 +263,14 @@ static inline void free_win_res_glx(session_t *ps, struct managed_win *w) {
 	free_glx_bc(ps, &w->glx_blur_cache);
 	free_glx_bc(ps, &w->glx_round_cache);
 	free_texture(ps, &w->glx_texture_bg);
+	if (w->border_fence) {
+		glDeleteSync(w->border_fence);
+		w->border_fence = NULL;
+	}
+	if (w->border_pbo) {
+		glDeleteBuffers(1, &w->border_pbo);
+		w->border_pbo = 0;
+	}
+	w->border_col_valid = false;
 #endif
 }
@@ -295,8 +295,8 @@ static void usage(const char *argv0, int ret) {
 	    "  screen.\n"
 	    "\n"
 	    "--backend backend\n"
-	    "  Choose backend. Possible choices are xrender, glx, and\n"
-	    "  xr_glx_hybrid."
+	    "  Choose backend. Possible choices are xrender, glx, xr_glx_hybrid,\n"
+	    "  and pixman (experimental backends only)."
 #ifndef CONFIG_OPENGL
 	    " (GLX BACKENDS DISABLED AT COMPILE TIME)"
 #endif
@@ -312,6 +312,15 @@ static void usage(const char *argv0, int ret) {
 	    "  known to break things on some drivers (LLVMpipe, xf86-video-intel,\n"
 	    "  etc.).\n"
 	    "\n"
+	    "--glx-texture-pool-size megabytes\n"
+	    "  GLX backend: Keep released textures up to this size for reuse,\n"
+	    "  instead of allocating new ones. 0 disables this. (default: 64)\n"
+	    "\n"
+	    "--image-memory-budget megabytes\n"
+	    "  Release the images of windows that are covered or off screen, least\n"
+	    "  recently seen first, once the images of all windows use more memory\n"
+	    "  than this. 0 means no limit. (experimental backends only)\n"
+	    "\n"
 	    "--no-use-damage\n"
 	    "  Disable the use of damage information. This cause the whole screen to\n"
 	    "  be redrawn everytime, instead of the part of the screen that has\n"
@@ -348,6 +357,23 @@ static void usage(const char *argv0, int ret) {
 	    "  Render into a separate window, and don't take over the screen. Useful\n"
 	    "  when you want to attach a debugger to picom\n"
 	    "\n"
+	    "--window-stats-interval seconds\n"
+	    "  Log the windows that cost the most to composite, and what they cost,\n"
+	    "  every this many seconds.\n"
+	    "\n"
+	    "--startup-profile\n"
+	    "  Print the time spent on each step of the startup, up to the first\n"
+	    "  rendered frame.\n"
+	    "\n"
+	    "--record-events file\n"
+	    "  Record the X events picom handles, and when they arrive, into the\n"
+	    "  file, for reproducing performance problems with --replay-events.\n"
+	    "  Window titles are not recorded.\n"
+	    "\n"
+	    "--replay-events file\n"
+	    "  Recreate the windows recorded with --record-events, make the\n"
+	    "  recorded changes to them with the same timing, and quit when done.\n"
+	    "\n"
 	    "--no-ewmh-fullscreen\n"
 	    "  Do not use EWMH to detect fullscreen windows. Reverts to checking\n"
 	    "  if a window is fullscreen based only on its size and coordinates.\n"
@@ -459,11 +485,17 @@ static const struct option longopts[] = {
     {"round-borders", required_argument, NULL, 342},
     {"round-borders-exclude", required_argument, NULL, 343},
     {"round-borders-rule", required_argument, NULL, 344},
+    {"window-stats-interval", required_argument, NULL, 345},
+    {"glx-texture-pool-size", required_argument, NULL, 346},
+    {"image-memory-budget", required_argument, NULL, 347},
     {"experimental-backends", no_argument, NULL, 733},
     {"monitor-repaint", no_argument, NULL, 800},
     {"diagnostics", no_argument, NULL, 801},
     {"debug-mode", no_argument, NULL, 802},
     {"no-ewmh-fullscreen", no_argument, NULL, 803},
+    {"startup-profile", no_argument, NULL, 804},
+    {"record-events", required_argument, NULL, 805},
+    {"replay-events", required_argument, NULL, 806},
     // Must terminate with a NULL entry
     {NULL, 0, NULL, 0},
 };
@@ -887,6 +919,9 @@ bool get_cfg(options_t *opt, int argc, char *const *argv, bool shadow_enable,
 			if (!parse_rule_border(&opt->round_borders_rules, optarg))
 				exit(1);
 			break;
+		P_CASEINT(345, window_stats_interval);
+		P_CASEINT(346, glx_texture_pool_size);
+		P_CASEINT(347, image_memory_budget);
 		case 333:
 			// --cornor-radius
 			opt->corner_radius = atoi(optarg);
@@ -900,6 +935,15 @@ bool get_cfg(options_t *opt, int argc, char *const *argv, bool shadow_enable,
 		case 801: opt->print_diagnostics = true; break;
 		P_CASEBOOL(802, debug_mode);
 		P_CASEBOOL(803, no_ewmh_fullscreen);
+		P_CASEBOOL(804, startup_profile);
+		case 805:
+			free(opt->record_events_path);
+			opt->record_events_path = strdup(optarg);
+			break;
+		case 806:
+			free(opt->replay_events_path);
+			opt->replay_events_path = strdup(optarg);
+			break;
 		default: usage(argv[0], 1); break;
 #undef P_CASEBOOL
 		}
@@ -936,6 +980,12 @@ bool get_cfg(options_t *opt, int argc, char *const *argv, bool shadow_enable,
 		return false;
 	}
 
+	if (opt->backend == BKEND_PIXMAN && !opt->experimental_backends) {
+		log_error("The pixman backend only works with the experimental "
+		          "backends.");
+		return false;
+	}
+
 	if (opt->transparent_clipping && !opt->experimental_backends) {
 		log_error("Transparent clipping only works with the experimental "
 		          "backends");
@@ -944,6 +994,9 @@ bool get_cfg(options_t *opt, int argc, char *const *argv, bool shadow_enable,
 
 	// Range checking and option assignments
 	opt->fade_delta = max2(opt->fade_delta, 1);
+	opt->window_stats_interval = max2(opt->window_stats_interval, 0);
+	opt->glx_texture_pool_size = max2(opt->glx_texture_pool_size, 0);
+	opt->image_memory_budget = max2(opt->image_memory_budget, 0);
 	opt->shadow_radius = max2(opt->shadow_radius, 0);
 	opt->shadow_red = normalize_d(opt->shadow_red);
 	opt->shadow_green = normalize_d(opt->shadow_green);
@@ -57,6 +57,7 @@
 #endif
 #include "atom.h"
 #include "event.h"
+#include "event_record.h"
 #include "file_watch.h"
 #include "list.h"
 #include "options.h"
@@ -90,6 +91,7 @@ const char *const BACKEND_STRS[] = {[BKEND_XRENDER] = "xrender",
                                     [BKEND_GLX] = "glx",
                                     [BKEND_XR_GLX_HYBRID] = "xr_glx_hybrid",
                                     [BKEND_DUMMY] = "dummy",
+                                    [BKEND_PIXMAN] = "pixman",
                                     NULL};
 // clang-format on
 
@@ -100,6 +102,11 @@ const char *const BACKEND_STRS[] = {[BKEND_XRENDER] = "xrender",
 /// XXX Limit what xerror can access by not having this pointer
 session_t *ps_g = NULL;
 
+/// The event recording and replay are kept across sessions, so a reset neither starts
+/// the recording over, nor restarts the replay.
+static struct event_recorder *event_recorder = NULL;
+static struct event_replayer *event_replayer = NULL;
+
 void set_root_flags(session_t *ps, uint64_t flags) {
 	log_debug("Setting root flags: %" PRIu64, flags);
 	ps->root_flags |= flags;
@@ -125,15 +132,6 @@ static inline void free_xinerama_info(session_t *ps) {
 	ps->xinerama_nscrs = 0;
 }
 
-/**
- * Get current system clock in milliseconds.
- */
-static inline int64_t get_time_ms(void) {
-	struct timespec tp;
-	clock_gettime(CLOCK_MONOTONIC, &tp);
-	return (int64_t)tp.tv_sec * 1000 + (int64_t)tp.tv_nsec / 1000000;
-}
-
 // XXX Move to x.c
 void cxinerama_upd_scrs(session_t *ps) {
 	// XXX Consider deprecating Xinerama, switch to RandR when necessary
@@ -186,6 +184,24 @@ static inline struct managed_win *find_win_all(session_t *ps, const xcb_window_t
 	return w;
 }
 
+static double ms_since(struct timespec start) {
+	auto now = get_time_timespec();
+	return (double)(now.tv_sec - start.tv_sec) * 1000.0 +
+	       (double)(now.tv_nsec - start.tv_nsec) / 1000000.0;
+}
+
+/// Report the time spent on a step of the startup, if --startup-profile is set. Steps
+/// are reported until the first frame is rendered.
+static void startup_profile_step(session_t *ps, const char *step) {
+	if (!ps->o.startup_profile || ps->startup_done) {
+		return;
+	}
+	printf("startup: %-28s %9.2f ms (total %9.2f ms)\n", step,
+	       ms_since(ps->startup_last_step), ms_since(ps->startup_time));
+	fflush(stdout);
+	ps->startup_last_step = get_time_timespec();
+}
+
 void queue_redraw(session_t *ps) {
 	// If --benchmark is used, redraw is always queued
 	if (!ps->redraw_needed && !ps->o.benchmark) {
@@ -214,7 +230,59 @@ void add_damage(session_t *ps, const region_t *damage) {
 	}
 	log_trace("Adding damage: ");
 	dump_region(damage);
-	pixman_region32_union(ps->damage, ps->damage, (region_t *)damage);
+	// New damage is part of the damage of every age
+	for (int i = 0; i < ps->ndamage; i++) {
+		pixman_region32_union(&ps->damage_ring[i], &ps->damage_ring[i],
+		                      (region_t *)damage);
+		coarsen_region(&ps->damage_ring[i], DAMAGE_MAX_RECTS, DAMAGE_TILE_SIZE);
+	}
+}
+
+TEST_CASE(coarsen_region) {
+	// A checkerboard of single pixels, the worst case for region operations
+	rect_t rects[128];
+	int nrects = 0;
+	for (int y = 0; y < 16; y++) {
+		for (int x = y % 2; x < 16; x += 2) {
+			rects[nrects++] =
+			    (rect_t){.x1 = x, .y1 = y, .x2 = x + 1, .y2 = y + 1};
+		}
+	}
+	region_t region, coarse, left;
+	pixman_region32_init_rects(&region, rects, nrects);
+	pixman_region32_init(&coarse);
+	pixman_region32_init(&left);
+
+	// Regions within the budget are left alone
+	pixman_region32_copy(&coarse, &region);
+	coarsen_region(&coarse, nrects, 4);
+	TEST_EQUAL(pixman_region32_n_rects(&coarse), nrects);
+	TEST_TRUE(pixman_region32_equal(&coarse, &region));
+
+	pixman_region32_copy(&coarse, &region);
+	coarsen_region(&coarse, 8, 1);
+	TEST_TRUE(pixman_region32_n_rects(&coarse) <= 8);
+	// The result covers the original region, and nothing outside of its extents
+	pixman_region32_subtract(&left, &region, &coarse);
+	TEST_TRUE(!pixman_region32_not_empty(&left));
+	region_t bounds;
+	pixman_region32_init_rect(&bounds, 0, 0, 16, 16);
+	pixman_region32_subtract(&left, &coarse, &bounds);
+	TEST_TRUE(!pixman_region32_not_empty(&left));
+	pixman_region32_fini(&bounds);
+
+	// Distant parts of a region stay apart
+	pixman_region32_union_rect(&region, &region, 1000, 1000, 1, 1);
+	pixman_region32_copy(&coarse, &region);
+	coarsen_region(&coarse, 8, 1);
+	TEST_TRUE(pixman_region32_n_rects(&coarse) <= 8);
+	TEST_TRUE(!pixman_region32_contains_point(&coarse, 500, 500, NULL));
+	pixman_region32_subtract(&left, &region, &coarse);
+	TEST_TRUE(!pixman_region32_not_empty(&left));
+
+	pixman_region32_fini(&region);
+	pixman_region32_fini(&coarse);
+	pixman_region32_fini(&left);
 }
 
 // === Fading ===
@@ -501,6 +569,7 @@ static bool initialize_backend(session_t *ps) {
 		assert(!ps->backend_data);
 		// Reinitialize win_data
 		assert(backend_list[ps->o.backend]);
+		auto init_start = get_time_timespec();
 		ps->backend_data = backend_list[ps->o.backend]->init(ps);
 		if (!ps->backend_data) {
 			log_fatal("Failed to initialize backend, aborting...");
@@ -522,6 +591,14 @@ static bool initialize_backend(session_t *ps) {
 			ps->o.corner_radius = 0;
 		}
 
+		// Most of this time is spent building shaders, which the GL backend
+		// caches across runs
+		auto init_end = get_time_timespec();
+		log_info("Backend initialized in %ld ms",
+		         (init_end.tv_sec - init_start.tv_sec) * 1000L +
+		             (init_end.tv_nsec - init_start.tv_nsec) / 1000000L);
+		startup_profile_step(ps, "backend and shaders");
+
 		// window_stack shouldn't include window that's
 		// not in the hash table at this point. Since
 		// there cannot be any fading windows.
@@ -643,6 +720,27 @@ static void handle_root_flags(session_t *ps) {
 	}
 }
 
+/// How many hidden windows can have their deferred images bound in a frame
+#define IMAGE_PREFETCH_PER_FRAME 2
+/// How long a window has to keep its size before its resize is considered finished,
+/// in milliseconds
+#define RESIZE_SETTLE_TIME 100
+
+/// Whether binding the images of `w` keeps the memory used by window images under
+/// --image-memory-budget
+static inline bool win_image_budget_fits(const session_t *ps, struct managed_win *w) {
+	if (ps->o.image_memory_budget == 0) {
+		return true;
+	}
+	// Estimated the same way as when the images are bound
+	size_t bytes = 4 * (size_t)w->widthb * (size_t)w->heightb;
+	if (w->shadow && win_check_flags_all(w, WIN_FLAGS_SHADOW_NONE)) {
+		bytes += 4 * (size_t)w->shadow_width * (size_t)w->shadow_height;
+	}
+	return ps->win_image_bytes + bytes <=
+	       (size_t)ps->o.image_memory_budget * 1024 * 1024;
+}
+
 static struct managed_win *paint_preprocess(session_t *ps, bool *fade_running) {
 	// XXX need better, more general name for `fade_running`. It really
 	// means if fade is still ongoing after the current frame is rendered
@@ -714,11 +812,17 @@ static struct managed_win *paint_preprocess(session_t *ps, bool *fade_running) {
 	// Track whether it's the highest window to paint
 	bool is_highest = true;
 	bool reg_ignore_valid = true;
-	win_stack_foreach_managed(w, &ps->window_stack) {
+	// Number of hidden windows whose images were bound in this frame
+	int nprefetched = 0;
+	int nwins;
+	auto wins = win_stack_managed(ps, &nwins);
+	for (int i = 0; i < nwins; i++) {
 		__label__ skip_window;
+		auto w = wins[i];
 		bool to_paint = true;
 		// w->to_paint remembers whether this window is painted last time
 		const bool was_painted = w->to_paint;
+		w->prefetched = false;
 
 		// Destroy reg_ignore if some window above us invalidated it
 		if (!reg_ignore_valid) {
@@ -763,6 +867,20 @@ static struct managed_win *paint_preprocess(session_t *ps, bool *fade_running) {
 			          "excluded from painting",
 			          w->base.id, w->name);
 			to_paint = false;
+		} else if (w->images_deferred && (w->state == WSTATE_UNMAPPING ||
+		                                  w->state == WSTATE_DESTROYING)) {
+			// The pixmap of a window can't be named after it's unmapped, so
+			// its images can't be bound again
+			log_trace("Window %#010x (%s) will not be painted because its "
+			          "images are not bound, and it is being unmapped",
+			          w->base.id, w->name);
+			to_paint = false;
+		} else if (w->images_deferred && win_is_occluded(w, last_reg_ignore)) {
+			log_trace("Window %#010x (%s) will not be painted because its "
+			          "images are not bound, and it is covered by other "
+			          "windows",
+			          w->base.id, w->name);
+			to_paint = false;
 		} else if (unlikely((w->flags & WIN_FLAGS_IMAGE_ERROR) != 0)) {
 			log_trace("Window %#010x (%s) will not be painted because it has "
 			          "image errors",
@@ -772,6 +890,27 @@ static struct managed_win *paint_preprocess(session_t *ps, bool *fade_running) {
 		// log_trace("%s %d %d %d", w->name, to_paint, w->opacity,
 		// w->paint_excluded);
 
+		if (to_paint && w->images_deferred) {
+			// The window is visible
+			win_bind_deferred_images(ps, w);
+			to_paint = !w->images_deferred &&
+			           (w->flags & WIN_FLAGS_IMAGE_ERROR) == 0;
+		} else if (w->images_deferred && w->state == WSTATE_MAPPED &&
+		           nprefetched < IMAGE_PREFETCH_PER_FRAME &&
+		           win_image_budget_fits(ps, w)) {
+			// Bind a few hidden windows ahead of time, so they don't all
+			// have to be bound in the frame that reveals them
+			win_bind_deferred_images(ps, w);
+			w->prefetched = true;
+			nprefetched++;
+		}
+		if (ps->o.image_memory_budget > 0) {
+			w->visible = to_paint && !win_is_occluded(w, last_reg_ignore);
+			if (w->visible) {
+				w->last_visible = now;
+			}
+		}
+
 		// Add window to damaged area if its painting status changes
 		// or opacity changes
 		if (to_paint != was_painted) {
@@ -796,9 +935,11 @@ static struct managed_win *paint_preprocess(session_t *ps, bool *fade_running) {
 
 		// If the window is solid, or we enabled clipping for transparent windows,
 		// we add the window region to the ignored region
-		// Otherwise last_reg_ignore shouldn't change
-		if ((w->mode != WMODE_TRANS && !ps->o.force_win_blend) ||
-		    ps->o.transparent_clipping) {
+		// Otherwise last_reg_ignore shouldn't change. A window image from before
+		// a resize might not cover the window, so it doesn't hide anything.
+		if (((w->mode != WMODE_TRANS && !ps->o.force_win_blend) ||
+		     ps->o.transparent_clipping) &&
+		    !w->resize_pending) {
 			// w->mode == WMODE_SOLID or WMODE_FRAME_TRANS
 			region_t *tmp = rc_region_new();
 			if (w->mode == WMODE_SOLID) {
@@ -945,6 +1086,7 @@ void ev_xcb_error(session_t *ps, xcb_generic_error_t *err) {
  */
 void force_repaint(session_t *ps) {
 	assert(pixman_region32_not_empty(&ps->screen_reg));
+	command_list_invalidate(&ps->last_frame_commands);
 	queue_redraw(ps);
 	add_damage(ps, &ps->screen_reg);
 }
@@ -1362,6 +1504,8 @@ static void unredirect(session_t *ps) {
 	ps->ndamage = 0;
 	free(ps->damage_ring);
 	ps->damage_ring = ps->damage = NULL;
+	command_list_deinit(&ps->frame_commands);
+	command_list_deinit(&ps->last_frame_commands);
 
 	// Must call XSync() here
 	x_sync(ps->c);
@@ -1385,6 +1529,9 @@ static void handle_queued_x_events(EV_P attr_unused, ev_prepare *w, int revents
 	// because OpenGL.
 	XFlush(ps->dpy);
 	xcb_flush(ps->c);
+	if (ps->event_recorder) {
+		event_recorder_flush(ps->event_recorder);
+	}
 	int err = xcb_connection_has_error(ps->c);
 	if (err) {
 		log_fatal("X11 server connection broke (error %d)", err);
@@ -1393,34 +1540,70 @@ static void handle_queued_x_events(EV_P attr_unused, ev_prepare *w, int revents
 }
 
 static void handle_new_windows(session_t *ps) {
-	list_foreach_safe(struct win, w, &ps->window_stack, stack_neighbour) {
+	// Request the attributes and geometry of all new windows first, so adopting
+	// many windows at once, e.g. at startup, doesn't take a round trip per window
+	// for each of them.
+	int nnew = 0;
+	list_foreach(struct win, w, &ps->window_stack, stack_neighbour) {
 		if (w->is_new) {
-			auto new_w = fill_win(ps, w);
-			if (!new_w->managed) {
-				continue;
-			}
-			auto mw = (struct managed_win *)new_w;
-			if (mw->a.map_state == XCB_MAP_STATE_VIEWABLE) {
-				win_set_flags(mw, WIN_FLAGS_MAPPED);
-
-				// This window might be damaged before we called fill_win
-				// and created the damage handle. And there is no way for
-				// us to find out. So just blindly mark it damaged
-				mw->ever_damaged = true;
-			}
+			nnew++;
+		}
+	}
+	if (nnew == 0) {
+		return;
+	}
+
+	auto new_wins = ccalloc(nnew, struct win *);
+	auto prefetch = ccalloc(nnew, struct win_prefetch);
+	int i = 0;
+	list_foreach(struct win, w, &ps->window_stack, stack_neighbour) {
+		if (w->is_new) {
+			new_wins[i] = w;
+			prefetch[i] = win_send_prefetch(ps, w->id);
+			i++;
 		}
 	}
+
+	for (i = 0; i < nnew; i++) {
+		auto new_w = fill_win_prefetched(ps, new_wins[i], &prefetch[i]);
+		if (!new_w->managed) {
+			continue;
+		}
+		auto mw = (struct managed_win *)new_w;
+		if (mw->a.map_state == XCB_MAP_STATE_VIEWABLE) {
+			win_set_flags(mw, WIN_FLAGS_MAPPED);
+
+			// This window might be damaged before we called fill_win
+			// and created the damage handle. And there is no way for
+			// us to find out. So just blindly mark it damaged
+			mw->ever_damaged = true;
+		}
+	}
+	free(prefetch);
+	free(new_wins);
 }
 
 static void refresh_windows(session_t *ps) {
-	win_stack_foreach_managed(w, &ps->window_stack) {
-		win_process_update_flags(ps, w);
+	int nwins;
+	auto wins = win_stack_managed(ps, &nwins);
+	for (int i = 0; i < nwins; i++) {
+		win_process_update_flags(ps, wins[i]);
 	}
 }
 
 static void refresh_images(session_t *ps) {
-	win_stack_foreach_managed(w, &ps->window_stack) {
-		win_process_image_flags(ps, w);
+	bool resizing = false;
+	int nwins;
+	auto wins = win_stack_managed(ps, &nwins);
+	for (int i = 0; i < nwins; i++) {
+		win_process_image_flags(ps, wins[i]);
+		resizing = resizing || wins[i]->resize_pending ||
+		           wins[i]->shadow_resize_pending;
+	}
+
+	if (resizing && !ev_is_active(&ps->resize_timer)) {
+		ev_timer_set(&ps->resize_timer, RESIZE_SETTLE_TIME / 1000.0, 0);
+		ev_timer_start(ps->loop, &ps->resize_timer);
 	}
 }
 
@@ -1438,6 +1621,30 @@ static void fade_timer_callback(EV_P attr_unused, ev_timer *w, int revents attr_
 	queue_redraw(ps);
 }
 
+/// Finish the resize of windows that weren't resized for RESIZE_SETTLE_TIME
+static void resize_timer_callback(EV_P_ ev_timer *w, int revents attr_unused) {
+	session_t *ps = session_ptr(w, resize_timer);
+	auto now = get_time_ms();
+	int64_t next_settle = INT64_MAX;
+	win_stack_foreach_managed(mw, &ps->window_stack) {
+		if (!mw->resize_pending && !mw->shadow_resize_pending) {
+			continue;
+		}
+		auto settle = mw->last_resize + RESIZE_SETTLE_TIME;
+		if (settle <= now) {
+			win_finish_resize(ps, mw);
+		} else {
+			next_settle = min2(next_settle, settle);
+		}
+	}
+
+	if (next_settle != INT64_MAX) {
+		ev_timer_set(w, (double)(next_settle - now) / 1000.0, 0);
+		ev_timer_start(EV_A_ w);
+	}
+	queue_redraw(ps);
+}
+
 static void handle_pending_updates(EV_P_ struct session *ps) {
 	if (ps->pending_updates) {
 		log_debug("Delayed handling of events, entering critical section");
@@ -1454,6 +1661,7 @@ static void handle_pending_updates(EV_P_ struct session *ps) {
 
 		// Call fill_win on new windows
 		handle_new_windows(ps);
+		startup_profile_step(ps, "window adoption");
 
 		// Handle screen changes
 		// This HAS TO be called before refresh_windows, as handle_root_flags
@@ -1553,12 +1761,17 @@ static void draw_callback_impl(EV_P_ session_t *ps, int revents attr_unused) {
 		log_trace("Render start, frame %d", paint);
 		if (ps->o.experimental_backends) {
 			paint_all_new(ps, bottom, false);
+			win_evict_images(ps);
 		} else {
 			paint_all(ps, bottom, false);
 		}
 		log_trace("Render end");
 
 		ps->first_frame = false;
+		if (!ps->startup_done) {
+			startup_profile_step(ps, "first frame");
+			ps->startup_done = true;
+		}
 		paint++;
 		if (ps->o.benchmark && paint >= ps->o.benchmark) {
 			exit(0);
@@ -1636,6 +1849,370 @@ static void x_event_callback(EV_P attr_unused, ev_io *w, int revents attr_unused
 	}
 }
 
+/// Interval between updates of the window statistics, in seconds
+#define WIN_STATS_UPDATE_INTERVAL 1.0
+/// Number of windows to log in the window statistics summary
+#define WIN_STATS_LOG_COUNT 5
+
+static int win_stats_cmp(const void *a, const void *b) {
+	const struct managed_win *wa = *(struct managed_win *const *)a;
+	const struct managed_win *wb = *(struct managed_win *const *)b;
+	double ca = win_stats_paint_time(&wa->stats),
+	       cb = win_stats_paint_time(&wb->stats);
+	if (ca == cb) {
+		ca = wa->stats.rate[WIN_STAT_DAMAGED_PIXELS];
+		cb = wb->stats.rate[WIN_STAT_DAMAGED_PIXELS];
+	}
+	return ca < cb ? 1 : (ca > cb ? -1 : 0);
+}
+
+/// Log the windows that cost the most to composite
+static void log_win_stats(session_t *ps) {
+	int nwins;
+	auto stack = win_stack_managed(ps, &nwins);
+	if (nwins == 0) {
+		return;
+	}
+	auto wins = ccalloc(nwins, struct managed_win *);
+	memcpy(wins, stack, sizeof(*wins) * (size_t)nwins);
+	qsort(wins, (size_t)nwins, sizeof(*wins), win_stats_cmp);
+
+	log_info("Windows that cost the most to composite, per second:");
+	for (int i = 0; i < min2(nwins, WIN_STATS_LOG_COUNT); i++) {
+		auto rate = wins[i]->stats.rate;
+		if (win_stats_paint_time(&wins[i]->stats) == 0 &&
+		    rate[WIN_STAT_DAMAGE_EVENTS] == 0) {
+			break;
+		}
+		char line[256];
+		int len = 0;
+		for (int j = 0; j < NUM_WIN_STATS && len < (int)sizeof(line); j++) {
+			len += snprintf(line + len, sizeof(line) - (size_t)len,
+			                "%s%s %.2f", j ? ", " : "", WIN_STAT_NAMES[j],
+			                rate[j]);
+		}
+		log_info("  %#010x (%s): %s", wins[i]->base.id,
+		         wins[i]->name ?: "unnamed", line);
+	}
+	free(wins);
+}
+
+static void
+win_stats_timer_callback(EV_P attr_unused, ev_timer *w, int revents attr_unused) {
+	session_t *ps = session_ptr(w, win_stats_timer);
+	win_stack_foreach_managed(mw, &ps->window_stack) {
+		win_stats_update(&mw->stats, WIN_STATS_UPDATE_INTERVAL);
+	}
+	if (ps->o.window_stats_interval > 0 &&
+	    ++ps->win_stats_ticks >= ps->o.window_stats_interval) {
+		ps->win_stats_ticks = 0;
+		log_win_stats(ps);
+	}
+}
+
+/// Start or stop collecting window statistics, depending on whether anything uses
+/// them
+static void update_win_stats_timer(session_t *ps) {
+	ps->win_stats_enabled = ps->o.dbus || ps->o.window_stats_interval > 0;
+	if (ps->win_stats_enabled && !ev_is_active(&ps->win_stats_timer)) {
+		ps->win_stats_ticks = 0;
+		ev_timer_set(&ps->win_stats_timer, WIN_STATS_UPDATE_INTERVAL,
+		             WIN_STATS_UPDATE_INTERVAL);
+		ev_timer_start(ps->loop, &ps->win_stats_timer);
+	} else if (!ps->win_stats_enabled) {
+		ev_timer_stop(ps->loop, &ps->win_stats_timer);
+	}
+}
+
+/// Free the dynamically allocated members of `o`
+static void free_options(options_t *o) {
+	free_wincondlst(&o->shadow_blacklist);
+	free_wincondlst(&o->fade_blacklist);
+	free_wincondlst(&o->focus_blacklist);
+	free_wincondlst(&o->invert_color_list);
+	free_wincondlst(&o->blur_background_blacklist);
+	free_wincondlst(&o->opacity_rules);
+	free_wincondlst(&o->paint_blacklist);
+	free_wincondlst(&o->unredir_if_possible_blacklist);
+	free_wincondlst(&o->rounded_corners_blacklist);
+	free_wincondlst(&o->round_borders_blacklist);
+	free_wincondlst(&o->round_borders_rules);
+
+	free(o->write_pid_path);
+	free(o->logpath);
+	free(o->record_events_path);
+	free(o->replay_events_path);
+	for (int i = 0; i < o->blur_kernel_count; ++i) {
+		free(o->blur_kerns[i]);
+	}
+	free(o->blur_kerns);
+	free(o->glx_fshader_win_str);
+	free(o->shadow_exclude_reg_str);
+	*o = (options_t){0};
+}
+
+/// Resolve the atoms used by the window rules in `ps->o`
+static void postprocess_window_rules(session_t *ps) {
+	if (!(c2_list_postprocess(ps, ps->o.unredir_if_possible_blacklist) &&
+	      c2_list_postprocess(ps, ps->o.paint_blacklist) &&
+	      c2_list_postprocess(ps, ps->o.shadow_blacklist) &&
+	      c2_list_postprocess(ps, ps->o.fade_blacklist) &&
+	      c2_list_postprocess(ps, ps->o.blur_background_blacklist) &&
+	      c2_list_postprocess(ps, ps->o.invert_color_list) &&
+	      c2_list_postprocess(ps, ps->o.opacity_rules) &&
+	      c2_list_postprocess(ps, ps->o.rounded_corners_blacklist) &&
+	      c2_list_postprocess(ps, ps->o.round_borders_blacklist) &&
+	      c2_list_postprocess(ps, ps->o.round_borders_rules) &&
+	      c2_list_postprocess(ps, ps->o.focus_blacklist))) {
+		log_error("Post-processing of conditionals failed, some of your rules "
+		          "might not work");
+	}
+}
+
+static bool nullable_str_equal(const char *a, const char *b) {
+	return a == b || (a && b && strcmp(a, b) == 0);
+}
+
+static bool blur_options_equal(const options_t *a, const options_t *b) {
+	if (a->blur_method != b->blur_method || a->blur_radius != b->blur_radius ||
+	    a->blur_deviation != b->blur_deviation ||
+	    memcmp(&a->blur_strength, &b->blur_strength, sizeof(a->blur_strength)) != 0 ||
+	    a->blur_kernel_count != b->blur_kernel_count) {
+		return false;
+	}
+	for (int i = 0; i < a->blur_kernel_count; i++) {
+		const struct conv *ka = a->blur_kerns[i], *kb = b->blur_kerns[i];
+		if (!ka || !kb) {
+			if (ka != kb) {
+				return false;
+			}
+			continue;
+		}
+		if (ka->w != kb->w || ka->h != kb->h ||
+		    memcmp(ka->data, kb->data,
+		           sizeof(double) * (size_t)(ka->w * ka->h)) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/// Find an option that differs between `old` and `new`, and that can't be changed
+/// without resetting the whole session.
+///
+/// @return the name of the option, NULL if there is none
+static const char *options_reset_reason(const options_t *old, const options_t *new) {
+	if (!old->experimental_backends || !new->experimental_backends) {
+		// The legacy backends set up their state from the options in
+		// init_render
+		return "experimental-backends";
+	}
+#define RESET_IF_CHANGED(member, name)                                                   \
+	if (old->member != new->member) {                                                \
+		return name;                                                             \
+	}
+	RESET_IF_CHANGED(backend, "backend");
+	RESET_IF_CHANGED(xrender_sync_fence, "xrender-sync-fence");
+	RESET_IF_CHANGED(glx_no_stencil, "glx-no-stencil");
+	RESET_IF_CHANGED(glx_no_rebind_pixmap, "glx-no-rebind-pixmap");
+	RESET_IF_CHANGED(detect_rounded_corners, "detect-rounded-corners");
+	RESET_IF_CHANGED(redirected_force, "redirected-force");
+	RESET_IF_CHANGED(dbus, "dbus");
+	RESET_IF_CHANGED(benchmark, "benchmark");
+	RESET_IF_CHANGED(benchmark_wid, "benchmark-wid");
+	RESET_IF_CHANGED(no_x_selection, "no-x-selection");
+	RESET_IF_CHANGED(refresh_rate, "refresh-rate");
+	RESET_IF_CHANGED(sw_opti, "sw-opti");
+	RESET_IF_CHANGED(vsync, "vsync");
+	RESET_IF_CHANGED(vsync_use_glfinish, "vsync-use-glfinish");
+	RESET_IF_CHANGED(use_damage, "use-damage");
+	RESET_IF_CHANGED(xinerama_shadow_crop, "xinerama-shadow-crop");
+	RESET_IF_CHANGED(detect_client_opacity, "detect-client-opacity");
+	RESET_IF_CHANGED(use_ewmh_active_win, "use-ewmh-active-win");
+	RESET_IF_CHANGED(detect_transient, "detect-transient");
+	RESET_IF_CHANGED(detect_client_leader, "detect-client-leader");
+	RESET_IF_CHANGED(track_leader, "track-leader");
+#undef RESET_IF_CHANGED
+	if (!nullable_str_equal(old->write_pid_path, new->write_pid_path)) {
+		return "write-pid-path";
+	}
+	if (!nullable_str_equal(old->logpath, new->logpath)) {
+		return "log-file";
+	}
+	if (!nullable_str_equal(old->record_events_path, new->record_events_path)) {
+		return "record-events";
+	}
+	if (!nullable_str_equal(old->replay_events_path, new->replay_events_path)) {
+		return "replay-events";
+	}
+	if (!nullable_str_equal(old->glx_fshader_win_str, new->glx_fshader_win_str)) {
+		return "glx-fshader-win";
+	}
+	return NULL;
+}
+
+static void reset_enable(EV_P_ ev_signal *w attr_unused, int revents attr_unused);
+static void config_file_change_cb(void *_ps);
+
+/// Parse the configuration again, and apply the changes without resetting the session
+/// if possible. The backend and the window images are kept, only the parts that
+/// depend on the changed options are rebuilt.
+static void session_reload_config(session_t *ps) {
+	auto reload_start = get_time_timespec();
+	log_info("Configuration changed, reloading");
+
+	options_t new_opt;
+	win_option_mask_t winopt_mask[NUM_WINTYPES] = {{0}};
+	bool shadow_enabled = false, fading_enable = false, hasneg = false;
+	char *config_file = parse_config(&new_opt, ps->config_file, &shadow_enabled,
+	                                 &fading_enable, &hasneg, winopt_mask);
+	if (IS_ERR(config_file)) {
+		log_error("Failed to parse the configuration file, keeping the current "
+		          "configuration");
+		free_options(&new_opt);
+		return;
+	}
+	if (!get_cfg(&new_opt, ps->argc, ps->argv, shadow_enabled, fading_enable,
+	             hasneg, winopt_mask)) {
+		log_error("Invalid configuration, keeping the current configuration");
+		free_options(&new_opt);
+		free(config_file);
+		return;
+	}
+
+	// Repeat the adjustments session_init made to the options
+	new_opt.show_all_xerrors = ps->o.show_all_xerrors;
+	new_opt.xrender_sync_fence = new_opt.xrender_sync_fence && ps->sync_fence;
+	if (new_opt.monitor_repaint && !backend_list[new_opt.backend]->fill) {
+		new_opt.monitor_repaint = false;
+	}
+	if (new_opt.sw_opti) {
+		// A changed refresh rate resets anyway, so the refresh rate found
+		// by swopti_init is still valid if it succeeded before
+		new_opt.sw_opti = ps->o.sw_opti || swopti_init(ps);
+	}
+#ifdef CONFIG_DBUS
+	if (ps->dbus_init_failed) {
+		new_opt.dbus = false;
+	}
+#endif
+
+	auto reason = options_reset_reason(&ps->o, &new_opt);
+	if (reason) {
+		log_info("Option %s changed, resetting", reason);
+		free_options(&new_opt);
+		free(config_file);
+		reset_enable(ps->loop, NULL, 0);
+		return;
+	}
+
+	// The config file might have been replaced by a new file, watch that instead
+	if (ps->file_watch_handle) {
+		file_watch_destroy(ps->loop, ps->file_watch_handle);
+		ps->file_watch_handle = file_watch_init(ps->loop);
+		if (ps->file_watch_handle && config_file) {
+			file_watch_add(ps->file_watch_handle, config_file,
+			               config_file_change_cb, ps);
+		}
+	}
+	free(config_file);
+
+	const bool blur_changed = !blur_options_equal(&ps->o, &new_opt);
+	const bool round_changed = ps->o.corner_radius != new_opt.corner_radius ||
+	                           ps->o.round_borders != new_opt.round_borders;
+	const bool shadow_changed =
+	    ps->o.shadow_radius != new_opt.shadow_radius ||
+	    ps->o.shadow_offset_x != new_opt.shadow_offset_x ||
+	    ps->o.shadow_offset_y != new_opt.shadow_offset_y ||
+	    ps->o.shadow_red != new_opt.shadow_red ||
+	    ps->o.shadow_green != new_opt.shadow_green ||
+	    ps->o.shadow_blue != new_opt.shadow_blue ||
+	    ps->o.shadow_opacity != new_opt.shadow_opacity;
+	const bool shadow_exclude_changed = !nullable_str_equal(
+	    ps->o.shadow_exclude_reg_str, new_opt.shadow_exclude_reg_str);
+
+	auto old_opt = ps->o;
+	ps->o = new_opt;
+
+	update_win_stats_timer(ps);
+
+	auto start = get_time_timespec();
+	postprocess_window_rules(ps);
+	log_info("Window rules rebuilt in %.2f ms", ms_since(start));
+
+	if (blur_changed && ps->backend_data) {
+		start = get_time_timespec();
+		if (ps->backend_blur_context) {
+			ps->backend_data->ops->destroy_blur_context(
+			    ps->backend_data, ps->backend_blur_context);
+			ps->backend_blur_context = NULL;
+		}
+		if (!initialize_blur(ps)) {
+			log_error("Failed to prepare for background blur, disabling it");
+			ps->o.blur_method = BLUR_METHOD_NONE;
+		}
+		log_info("Blur context rebuilt in %.2f ms", ms_since(start));
+	}
+
+	if (round_changed && ps->backend_data) {
+		start = get_time_timespec();
+		if (ps->backend_round_context) {
+			ps->backend_data->ops->destroy_round_context(
+			    ps->backend_data, ps->backend_round_context);
+			ps->backend_round_context = NULL;
+		}
+		if (!initialize_round_corners(ps)) {
+			log_error("Failed to prepare for rounded corners, disabling "
+			          "them");
+			ps->o.corner_radius = 0;
+		}
+		log_info("Rounded corners context rebuilt in %.2f ms", ms_since(start));
+	}
+
+	if (shadow_changed) {
+		start = get_time_timespec();
+		free_conv(ps->gaussian_map);
+		ps->gaussian_map =
+		    gaussian_kernel_autodetect_deviation(ps->o.shadow_radius);
+		sum_kernel_preprocess(ps->gaussian_map);
+		log_info("Shadow kernel rebuilt in %.2f ms", ms_since(start));
+	}
+	if (shadow_exclude_changed) {
+		rebuild_shadow_exclude_reg(ps);
+	}
+
+	// The rules are evaluated again, and the shadows rebuilt, by the next
+	// refresh_windows and refresh_images.
+	start = get_time_timespec();
+	int nwins = 0;
+	win_stack_foreach_managed(w, &ps->window_stack) {
+		if (w->state == WSTATE_DESTROYING) {
+			continue;
+		}
+		win_set_flags(w, WIN_FLAGS_FACTOR_CHANGED);
+		if (shadow_changed) {
+			win_on_shadow_options_change(ps, w);
+		}
+		w->reg_ignore_valid = false;
+		rc_region_unref(&w->reg_ignore);
+		nwins++;
+	}
+	ps->pending_updates = true;
+	log_info("%d windows marked for update in %.2f ms", nwins, ms_since(start));
+
+	free_options(&old_opt);
+	force_repaint(ps);
+	queue_redraw(ps);
+	log_info("Configuration reloaded in %.2f ms", ms_since(reload_start));
+}
+
+static void reload_timer_callback(EV_P_ ev_timer *w, int revents attr_unused) {
+	session_t *ps = session_ptr(w, reload_timer);
+	// The timer repeats, see config_file_change_cb
+	ev_timer_stop(EV_A_ w);
+	session_reload_config(ps);
+}
+
 /**
  * Turn on the program reset flag.
  *
@@ -1654,7 +2231,9 @@ static void exit_enable(EV_P attr_unused, ev_signal *w, int revents attr_unused)
 
 static void config_file_change_cb(void *_ps) {
 	auto ps = (struct session *)_ps;
-	reset_enable(ps->loop, NULL, 0);
+	// Editors often write a file in several steps, wait for them to finish.
+	// ev_timer_again restarts the timer if it's already running.
+	ev_timer_again(ps->loop, &ps->reload_timer);
 }
 
 /**
@@ -1801,6 +2380,7 @@ static session_t *session_init(int argc, char **argv, Display *dpy,
 	xcb_prefetch_extension_data(ps->c, &xcb_xinerama_id);
 	xcb_prefetch_extension_data(ps->c, &xcb_present_id);
 	xcb_prefetch_extension_data(ps->c, &xcb_sync_id);
+	xcb_prefetch_extension_data(ps->c, &xcb_shm_id);
 	xcb_prefetch_extension_data(ps->c, &xcb_glx_id);
 
 	ext_info = xcb_get_extension_data(ps->c, &xcb_render_id);
@@ -1870,6 +2450,15 @@ static session_t *session_init(int argc, char **argv, Display *dpy,
 		ps->glx_event = ext_info->first_event;
 	}
 
+	ps->startup_time = ps->startup_last_step = get_time_timespec();
+	// Window generations keep increasing across resets, so D-Bus clients can tell
+	// generations from previous sessions apart
+	ps->win_generation = (uint64_t)ps->startup_time.tv_sec * 1000000 +
+	                     (uint64_t)ps->startup_time.tv_nsec / 1000;
+	ps->argc = argc;
+	ps->argv = argv;
+	ps->config_file = config_file ? strdup(config_file) : NULL;
+
 	// Parse configuration file
 	win_option_mask_t winopt_mask[NUM_WINTYPES] = {{0}};
 	bool shadow_enabled = false, fading_enable = false, hasneg = false;
@@ -1887,6 +2476,7 @@ static session_t *session_init(int argc, char **argv, Display *dpy,
 		          "invalid options.");
 		return NULL;
 	}
+	startup_profile_step(ps, "configuration");
 
 	if (ps->o.logpath) {
 		auto l = file_logger_new(ps->o.logpath);
@@ -1910,6 +2500,7 @@ static session_t *session_init(int argc, char **argv, Display *dpy,
 	}
 
 	ps->atoms = init_atoms(ps->c);
+	startup_profile_step(ps, "atoms");
 	ps->atoms_wintypes[WINTYPE_UNKNOWN] = 0;
 #define SET_WM_TYPE_ATOM(x)                                                              \
 	ps->atoms_wintypes[WINTYPE_##x] = ps->atoms->a_NET_WM_WINDOW_TYPE_##x
@@ -1930,20 +2521,7 @@ static session_t *session_init(int argc, char **argv, Display *dpy,
 #undef SET_WM_TYPE_ATOM
 
 	// Get needed atoms for c2 condition lists
-	if (!(c2_list_postprocess(ps, ps->o.unredir_if_possible_blacklist) &&
-	      c2_list_postprocess(ps, ps->o.paint_blacklist) &&
-	      c2_list_postprocess(ps, ps->o.shadow_blacklist) &&
-	      c2_list_postprocess(ps, ps->o.fade_blacklist) &&
-	      c2_list_postprocess(ps, ps->o.blur_background_blacklist) &&
-	      c2_list_postprocess(ps, ps->o.invert_color_list) &&
-	      c2_list_postprocess(ps, ps->o.opacity_rules) &&
-	      c2_list_postprocess(ps, ps->o.rounded_corners_blacklist) &&
-	      c2_list_postprocess(ps, ps->o.round_borders_blacklist) &&
-	      c2_list_postprocess(ps, ps->o.round_borders_rules) &&
-	      c2_list_postprocess(ps, ps->o.focus_blacklist))) {
-		log_error("Post-processing of conditionals failed, some of your rules "
-		          "might not work");
-	}
+	postprocess_window_rules(ps);
 
 	ps->gaussian_map = gaussian_kernel_autodetect_deviation(ps->o.shadow_radius);
 	sum_kernel_preprocess(ps->gaussian_map);
@@ -1995,6 +2573,9 @@ static session_t *session_init(int argc, char **argv, Display *dpy,
 		}
 	}
 
+	startup_profile_step(ps, "extensions");
+	x_shm_pool_init(ps->c, &ps->shm_pool);
+
 	ps->sync_fence = XCB_NONE;
 	if (ps->xsync_exists) {
 		ps->sync_fence = x_new_id(ps->c);
@@ -2158,6 +2739,10 @@ static session_t *session_init(int argc, char **argv, Display *dpy,
 		ev_idle_init(&ps->draw_idle, draw_callback);
 
 	ev_init(&ps->fade_timer, fade_timer_callback);
+	ev_init(&ps->resize_timer, resize_timer_callback);
+	ev_init(&ps->reload_timer, reload_timer_callback);
+	ps->reload_timer.repeat = 0.1;
+	ev_init(&ps->win_stats_timer, win_stats_timer_callback);
 	ev_init(&ps->delayed_draw_timer, delayed_draw_timer_callback);
 
 	// Set up SIGUSR1 signal handler to reset program
@@ -2193,12 +2778,15 @@ static session_t *session_init(int argc, char **argv, Display *dpy,
 		cdbus_init(ps, DisplayString(ps->dpy));
 		if (!ps->dbus_data) {
 			ps->o.dbus = false;
+			ps->dbus_init_failed = true;
 		}
 #else
 		log_fatal("DBus support not compiled in!");
 		exit(1);
 #endif
 	}
+	update_win_stats_timer(ps);
+	startup_profile_step(ps, "session setup");
 
 	e = xcb_request_check(ps->c, xcb_grab_server_checked(ps->c));
 	if (e) {
@@ -2239,6 +2827,7 @@ static session_t *session_init(int argc, char **argv, Display *dpy,
 		}
 		free(query_tree_reply);
 	}
+	startup_profile_step(ps, "window tree");
 
 	log_debug("Initial stack:");
 	list_foreach(struct win, w, &ps->window_stack, stack_neighbour) {
@@ -2249,6 +2838,37 @@ static session_t *session_init(int argc, char **argv, Display *dpy,
 
 	write_pid(ps);
 
+	if (event_replayer && (!ps->o.replay_events_path ||
+	                       strcmp(event_replayer_path(event_replayer),
+	                              ps->o.replay_events_path) != 0)) {
+		event_replayer_free(event_replayer);
+		event_replayer = NULL;
+	}
+	if (!event_replayer && ps->o.replay_events_path) {
+		event_replayer = event_replayer_new(ps->o.replay_events_path);
+		if (!event_replayer) {
+			goto err;
+		}
+	}
+	if (event_replayer) {
+		event_replayer_attach(event_replayer, ps);
+		ps->event_replayer = event_replayer;
+	}
+
+	if (event_recorder && (!ps->o.record_events_path ||
+	                       strcmp(event_recorder_path(event_recorder),
+	                              ps->o.record_events_path) != 0)) {
+		event_recorder_free(event_recorder);
+		event_recorder = NULL;
+	}
+	if (!event_recorder && ps->o.record_events_path) {
+		event_recorder = event_recorder_new(ps->o.record_events_path);
+	}
+	if (event_recorder) {
+		event_recorder_attach(event_recorder, ps);
+		ps->event_recorder = event_recorder;
+	}
+
 	if (fork && stderr_logger) {
 		// Remove the stderr logger if we will fork
 		log_remove_target_tls(stderr_logger);
@@ -2280,6 +2900,15 @@ static void session_destroy(session_t *ps) {
 	file_watch_destroy(ps->loop, ps->file_watch_handle);
 	ps->file_watch_handle = NULL;
 
+	if (ps->event_recorder) {
+		event_recorder_detach(ps->event_recorder);
+		ps->event_recorder = NULL;
+	}
+	if (ps->event_replayer) {
+		event_replayer_detach(ps->event_replayer);
+		ps->event_replayer = NULL;
+	}
+
 	// Stop listening to events on root window
 	xcb_change_window_attributes(ps->c, ps->root, XCB_CW_EVENT_MASK,
 	                             (const uint32_t[]){0});
@@ -2307,19 +2936,14 @@ static void session_destroy(session_t *ps) {
 		free(w);
 	}
 	list_init_head(&ps->window_stack);
+	free(ps->managed_stack);
+	ps->managed_stack = NULL;
+	ps->managed_stack_len = ps->managed_stack_capacity = 0;
+	ps->managed_stack_valid = false;
 
-	// Free blacklists
-	free_wincondlst(&ps->o.shadow_blacklist);
-	free_wincondlst(&ps->o.fade_blacklist);
-	free_wincondlst(&ps->o.focus_blacklist);
-	free_wincondlst(&ps->o.invert_color_list);
-	free_wincondlst(&ps->o.blur_background_blacklist);
-	free_wincondlst(&ps->o.opacity_rules);
-	free_wincondlst(&ps->o.paint_blacklist);
-	free_wincondlst(&ps->o.unredir_if_possible_blacklist);
-	free_wincondlst(&ps->o.rounded_corners_blacklist);
-	free_wincondlst(&ps->o.round_borders_blacklist);
-	free_wincondlst(&ps->o.round_borders_rules);
+	free_options(&ps->o);
+	free(ps->config_file);
+	ps->config_file = NULL;
 
 	// Free tracked atom list
 	{
@@ -2357,17 +2981,11 @@ static void session_destroy(session_t *ps) {
 
 	free_picture(ps->c, &ps->root_picture);
 	free_paint(ps, &ps->tgt_buffer);
+	x_shm_pool_deinit(ps->c, &ps->shm_pool);
 
 	pixman_region32_fini(&ps->screen_reg);
 	free(ps->expose_rects);
 
-	free(ps->o.write_pid_path);
-	free(ps->o.logpath);
-	for (int i = 0; i < ps->o.blur_kernel_count; ++i) {
-		free(ps->o.blur_kerns[i]);
-	}
-	free(ps->o.blur_kerns);
-	free(ps->o.glx_fshader_win_str);
 	free_xinerama_info(ps);
 
 #ifdef CONFIG_VSYNC_DRM
@@ -2435,6 +3053,9 @@ static void session_destroy(session_t *ps) {
 	// Stop libev event handlers
 	ev_timer_stop(ps->loop, &ps->unredir_timer);
 	ev_timer_stop(ps->loop, &ps->fade_timer);
+	ev_timer_stop(ps->loop, &ps->resize_timer);
+	ev_timer_stop(ps->loop, &ps->reload_timer);
+	ev_timer_stop(ps->loop, &ps->win_stats_timer);
 	ev_idle_stop(ps->loop, &ps->draw_idle);
 	ev_prepare_stop(ps->loop, &ps->event_check);
 	ev_signal_stop(ps->loop, &ps->usr1_signal);
@@ -2559,6 +3180,9 @@ int main(int argc, char **argv) {
 			// We only do this once
 			need_fork = false;
 		}
+		// From here on, log messages are written out in the background, so
+		// verbose logging doesn't slow down rendering.
+		log_start_async_tls();
 		session_run(ps_g);
 		quit = ps_g->quit;
 		if (quit && ps_g->o.write_pid_path) {
@@ -2572,6 +3196,12 @@ int main(int argc, char **argv) {
 		}
 	} while (!quit);
 
+	if (event_recorder) {
+		event_recorder_free(event_recorder);
+	}
+	if (event_replayer) {
+		event_replayer_free(event_replayer);
+	}
 	free(config_file);
 	if (pid_file) {
 		log_trace("remove pid file %s", pid_file);
@@ -28,6 +28,18 @@ static inline void dump_region(const region_t *x) {
 		          rects[i].y2);
 }
 
+/// Number of pixels covered by a region
+static inline uint64_t region_area(const region_t *region) {
+	int nrects;
+	const rect_t *rects = pixman_region32_rectangles((region_t *)region, &nrects);
+	uint64_t area = 0;
+	for (int i = 0; i < nrects; i++) {
+		area += (uint64_t)(rects[i].x2 - rects[i].x1) *
+		        (uint64_t)(rects[i].y2 - rects[i].y1);
+	}
+	return area;
+}
+
 /// Convert one xcb rectangle to our rectangle type
 static inline rect_t from_x_rect(const xcb_rectangle_t *rect) {
 	return (rect_t){
@@ -48,6 +60,10 @@ static inline rect_t *from_x_rects(int nrects, const xcb_rectangle_t *rects) {
 	return ret;
 }
 
+/// Regions with at most this many rectangles are resized without allocating a
+/// temporary rectangle array
+#define RESIZE_REGION_STACK_RECTS 32
+
 /**
  * Resize a region.
  */
@@ -66,7 +82,9 @@ static inline void _resize_region(const region_t *region, region_t *output, int
 	int nrects;
 	int nnewrects = 0;
 	const rect_t *rects = pixman_region32_rectangles((region_t *)region, &nrects);
-	auto newrects = ccalloc(nrects, rect_t);
+	rect_t stack_rects[RESIZE_REGION_STACK_RECTS];
+	rect_t *newrects =
+	    nrects <= RESIZE_REGION_STACK_RECTS ? stack_rects : ccalloc(nrects, rect_t);
 	for (int i = 0; i < nrects; i++) {
 		int x1 = rects[i].x1 - dx;
 		int y1 = rects[i].y1 - dy;
@@ -85,7 +103,9 @@ static inline void _resize_region(const region_t *region, region_t *output, int
 	pixman_region32_fini(output);
 	pixman_region32_init_rects(output, newrects, nnewrects);
 
-	free(newrects);
+	if (newrects != stack_rects) {
+		free(newrects);
+	}
 }
 
 static inline region_t resize_region(const region_t *region, int dx, int dy) {
@@ -98,3 +118,77 @@ static inline region_t resize_region(const region_t *region, int dx, int dy) {
 static inline void resize_region_in_place(region_t *region, int dx, int dy) {
 	return _resize_region(region, region, dx, dy);
 }
+
+/// Resize `region` into the existing region `output`
+static inline void resize_region_into(const region_t *region, region_t *output, int dx,
+                                      int dy) {
+	_resize_region(region, output, dx, dy);
+}
+
+/**
+ * Reduce the number of rectangles in a region to at most `max_rects`, by snapping
+ * every rectangle outwards onto a grid of `tile` x `tile` tiles, and merging
+ * neighbouring tiles in the same row. The tile size is doubled until the budget is
+ * met. The result always contains the original region.
+ *
+ * Heavily fragmented regions make every region operation slow, while painting a
+ * slightly bigger area is cheap.
+ */
+static inline void coarsen_region(region_t *region, int max_rects, int tile) {
+	int nrects;
+	const rect_t *rects = pixman_region32_rectangles(region, &nrects);
+	if (nrects <= max_rects) {
+		return;
+	}
+
+	const rect_t ext = *pixman_region32_extents(region);
+	for (;; tile *= 2) {
+		int cols = (ext.x2 - ext.x1 + tile - 1) / tile;
+		int rows = (ext.y2 - ext.y1 + tile - 1) / tile;
+		auto grid = ccalloc(cols * rows, bool);
+		for (int i = 0; i < nrects; i++) {
+			int c1 = (rects[i].x1 - ext.x1) / tile;
+			int c2 = (rects[i].x2 - ext.x1 + tile - 1) / tile;
+			int r1 = (rects[i].y1 - ext.y1) / tile;
+			int r2 = (rects[i].y2 - ext.y1 + tile - 1) / tile;
+			for (int r = r1; r < r2; r++) {
+				for (int c = c1; c < c2; c++) {
+					grid[r * cols + c] = true;
+				}
+			}
+		}
+
+		// Each row has at most (cols + 1) / 2 runs of covered tiles
+		auto runs = ccalloc(rows * ((cols + 1) / 2), rect_t);
+		int nruns = 0;
+		for (int r = 0; r < rows; r++) {
+			for (int c = 0; c < cols; c++) {
+				if (!grid[r * cols + c]) {
+					continue;
+				}
+				int start = c;
+				while (c < cols && grid[r * cols + c]) {
+					c++;
+				}
+				runs[nruns++] = (rect_t){
+				    .x1 = ext.x1 + start * tile,
+				    .y1 = ext.y1 + r * tile,
+				    .x2 = min2(ext.x1 + c * tile, ext.x2),
+				    .y2 = min2(ext.y1 + (r + 1) * tile, ext.y2),
+				};
+			}
+		}
+		free(grid);
+
+		if (nruns > max_rects && (cols > 1 || rows > 1)) {
+			free(runs);
+			continue;
+		}
+
+		// `rects` points into `region`, don't use it after this
+		pixman_region32_fini(region);
+		pixman_region32_init_rects(region, runs, nruns);
+		free(runs);
+		return;
+	}
+}
@@ -703,7 +703,10 @@ static bool win_build_shadow(session_t *ps, struct managed_win *w, double opacit
 	gc = x_new_id(ps->c);
 	xcb_create_gc(ps->c, gc, shadow_pixmap, 0, NULL);
 
-	xcb_image_put(ps->c, shadow_pixmap, gc, shadow_image, 0, 0, 0);
+	if (!x_put_image(ps->c, &ps->shm_pool, shadow_pixmap, gc, shadow_image, 0, 0)) {
+		log_error("failed to upload shadow image");
+		goto shadow_picture_err;
+	}
 	xcb_render_composite(ps->c, XCB_RENDER_PICT_OP_SRC, ps->cshadow_picture,
 	                     shadow_picture, shadow_picture_argb, 0, 0, 0, 0, 0, 0,
 	                     shadow_image->width, shadow_image->height);
@@ -991,13 +994,12 @@ void paint_all(session_t *ps, struct managed_win *t, bool ignore_damage) {
 	region_t region;
 	pixman_region32_init(&region);
 	int buffer_age = get_buffer_age(ps);
-	if (buffer_age == -1 || buffer_age > ps->ndamage || ignore_damage) {
+	if (buffer_age < 1 || buffer_age > ps->ndamage || ignore_damage) {
 		pixman_region32_copy(&region, &ps->screen_reg);
 	} else {
-		for (int i = 0; i < get_buffer_age(ps); i++) {
-			auto curr = ((ps->damage - ps->damage_ring) + i) % ps->ndamage;
-			pixman_region32_union(&region, &region, &ps->damage_ring[curr]);
-		}
+		auto curr =
+		    ((ps->damage - ps->damage_ring) + buffer_age - 1) % ps->ndamage;
+		pixman_region32_copy(&region, &ps->damage_ring[curr]);
 	}
 
 	if (!pixman_region32_not_empty(&region)) {
@@ -289,6 +289,8 @@ void add_damage_from_win(session_t *ps, const struct managed_win *w) {
 	win_extents(w, &extents);
 	add_damage(ps, &extents);
 	pixman_region32_fini(&extents);
+	// Not all window changes are captured by the render commands, be conservative
+	command_list_invalidate(&ps->last_frame_commands);
 }
 
 /// Release the images attached to this window
@@ -298,6 +300,12 @@ static inline void win_release_pixmap(backend_t *base, struct managed_win *w) {
 	if (w->win_image) {
 		base->ops->release_image(base, w->win_image);
 		w->win_image = NULL;
+		if (w->shape_mask) {
+			base->ops->release_image(base, w->shape_mask);
+			w->shape_mask = NULL;
+		}
+		base->ps->win_image_bytes -= w->pixmap_bytes;
+		w->pixmap_bytes = 0;
 		// Bypassing win_set_flags, because `w` might have been destroyed
 		w->flags |= WIN_FLAGS_PIXMAP_NONE;
 	}
@@ -308,11 +316,38 @@ static inline void win_release_shadow(backend_t *base, struct managed_win *w) {
 	if (w->shadow_image) {
 		base->ops->release_image(base, w->shadow_image);
 		w->shadow_image = NULL;
+		base->ps->win_image_bytes -= w->shadow_bytes;
+		w->shadow_bytes = 0;
 		// Bypassing win_set_flags, because `w` might have been destroyed
 		w->flags |= WIN_FLAGS_SHADOW_NONE;
 	}
 }
 
+/// Rebuild the mask of the bounding shape of `w`, which must have an image. Called when
+/// the image is bound, and whenever the bounding shape changes.
+static void win_update_shape_mask(struct backend_base *b, struct managed_win *w) {
+	// The mask is accounted in pixmap_bytes, next to the image
+	size_t image_bytes = 4 * (size_t)w->image_width * (size_t)w->image_height;
+	if (w->shape_mask) {
+		b->ops->release_image(b, w->shape_mask);
+		w->shape_mask = NULL;
+	}
+	b->ps->win_image_bytes -= w->pixmap_bytes - image_bytes;
+	w->pixmap_bytes = image_bytes;
+
+	// Painting with a clip region is expensive when it has a lot of rectangles,
+	// use a mask instead. 1 byte per pixel.
+	if (b->ops->make_mask &&
+	    pixman_region32_n_rects(&w->bounding_shape) > SHAPE_MASK_MIN_RECTS) {
+		w->shape_mask =
+		    b->ops->make_mask(b, w->widthb, w->heightb, &w->bounding_shape);
+	}
+	if (w->shape_mask) {
+		w->pixmap_bytes += (size_t)w->widthb * (size_t)w->heightb;
+		b->ps->win_image_bytes += (size_t)w->widthb * (size_t)w->heightb;
+	}
+}
+
 static inline bool win_bind_pixmap(struct backend_base *b, struct managed_win *w) {
 	assert(!w->win_image);
 	auto pixmap = x_new_id(b->c);
@@ -327,12 +362,20 @@ static inline bool win_bind_pixmap(struct backend_base *b, struct managed_win *w
 	log_debug("New named pixmap for %#010x (%s) : %#010x", w->base.id, w->name, pixmap);
 	w->win_image =
 	    b->ops->bind_pixmap(b, pixmap, x_get_visual_info(b->c, w->a.visual), true);
+	win_stats_add(&w->stats, WIN_STAT_REBINDS, 1);
 	if (!w->win_image) {
 		log_error("Failed to bind pixmap");
 		win_set_flags(w, WIN_FLAGS_IMAGE_ERROR);
 		return false;
 	}
 
+	// 4 bytes per pixel
+	w->image_width = w->widthb;
+	w->image_height = w->heightb;
+	w->pixmap_bytes = 4 * (size_t)w->widthb * (size_t)w->heightb;
+	b->ps->win_image_bytes += w->pixmap_bytes;
+	assert(!w->shape_mask);
+	win_update_shape_mask(b, w);
 	win_clear_flags(w, WIN_FLAGS_PIXMAP_NONE);
 	return true;
 }
@@ -353,6 +396,10 @@ bool win_bind_shadow(struct backend_base *b, struct managed_win *w, struct color
 	}
 
 	log_debug("New shadow for %#010x (%s)", w->base.id, w->name);
+	w->shadow_image_width = w->shadow_width;
+	w->shadow_image_height = w->shadow_height;
+	w->shadow_bytes = 4 * (size_t)w->shadow_width * (size_t)w->shadow_height;
+	b->ps->win_image_bytes += w->shadow_bytes;
 	win_clear_flags(w, WIN_FLAGS_SHADOW_NONE);
 	return true;
 }
@@ -374,6 +421,114 @@ void win_release_images(struct backend_base *backend, struct managed_win *w) {
 	}
 }
 
+static void win_update_images(session_t *ps, struct managed_win *w);
+
+void win_bind_deferred_images(session_t *ps, struct managed_win *w) {
+	assert(w->images_deferred);
+	if (w->state != WSTATE_MAPPING && w->state != WSTATE_MAPPED) {
+		// The pixmap can't be named anymore, the window can't be painted
+		log_debug("Not binding the images of window %#010x (%s), it's being "
+		          "unmapped",
+		          w->base.id, w->name);
+		return;
+	}
+	log_debug("Binding deferred images of window %#010x (%s)", w->base.id, w->name);
+	w->images_deferred = false;
+	// A shadow kept from before the window was unmapped can still be used
+	win_set_flags(w, WIN_FLAGS_PIXMAP_STALE);
+	if (win_check_flags_all(w, WIN_FLAGS_SHADOW_NONE)) {
+		win_set_flags(w, WIN_FLAGS_SHADOW_STALE);
+	}
+	win_update_images(ps, w);
+}
+
+bool win_is_occluded(const struct managed_win *w, const region_t *reg_ignore) {
+	region_t extents;
+	pixman_region32_init(&extents);
+	win_extents(w, &extents);
+	auto box = pixman_region32_extents(&extents);
+	bool ret = pixman_region32_contains_rectangle((region_t *)reg_ignore, box) ==
+	           PIXMAN_REGION_IN;
+	pixman_region32_fini(&extents);
+	return ret;
+}
+
+static int win_cmp_last_visible(const void *a, const void *b) {
+	auto wa = *(struct managed_win *const *)a;
+	auto wb = *(struct managed_win *const *)b;
+	if (wa->last_visible != wb->last_visible) {
+		return wa->last_visible < wb->last_visible ? -1 : 1;
+	}
+	return 0;
+}
+
+void win_evict_images(session_t *ps) {
+	auto budget = (size_t)ps->o.image_memory_budget * 1024 * 1024;
+	if (!ps->backend_data || budget == 0 || ps->win_image_bytes <= budget) {
+		return;
+	}
+
+	// Mapped windows that are not visible, and the shadows kept by unmapped
+	// windows. Windows with pending image updates, and those just bound ahead of
+	// time, are left alone.
+	int nwins;
+	auto wins = win_stack_managed(ps, &nwins);
+	auto candidates = ccalloc(nwins, struct managed_win *);
+	int ncandidates = 0;
+	for (int i = 0; i < nwins; i++) {
+		auto w = wins[i];
+		if (win_check_flags_any(w, WIN_FLAGS_IMAGES_STALE)) {
+			continue;
+		}
+		if ((w->state == WSTATE_MAPPED && !w->visible && !w->images_deferred &&
+		     !w->prefetched && w->pixmap_bytes + w->shadow_bytes > 0) ||
+		    (w->state == WSTATE_UNMAPPED && w->shadow_bytes > 0)) {
+			candidates[ncandidates++] = w;
+		}
+	}
+	qsort(candidates, (size_t)ncandidates, sizeof(*candidates), win_cmp_last_visible);
+
+	int nevicted = 0;
+	for (int i = 0; i < ncandidates && ps->win_image_bytes > budget; i++) {
+		auto w = candidates[i];
+		if (!win_check_flags_all(w, WIN_FLAGS_SHADOW_NONE)) {
+			win_release_shadow(ps->backend_data, w);
+		}
+		w->shadow_resize_pending = false;
+		if (w->state == WSTATE_UNMAPPED) {
+			// Mapping only rebinds the pixmap, the shadow is normally kept
+			win_set_flags(w, WIN_FLAGS_SHADOW_STALE);
+		} else {
+			if (!win_check_flags_all(w, WIN_FLAGS_PIXMAP_NONE)) {
+				win_release_pixmap(ps->backend_data, w);
+			}
+			w->images_deferred = true;
+		}
+		nevicted++;
+	}
+	free(candidates);
+
+	log_debug("Released the images of %d windows, %zu KiB of window images left",
+	          nevicted, ps->win_image_bytes / 1024);
+	if (ps->win_image_bytes > budget) {
+		log_debug("The visible windows alone exceed the image memory budget");
+	}
+}
+
+void win_finish_resize(session_t *ps, struct managed_win *w) {
+	if (w->resize_pending) {
+		w->resize_pending = false;
+		w->reg_ignore_valid = false;
+		win_set_flags(w, WIN_FLAGS_PIXMAP_STALE);
+	}
+	if (w->shadow_resize_pending) {
+		w->shadow_resize_pending = false;
+		win_set_flags(w, WIN_FLAGS_SHADOW_STALE);
+	}
+	ps->pending_updates = true;
+	add_damage_from_win(ps, w);
+}
+
 /// Returns true if the `prop` property is stale, as well as clears the stale flag.
 static bool win_fetch_and_unset_property_stale(struct managed_win *w, xcb_atom_t prop);
 /// Returns true if any of the properties are stale, as well as clear all the stale flags.
@@ -447,6 +602,12 @@ void win_process_update_flags(session_t *ps, struct managed_win *w) {
 		return;
 	}
 
+	if (win_check_flags_any(w, WIN_FLAGS_CLIENT_STALE | WIN_FLAGS_SIZE_STALE |
+	                               WIN_FLAGS_POSITION_STALE |
+	                               WIN_FLAGS_PROPERTY_STALE)) {
+		win_mark_changed(ps, w);
+	}
+
 	// Check client first, because later property updates need accurate client window
 	// information
 	if (win_check_flags_all(w, WIN_FLAGS_CLIENT_STALE)) {
@@ -513,7 +674,24 @@ void win_process_image_flags(session_t *ps, struct managed_win *w) {
 		// Flags of invisible windows are processed when they are mapped
 		return;
 	}
+	if (w->images_deferred) {
+		// Processed when the images are bound
+		return;
+	}
+	if (ps->backend_data && win_check_flags_all(w, WIN_FLAGS_PIXMAP_NONE) &&
+	    win_check_flags_any(w, WIN_FLAGS_IMAGES_STALE) &&
+	    !win_check_flags_all(w, WIN_FLAGS_IMAGE_ERROR)) {
+		// The window doesn't have an image yet. Many windows are mapped
+		// behind others, or off screen, and are never painted, so only bind
+		// the images when paint_preprocess finds the window visible.
+		w->images_deferred = true;
+		return;
+	}
+	win_update_images(ps, w);
+}
 
+/// Bind the stale images of a window, and clear the stale flags
+static void win_update_images(session_t *ps, struct managed_win *w) {
 	// Not a loop
 	while (win_check_flags_any(w, WIN_FLAGS_IMAGES_STALE) &&
 	       !win_check_flags_all(w, WIN_FLAGS_IMAGE_ERROR)) {
@@ -550,6 +728,9 @@ void win_process_image_flags(session_t *ps, struct managed_win *w) {
 			}
 		}
 
+		// Freshly bound images have new content
+		w->pixmap_damaged = true;
+
 		// break here, loop always run only once
 		break;
 	}
@@ -726,7 +907,8 @@ winmode_t win_calc_mode(session_t *ps, const struct managed_win *w) {
 		return WMODE_TRANS;
 	}
 
-	if (ps->o.backend == BKEND_GLX && w->corner_radius > 0) {
+	if ((ps->o.backend == BKEND_GLX || ps->o.backend == BKEND_PIXMAN) &&
+	    w->corner_radius > 0) {
 		return WMODE_TRANS;
 	}
 
@@ -1097,6 +1279,9 @@ static void win_determine_rounded_corners(session_t *ps, struct managed_win *w)
 		// we query the color in glx_round_corners_dst0 using glReadPixels
 		//w->border_col = { -1., -1, -1, -1 };
 		w->border_col[0] = w->border_col[1] = w->border_col[2] = w->border_col[3] = -1.0;
+#ifdef CONFIG_OPENGL
+		w->border_col_valid = false;
+#endif
 
 		// wintypes config section override
 		if (!safe_isnan(ps->o.wintype_option[w->window_type].corner_radius) &&
@@ -1184,12 +1369,19 @@ void win_on_factor_change(session_t *ps, struct managed_win *w) {
 	win_update_opacity_target(ps, w);
 
 	w->reg_ignore_valid = false;
+	win_mark_changed(ps, w);
+}
+
+void win_mark_changed(session_t *ps, struct managed_win *w) {
+	w->generation = ++ps->win_generation;
 }
 
 /**
  * Update cache data in struct _win that depends on window size.
  */
 void win_on_win_size_change(session_t *ps, struct managed_win *w) {
+	bool resized = w->widthb != w->g.width + w->g.border_width * 2 ||
+	               w->heightb != w->g.height + w->g.border_width * 2;
 	w->widthb = w->g.width + w->g.border_width * 2;
 	w->heightb = w->g.height + w->g.border_width * 2;
 	w->shadow_dx = ps->o.shadow_offset_x;
@@ -1201,10 +1393,43 @@ void win_on_win_size_change(session_t *ps, struct managed_win *w) {
 	assert(w->state != WSTATE_UNMAPPED && w->state != WSTATE_DESTROYING &&
 	       w->state != WSTATE_UNMAPPING);
 
-	// Invalidate the shadow we built
-	win_set_flags(w, WIN_FLAGS_IMAGES_STALE);
 	ps->pending_updates = true;
 	free_paint(ps, &w->shadow_paint);
+	if (ps->backend_data && w->state == WSTATE_MAPPED &&
+	    !win_check_flags_all(w, WIN_FLAGS_PIXMAP_NONE)) {
+		// During an interactive resize, the window is resized many times per
+		// frame. Keep drawing the old image until the client redraws the window
+		// (see repair_win), and only rebuild the shadow once the resize settles.
+		// If only the shape changed, the images are still good.
+		if (!resized) {
+			return;
+		}
+		w->last_resize = get_time_ms();
+		if (win_check_flags_all(w, WIN_FLAGS_SHADOW_NONE)) {
+			win_set_flags(w, WIN_FLAGS_SHADOW_STALE);
+		} else {
+			w->shadow_resize_pending = true;
+		}
+		return;
+	}
+
+	// Invalidate the images we built
+	w->resize_pending = false;
+	w->shadow_resize_pending = false;
+	win_set_flags(w, WIN_FLAGS_IMAGES_STALE);
+}
+
+/**
+ * Update cache data in struct _win that depends on the shadow options, and rebuild the
+ * shadow of the window.
+ */
+void win_on_shadow_options_change(session_t *ps, struct managed_win *w) {
+	w->shadow_dx = ps->o.shadow_offset_x;
+	w->shadow_dy = ps->o.shadow_offset_y;
+	w->shadow_width = w->widthb + ps->o.shadow_radius * 2;
+	w->shadow_height = w->heightb + ps->o.shadow_radius * 2;
+	win_set_flags(w, WIN_FLAGS_SHADOW_STALE);
+	ps->pending_updates = true;
 }
 
 /**
@@ -1387,6 +1612,7 @@ void free_win_res(session_t *ps, struct managed_win *w) {
 	// Except when we are called by session_destroy
 
 	pixman_region32_fini(&w->bounding_shape);
+	pixman_region32_fini(&w->pixmap_damage);
 	// BadDamage may be thrown if the window is destroyed
 	set_ignore_cookie(ps, xcb_damage_destroy(ps->c, w->damage));
 	rc_region_unref(&w->reg_ignore);
@@ -1400,6 +1626,11 @@ void free_win_res(session_t *ps, struct managed_win *w) {
 	w->stale_props_capacity = 0;
 }
 
+/// Mark the array of managed windows out of date, after the window stack changed
+static inline void win_stack_changed(session_t *ps) {
+	ps->managed_stack_valid = false;
+}
+
 /// Insert a new window after list_node `prev`
 /// New window will be in unmapped state
 static struct win *add_win(session_t *ps, xcb_window_t id, struct list_node *prev) {
@@ -1445,10 +1676,29 @@ struct win *add_win_above(session_t *ps, xcb_window_t id, xcb_window_t below) {
 	}
 }
 
+/// Send the requests for the information `fill_win` needs about window `wid`
+struct win_prefetch win_send_prefetch(session_t *ps, xcb_window_t wid) {
+	return (struct win_prefetch){
+	    .attributes = xcb_get_window_attributes(ps->c, wid),
+	    .geometry = xcb_get_geometry(ps->c, wid),
+	};
+}
+
+static void win_discard_prefetch(session_t *ps, const struct win_prefetch *p) {
+	xcb_discard_reply(ps->c, p->attributes.sequence);
+	xcb_discard_reply(ps->c, p->geometry.sequence);
+}
+
 /// Query the Xorg for information about window `win`
 /// `win` pointer might become invalid after this function returns
 /// Returns the pointer to the window, might be different from `w`
 struct win *fill_win(session_t *ps, struct win *w) {
+	auto prefetch = win_send_prefetch(ps, w->id);
+	return fill_win_prefetched(ps, w, &prefetch);
+}
+
+struct win *
+fill_win_prefetched(session_t *ps, struct win *w, const struct win_prefetch *prefetch) {
 	static const struct managed_win win_def = {
 	    // No need to initialize. (or, you can think that
 	    // they are initialized right here).
@@ -1540,6 +1790,7 @@ struct win *fill_win(session_t *ps, struct win *w) {
 
 	// Reject overlay window and already added windows
 	if (w->id == ps->overlay) {
+		win_discard_prefetch(ps, prefetch);
 		return w;
 	}
 
@@ -1547,14 +1798,15 @@ struct win *fill_win(session_t *ps, struct win *w) {
 	if (duplicated_win) {
 		log_debug("Window %#010x (recorded name: %s) added multiple times", w->id,
 		          duplicated_win->name);
+		win_discard_prefetch(ps, prefetch);
 		return &duplicated_win->base;
 	}
 
 	log_debug("Managing window %#010x", w->id);
-	xcb_get_window_attributes_cookie_t acookie = xcb_get_window_attributes(ps->c, w->id);
 	xcb_get_window_attributes_reply_t *a =
-	    xcb_get_window_attributes_reply(ps->c, acookie, NULL);
+	    xcb_get_window_attributes_reply(ps->c, prefetch->attributes, NULL);
 	if (!a || a->map_state == XCB_MAP_STATE_UNVIEWABLE) {
+		xcb_discard_reply(ps->c, prefetch->geometry.sequence);
 		// Failed to get window attributes or geometry probably means
 		// the window is gone already. Unviewable means the window is
 		// already reparented elsewhere.
@@ -1567,6 +1819,7 @@ struct win *fill_win(session_t *ps, struct win *w) {
 	if (a->_class == XCB_WINDOW_CLASS_INPUT_ONLY) {
 		// No need to manage this window, but we still keep it on the window stack
 		w->managed = false;
+		xcb_discard_reply(ps->c, prefetch->geometry.sequence);
 		free(a);
 		return w;
 	}
@@ -1583,11 +1836,12 @@ struct win *fill_win(session_t *ps, struct win *w) {
 	new->base.managed = true;
 	new->a = *a;
 	pixman_region32_init(&new->bounding_shape);
+	pixman_region32_init(&new->pixmap_damage);
 
 	free(a);
 
 	xcb_generic_error_t *e;
-	auto g = xcb_get_geometry_reply(ps->c, xcb_get_geometry(ps->c, w->id), &e);
+	auto g = xcb_get_geometry_reply(ps->c, prefetch->geometry, &e);
 	if (!g) {
 		log_error_x_error(e, "Failed to get geometry of window %#010x", w->id);
 		free(e);
@@ -1628,8 +1882,10 @@ struct win *fill_win(session_t *ps, struct win *w) {
 
 	new->pictfmt = x_get_pictform_for_visual(ps->c, new->a.visual);
 	new->client_pictfmt = NULL;
+	win_mark_changed(ps, new);
 
 	list_replace(&w->stack_neighbour, &new->base.stack_neighbour);
+	win_stack_changed(ps);
 	struct win *replaced = NULL;
 	HASH_REPLACE_INT(ps->windows, id, &new->base, replaced);
 	assert(replaced == w);
@@ -1921,9 +2177,13 @@ void win_update_bounding_shape(session_t *ps, struct managed_win *w) {
 		w->rounded_corners = win_has_rounded_corners(w);
 	}
 
-	// Window shape changed, we should free old wpaint and shadow pict
-	// log_trace("free out dated pict");
-	win_set_flags(w, WIN_FLAGS_IMAGES_STALE);
+	// Window shape changed. The images are already marked stale by
+	// win_on_win_size_change, unless the window keeps its image through a resize, or
+	// only the shape changed. The image is still good then, but the mask isn't.
+	if (ps->backend_data &&
+	    !win_check_flags_any(w, WIN_FLAGS_PIXMAP_NONE | WIN_FLAGS_PIXMAP_STALE)) {
+		win_update_shape_mask(ps->backend_data, w);
+	}
 	ps->pending_updates = true;
 
 	free_paint(ps, &w->paint);
@@ -2035,6 +2295,18 @@ static void unmap_win_finish(session_t *ps, struct managed_win *w) {
 	w->reg_ignore_valid = false;
 	w->state = WSTATE_UNMAPPED;
 
+	if (w->images_deferred) {
+		// Mapping only rebinds the pixmap, the shadow is normally kept
+		w->images_deferred = false;
+		win_set_flags(w, WIN_FLAGS_SHADOW_STALE);
+	}
+	if (w->shadow_resize_pending) {
+		// The shadow kept for the next map has the wrong size
+		w->shadow_resize_pending = false;
+		win_set_flags(w, WIN_FLAGS_SHADOW_STALE);
+	}
+	w->resize_pending = false;
+
 	// We are in unmap_win, this window definitely was viewable
 	if (ps->backend_data) {
 		// Only the pixmap needs to be freed and reacquired when mapping.
@@ -2061,6 +2333,7 @@ static void destroy_win_finish(session_t *ps, struct win *w) {
 
 	auto next_w = win_stack_find_next_managed(ps, &w->stack_neighbour);
 	list_remove(&w->stack_neighbour);
+	win_stack_changed(ps);
 
 	if (w->managed) {
 		auto mw = (struct managed_win *)w;
@@ -2143,6 +2416,7 @@ static inline void restack_win(session_t *ps, struct win *w, struct list_node *n
 	}
 
 	list_move_before(&w->stack_neighbour, next);
+	win_stack_changed(ps);
 
 	// add damage for this window
 	if (mw) {
@@ -2310,6 +2584,7 @@ void unmap_win_start(session_t *ps, struct managed_win *w) {
 	w->state = WSTATE_UNMAPPING;
 	w->opacity_target_old = fmax(w->opacity_target, w->opacity_target_old);
 	w->opacity_target = win_calc_opacity_target(ps, w);
+	win_mark_changed(ps, w);
 
 #ifdef CONFIG_DBUS
 	// Send D-Bus signal
@@ -2339,6 +2614,7 @@ bool win_check_fade_finished(session_t *ps, struct managed_win *w) {
 		return false;
 	}
 	if (w->opacity == w->opacity_target) {
+		win_mark_changed(ps, w);
 		switch (w->state) {
 		case WSTATE_UNMAPPING: unmap_win_finish(ps, w); return false;
 		case WSTATE_DESTROYING: destroy_win_finish(ps, &w->base); return true;
@@ -2444,6 +2720,7 @@ void map_win_start(session_t *ps, struct managed_win *w) {
 	w->state = WSTATE_MAPPING;
 	w->opacity_target_old = 0;
 	w->opacity_target = win_calc_opacity_target(ps, w);
+	win_mark_changed(ps, w);
 
 	log_debug("Window %#010x has opacity %f, opacity target is %f", w->base.id,
 	          w->opacity, w->opacity_target);
@@ -2781,6 +3058,24 @@ win_stack_find_next_managed(const session_t *ps, const struct list_node *i) {
 	return NULL;
 }
 
+struct managed_win **win_stack_managed(session_t *ps, int *count) {
+	if (!ps->managed_stack_valid) {
+		ps->managed_stack_len = 0;
+		win_stack_foreach_managed(w, &ps->window_stack) {
+			if (ps->managed_stack_len == ps->managed_stack_capacity) {
+				ps->managed_stack_capacity =
+				    max2(ps->managed_stack_capacity * 2, 64);
+				ps->managed_stack = crealloc(ps->managed_stack,
+				                             ps->managed_stack_capacity);
+			}
+			ps->managed_stack[ps->managed_stack_len++] = w;
+		}
+		ps->managed_stack_valid = true;
+	}
+	*count = ps->managed_stack_len;
+	return ps->managed_stack;
+}
+
 /// Return whether this window is mapped on the X server side
 bool win_is_mapped_in_x(const struct managed_win *w) {
 	return w->state == WSTATE_MAPPING || w->state == WSTATE_FADING ||
@@ -12,6 +12,7 @@
 // FIXME shouldn't need this
 #ifdef CONFIG_OPENGL
 #include <GL/gl.h>
+#include <GL/glext.h>
 #endif
 
 #include "c2.h"
@@ -22,6 +23,7 @@
 #include "types.h"
 #include "utils.h"
 #include "win_defs.h"
+#include "win_stats.h"
 #include "x.h"
 
 struct backend_base;
@@ -104,6 +106,10 @@ struct managed_win {
 	/// `state` is not UNMAPPED
 	void *win_image;
 	void *shadow_image;
+	/// Mask of the bounding shape, used in place of the bounding shape when it has
+	/// more than SHAPE_MASK_MIN_RECTS rectangles. NULL otherwise, or if the backend
+	/// doesn't support masks. Only available when `win_image` is.
+	void *shape_mask;
 	/// Pointer to the next higher window to paint.
 	struct managed_win *prev_trans;
 	/// Number of windows above this window
@@ -114,32 +120,36 @@ struct managed_win {
 	/// The "mapped state" of this window, doesn't necessary
 	/// match X mapped state, because of fading.
 	winstate_t state;
-	/// Window attributes.
-	xcb_get_window_attributes_reply_t a;
 	/// The geometry of the window body, excluding the window border region.
 	struct win_geometry g;
 	/// Updated geometry received in events
 	struct win_geometry pending_g;
+	/// Value of the session's window generation counter when the state reported to
+	/// D-Bus clients last changed. See `win_mark_changed`.
+	uint64_t generation;
+	/// How much work the window causes
+	struct win_stats stats;
 	/// Xinerama screen this window is on.
 	int xinerama_scr;
-	/// Window visual pict format
-	const xcb_render_pictforminfo_t *pictfmt;
-	/// Client window visual pict format
-	const xcb_render_pictforminfo_t *client_pictfmt;
 	/// Window painting mode.
 	winmode_t mode;
 	/// Whether the window has been damaged at least once.
 	bool ever_damaged;
 	/// Whether the window was damaged after last paint.
 	bool pixmap_damaged;
+	/// Part of the window pixmap damaged since it was last handed to the backend,
+	/// in pixmap coordinates. Only tracked if the backend has `image_damaged`.
+	region_t pixmap_damage;
 	/// Damage of the window.
 	xcb_damage_damage_t damage;
-	/// Paint info of the window.
-	paint_t paint;
-	/// bitmap for properties which needs to be updated
-	uint64_t *stale_props;
-	/// number of uint64_ts that has been allocated for stale_props
-	uint64_t stale_props_capacity;
+	/// Damage events, damaged rectangles and damaged pixels received since
+	/// `damage_period_start`, in milliseconds. Used to decide `coarse_damage`.
+	unsigned int damage_period_events, damage_period_rects;
+	double damage_period_pixels;
+	int64_t damage_period_start;
+	/// Whether the window is updated so often that the damaged region isn't fetched
+	/// from the X server, and the whole window is considered damaged instead.
+	bool coarse_damage;
 
 	/// Bounding shape of the window. In local coordinates.
 	/// See above about coordinate systems.
@@ -164,6 +174,35 @@ struct managed_win {
 	bool rounded_corners;
 	/// Whether this window is to be painted.
 	bool to_paint;
+	/// Whether part of the window was visible in the last frame, i.e. it's painted
+	/// and not covered by the windows above. Only tracked with
+	/// --image-memory-budget.
+	bool visible;
+	/// When the window was last visible, in milliseconds
+	int64_t last_visible;
+	/// Whether binding the images of the window is put off until it's visible.
+	/// Either the window hasn't been visible since it was mapped, or its images
+	/// were released to stay under --image-memory-budget. Image flags are not
+	/// processed meanwhile.
+	bool images_deferred;
+	/// Whether the images were bound ahead of time in the current frame, before the
+	/// window is visible. Such images are not released in the same frame.
+	bool prefetched;
+	/// Estimated memory used by win_image and shape_mask, and by shadow_image, in
+	/// bytes
+	size_t pixmap_bytes, shadow_bytes;
+	/// Sizes of `win_image` and `shadow_image`. They keep the sizes from before the
+	/// resize while `resize_pending` and `shadow_resize_pending` are set.
+	int image_width, image_height;
+	int shadow_image_width, shadow_image_height;
+	/// Whether the window was resized, and the client hasn't redrawn it since. The
+	/// image from before the resize is drawn meanwhile.
+	bool resize_pending;
+	/// Whether the shadow still has the size from before the window was resized.
+	/// It's rebuilt once the resize settles.
+	bool shadow_resize_pending;
+	/// When the window was last resized, in milliseconds
+	int64_t last_resize;
 	/// Whether the window is painting excluded.
 	bool paint_excluded;
 	/// Whether the window is unredirect-if-possible excluded.
@@ -191,16 +230,6 @@ struct managed_win {
 	/// Override value of window focus state. Set by D-Bus method calls.
 	switch_t focused_force;
 
-	// Blacklist related members
-	/// Name of the window.
-	char *name;
-	/// Window instance class of the window.
-	char *class_instance;
-	/// Window general class of the window.
-	char *class_general;
-	/// <code>WM_WINDOW_ROLE</code> value of the window.
-	char *role;
-
 	// Opacity-related members
 	/// Current window opacity.
 	double opacity;
@@ -253,8 +282,6 @@ struct managed_win {
 	int shadow_width;
 	/// Height of shadow. Affected by window size and commandline argument.
 	int shadow_height;
-	/// Picture to render shadow. Affected by window size.
-	paint_t shadow_paint;
 	/// The value of _COMPTON_SHADOW attribute of the window. Below 0 for
 	/// none.
 	long prop_shadow;
@@ -272,12 +299,53 @@ struct managed_win {
 	/// Whether to blur window background.
 	bool blur_background;
 
+	// Cold members
+	// Everything above is used for every window on the stack in every frame. The
+	// members below are only used when a window's properties change, or by the
+	// legacy backends, so they are kept out of the way of the stack traversals.
+
+	/// Window attributes.
+	xcb_get_window_attributes_reply_t a;
+	/// Window visual pict format
+	const xcb_render_pictforminfo_t *pictfmt;
+	/// Client window visual pict format
+	const xcb_render_pictforminfo_t *client_pictfmt;
+	/// Paint info of the window.
+	paint_t paint;
+	/// bitmap for properties which needs to be updated
+	uint64_t *stale_props;
+	/// number of uint64_ts that has been allocated for stale_props
+	uint64_t stale_props_capacity;
+	/// Picture to render shadow. Affected by window size.
+	paint_t shadow_paint;
+
+	// Blacklist related members
+	/// Name of the window.
+	char *name;
+	/// Window instance class of the window.
+	char *class_instance;
+	/// Window general class of the window.
+	char *class_general;
+	/// <code>WM_WINDOW_ROLE</code> value of the window.
+	char *role;
+
 #ifdef CONFIG_OPENGL
 	/// Textures and FBO background blur use.
 	glx_blur_cache_t glx_blur_cache;
 	glx_blur_cache_t glx_round_cache;
 	/// Background texture of the window
 	glx_texture_t *glx_texture_bg;
+	/// Pixel buffer the border color is read back into, so reading it doesn't
+	/// stall the rendering
+	GLuint border_pbo;
+	/// Signaled when the read back into border_pbo is done. NULL if there is no
+	/// read back in flight.
+	GLsync border_fence;
+	/// Whether border_col is up to date, otherwise it's sampled again
+	bool border_col_valid;
+	/// Where, and at which opacity, border_col was last sampled. In X coordinates.
+	int border_sample_x, border_sample_y;
+	double border_sample_opacity;
 #endif
 };
 
@@ -304,6 +372,18 @@ bool must_use destroy_win_start(session_t *ps, struct win *w);
 /// Release images bound with a window, set the *_NONE flags on the window. Only to be
 /// used when de-initializing the backend outside of win.c
 void win_release_images(struct backend_base *base, struct managed_win *w);
+/// Bind the images of a window with `images_deferred` set, because it became visible,
+/// or to have them ready before it does. Sets WIN_FLAGS_IMAGE_ERROR on failure.
+void win_bind_deferred_images(session_t *ps, struct managed_win *w);
+/// Whether the window is fully covered by `reg_ignore`, the region covered by the
+/// opaque windows above it.
+bool win_is_occluded(const struct managed_win *w, const region_t *reg_ignore);
+/// Release the images of the windows that were not visible for the longest time,
+/// until the memory used by window images is under --image-memory-budget.
+void win_evict_images(session_t *ps);
+/// Rebind the image and rebuild the shadow of a window that stopped being resized,
+/// even if the client hasn't redrawn it.
+void win_finish_resize(session_t *ps, struct managed_win *w);
 winmode_t attr_pure win_calc_mode(session_t *ps, const struct managed_win *w);
 void win_set_shadow_force(session_t *ps, struct managed_win *w, switch_t val);
 void win_set_fade_force(struct managed_win *w, switch_t val);
@@ -315,10 +395,18 @@ void win_set_invert_color_force(session_t *ps, struct managed_win *w, switch_t v
 void win_set_focused(session_t *ps, struct managed_win *w);
 bool attr_pure win_should_fade(session_t *ps, const struct managed_win *w);
 void win_on_factor_change(session_t *ps, struct managed_win *w);
+/// Record that the state of the window reported to D-Bus clients has changed, by
+/// giving it a new generation
+void win_mark_changed(session_t *ps, struct managed_win *w);
 /**
  * Update cache data in struct _win that depends on window size.
  */
 void win_on_win_size_change(session_t *ps, struct managed_win *w);
+/**
+ * Update cache data in struct _win that depends on the shadow options, and rebuild the
+ * shadow of the window.
+ */
+void win_on_shadow_options_change(session_t *ps, struct managed_win *w);
 void win_unmark_client(session_t *ps, struct managed_win *w);
 void win_recheck_client(session_t *ps, struct managed_win *w);
 
@@ -383,6 +471,20 @@ struct win *add_win_top(session_t *ps, xcb_window_t id);
 /// Query the Xorg for information about window `win`
 /// `win` pointer might become invalid after this function returns
 struct win *fill_win(session_t *ps, struct win *win);
+
+/// Requests for the information `fill_win` needs about a window. Sending them for many
+/// windows before waiting for any reply makes their round trips overlap.
+struct win_prefetch {
+	xcb_get_window_attributes_cookie_t attributes;
+	xcb_get_geometry_cookie_t geometry;
+};
+
+/// Send the requests for the information `fill_win` needs about window `wid`
+struct win_prefetch win_send_prefetch(session_t *ps, xcb_window_t wid);
+/// Same as `fill_win`, but use the replies to requests sent by `win_send_prefetch`.
+/// The replies are always consumed.
+struct win *
+fill_win_prefetched(session_t *ps, struct win *win, const struct win_prefetch *prefetch);
 /// Move window `w` to be right above `below`
 void restack_above(session_t *ps, struct win *w, xcb_window_t below);
 /// Move window `w` to the bottom of the stack
@@ -442,6 +544,11 @@ bool win_is_mapped_in_x(const struct managed_win *w);
 // Find the managed window immediately below `w` in the window stack
 struct managed_win *attr_pure win_stack_find_next_managed(const session_t *ps,
                                                           const struct list_node *w);
+/// Get the managed windows in the window stack, from top to bottom, as an array. The
+/// array is valid until windows are added to, removed from or moved in the stack.
+/// Prefer this over walking the stack in loops that run every frame, since the
+/// stack also links the unmanaged windows, and every step is a pointer chase.
+struct managed_win **win_stack_managed(session_t *ps, int *count);
 /// Set flags on a window. Some sanity checks are performed
 void win_set_flags(struct managed_win *w, uint64_t flags);
 /// Clear flags on a window. Some sanity checks are performed
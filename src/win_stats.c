@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (c) Yuxuan Shui <yshuiv7@gmail.com>
+
+#include <math.h>
+#include <test.h>
+#include <time.h>
+
+#include "win_stats.h"
+
+/// How long it takes for the rates to forget about past activity, in seconds
+#define WIN_STATS_TIME_CONSTANT 10.0
+
+const char *const WIN_STAT_NAMES[NUM_WIN_STATS] = {
+    [WIN_STAT_DAMAGE_EVENTS] = "damage_events",
+    [WIN_STAT_DAMAGED_PIXELS] = "damaged_pixels",
+    [WIN_STAT_BLUR_TIME] = "blur_ms",
+    [WIN_STAT_COMPOSE_TIME] = "compose_ms",
+    [WIN_STAT_SHADOW_TIME] = "shadow_ms",
+    [WIN_STAT_REBINDS] = "rebinds",
+};
+
+void win_stats_add_time(struct win_stats *s, enum win_stat stat, struct timespec start) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	s->pending[stat] += (double)(now.tv_sec - start.tv_sec) * 1000.0 +
+	                    (double)(now.tv_nsec - start.tv_nsec) / 1000000.0;
+}
+
+void win_stats_update(struct win_stats *s, double interval) {
+	if (interval <= 0) {
+		return;
+	}
+	double alpha = 1 - exp(-interval / WIN_STATS_TIME_CONSTANT);
+	for (int i = 0; i < NUM_WIN_STATS; i++) {
+		s->rate[i] += alpha * (s->pending[i] / interval - s->rate[i]);
+		s->pending[i] = 0;
+	}
+}
+
+TEST_CASE(win_stats_update) {
+	struct win_stats s = {0};
+	win_stats_add(&s, WIN_STAT_DAMAGE_EVENTS, 10);
+	win_stats_update(&s, 1);
+	double alpha = 1 - exp(-1 / WIN_STATS_TIME_CONSTANT);
+	TEST_TRUE(fabs(s.rate[WIN_STAT_DAMAGE_EVENTS] - alpha * 10) < 1e-9);
+	TEST_EQUAL(s.pending[WIN_STAT_DAMAGE_EVENTS], 0);
+	TEST_EQUAL(s.rate[WIN_STAT_REBINDS], 0);
+
+	// Nothing is folded in over an empty interval
+	win_stats_add(&s, WIN_STAT_DAMAGE_EVENTS, 10);
+	win_stats_update(&s, 0);
+	TEST_EQUAL(s.pending[WIN_STAT_DAMAGE_EVENTS], 10);
+	TEST_TRUE(fabs(s.rate[WIN_STAT_DAMAGE_EVENTS] - alpha * 10) < 1e-9);
+
+	// A steady rate is reached regardless of how often the rates are updated
+	s = (struct win_stats){0};
+	for (int i = 0; i < 1000; i++) {
+		win_stats_add(&s, WIN_STAT_COMPOSE_TIME, 2);
+		win_stats_update(&s, 0.5);
+	}
+	TEST_TRUE(fabs(s.rate[WIN_STAT_COMPOSE_TIME] - 4) < 1e-6);
+	TEST_TRUE(fabs(win_stats_paint_time(&s) - 4) < 1e-6);
+}
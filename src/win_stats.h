@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (c) Yuxuan Shui <yshuiv7@gmail.com>
+
+#pragma once
+
+#include <time.h>
+
+enum win_stat {
+	/// Number of damage events received from the window
+	WIN_STAT_DAMAGE_EVENTS,
+	/// Number of pixels the window reported as damaged
+	WIN_STAT_DAMAGED_PIXELS,
+	/// Milliseconds spent blurring the background of the window
+	WIN_STAT_BLUR_TIME,
+	/// Milliseconds spent painting the window itself, including rounding its corners
+	WIN_STAT_COMPOSE_TIME,
+	/// Milliseconds spent painting the shadow of the window
+	WIN_STAT_SHADOW_TIME,
+	/// Number of times the pixmap of the window was bound
+	WIN_STAT_REBINDS,
+	NUM_WIN_STATS,
+};
+
+extern const char *const WIN_STAT_NAMES[NUM_WIN_STATS];
+
+/// Counters for finding out which windows cost the most to composite. Times are the
+/// CPU time spent issuing the rendering commands, which for the GPU backends doesn't
+/// include the time the GPU spends running them.
+struct win_stats {
+	/// Accumulated since the last `win_stats_update`
+	double pending[NUM_WIN_STATS];
+	/// Per second, as an exponential moving average
+	double rate[NUM_WIN_STATS];
+};
+
+static inline void win_stats_add(struct win_stats *s, enum win_stat stat, double value) {
+	s->pending[stat] += value;
+}
+
+/// Add the time passed since `start` to a time counter
+void win_stats_add_time(struct win_stats *s, enum win_stat stat, struct timespec start);
+
+/// Fold the counters accumulated over the last `interval` seconds into the rates
+void win_stats_update(struct win_stats *s, double interval);
+
+/// Milliseconds per second spent painting the window, its shadow and its background
+static inline double win_stats_paint_time(const struct win_stats *s) {
+	return s->rate[WIN_STAT_BLUR_TIME] + s->rate[WIN_STAT_COMPOSE_TIME] +
+	       s->rate[WIN_STAT_SHADOW_TIME];
+}
@@ -1,8 +1,14 @@
 // SPDX-License-Identifier: MPL-2.0
 // Copyright (c) 2018 Yuxuan Shui <yshuiv7@gmail.com>
+#include <errno.h>
+#include <inttypes.h>
 #include <stdalign.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <unistd.h>
 
 #include <X11/Xutil.h>
 #include <pixman.h>
@@ -10,8 +16,10 @@
 #include <xcb/damage.h>
 #include <xcb/glx.h>
 #include <xcb/render.h>
+#include <xcb/shm.h>
 #include <xcb/sync.h>
 #include <xcb/xcb.h>
+#include <xcb/xcb_image.h>
 #include <xcb/xcb_renderutil.h>
 #include <xcb/xfixes.h>
 
@@ -746,3 +754,160 @@ xcb_screen_t *x_screen_of_display(xcb_connection_t *c, int screen) {
 
 	return NULL;
 }
+
+void x_shm_pool_init(xcb_connection_t *c, struct x_shm_pool *pool) {
+	*pool = (struct x_shm_pool){0};
+	auto ext_info = xcb_get_extension_data(c, &xcb_shm_id);
+	pool->enabled = ext_info && ext_info->present;
+	if (!pool->enabled) {
+		log_info("No MIT-SHM extension, images will be uploaded with PutImage.");
+	}
+}
+
+void x_shm_segment_wait(xcb_connection_t *c, struct x_shm_segment *seg) {
+	if (seg->busy) {
+		free(xcb_get_input_focus_reply(c, seg->fence, NULL));
+		seg->busy = false;
+	}
+}
+
+void x_shm_segment_destroy(xcb_connection_t *c, struct x_shm_segment *seg) {
+	x_shm_segment_wait(c, seg);
+	xcb_shm_detach(c, seg->seg);
+	shmdt(seg->addr);
+	*seg = (struct x_shm_segment){0};
+}
+
+bool x_shm_segment_create(xcb_connection_t *c, struct x_shm_segment *seg, size_t size,
+                          bool read_only) {
+	int shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+	if (shmid < 0) {
+		log_error_errno("Failed to create shared memory segment of %zu bytes",
+		                size);
+		return false;
+	}
+	void *addr = shmat(shmid, NULL, 0);
+	if (addr == (void *)-1) {
+		log_error_errno("Failed to attach shared memory segment");
+		shmctl(shmid, IPC_RMID, NULL);
+		return false;
+	}
+
+	auto xseg = x_new_id(c);
+	auto e = xcb_request_check(
+	    c, xcb_shm_attach_checked(c, xseg, (uint32_t)shmid, read_only));
+	// The segment is destroyed once both of us detached from it
+	shmctl(shmid, IPC_RMID, NULL);
+	if (e) {
+		log_error_x_error(e, "Failed to attach shared memory segment to the X "
+		                     "server");
+		free(e);
+		shmdt(addr);
+		return false;
+	}
+
+	*seg = (struct x_shm_segment){.seg = xseg, .addr = addr, .size = size};
+	return true;
+}
+
+/// Get a segment that can hold `size` bytes, and is not in use by the X server
+static struct x_shm_segment *
+x_shm_pool_get_segment(xcb_connection_t *c, struct x_shm_pool *pool, size_t size) {
+	struct x_shm_segment *ret = NULL;
+	for (int i = 0; i < pool->nsegments; i++) {
+		auto seg = &pool->segments[i];
+		if (seg->size >= size && (!ret || seg->size < ret->size)) {
+			ret = seg;
+		}
+	}
+	if (ret) {
+		x_shm_segment_wait(c, ret);
+		return ret;
+	}
+
+	if (pool->nsegments < X_SHM_POOL_SIZE) {
+		ret = &pool->segments[pool->nsegments];
+	} else {
+		// Replace the smallest segment, it's the least useful one
+		ret = &pool->segments[0];
+		for (int i = 1; i < pool->nsegments; i++) {
+			if (pool->segments[i].size < ret->size) {
+				ret = &pool->segments[i];
+			}
+		}
+		x_shm_segment_destroy(c, ret);
+		pool->nsegments--;
+		*ret = pool->segments[pool->nsegments];
+		ret = &pool->segments[pool->nsegments];
+	}
+
+	// Round up to reduce the number of times segments are replaced
+	size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+	size = (size + page_size * 16 - 1) / (page_size * 16) * (page_size * 16);
+	if (!x_shm_segment_create(c, ret, size, true)) {
+		return NULL;
+	}
+	pool->nsegments++;
+	return ret;
+}
+
+void x_shm_pool_deinit(xcb_connection_t *c, struct x_shm_pool *pool) {
+	for (int i = 0; i < pool->nsegments; i++) {
+		x_shm_segment_destroy(c, &pool->segments[i]);
+	}
+	log_debug("Uploaded %" PRIu64 " bytes through MIT-SHM, %" PRIu64
+	          " bytes through PutImage",
+	          pool->shm_bytes, pool->put_image_bytes);
+	*pool = (struct x_shm_pool){0};
+}
+
+bool x_put_image(xcb_connection_t *c, struct x_shm_pool *pool, xcb_drawable_t drawable,
+                 xcb_gcontext_t gc, xcb_image_t *image, int16_t x, int16_t y) {
+	if (pool && pool->enabled) {
+		auto seg = x_shm_pool_get_segment(c, pool, image->size);
+		if (seg) {
+			memcpy(seg->addr, image->data, image->size);
+			xcb_shm_put_image(c, drawable, gc, image->width,
+			                  image->height, 0, 0, image->width,
+			                  image->height, x, y, image->depth,
+			                  (uint8_t)image->format, 0, seg->seg, 0);
+			seg->fence = xcb_get_input_focus(c);
+			seg->busy = true;
+			pool->shm_bytes += image->size;
+			return true;
+		}
+		// Most likely the server can't access our memory, e.g. it's remote
+		log_warn("Failed to use MIT-SHM, falling back to PutImage.");
+		pool->enabled = false;
+	}
+
+	// We need to make room for protocol metadata in the request. The metadata should
+	// be 24 bytes plus padding, let's be generous and give it 1kb
+	auto maximum_image_size = xcb_get_maximum_request_length(c) * 4 - 1024;
+	auto maximum_row =
+	    to_u16_checked(clamp(maximum_image_size / image->stride, 0, UINT16_MAX));
+	if (maximum_row <= 0) {
+		log_error("X server request size limit is too restrictive, or the "
+		          "image is too wide for us to send a single row of the image. "
+		          "Image size: %dx%d",
+		          image->width, image->height);
+		return false;
+	}
+
+	for (uint32_t row = 0; row < image->height; row += maximum_row) {
+		auto batch_height = maximum_row;
+		if (batch_height > image->height - row) {
+			batch_height = to_u16_checked(image->height - row);
+		}
+
+		uint32_t offset = row * image->stride / sizeof(*image->data);
+		xcb_put_image(c, (uint8_t)image->format, drawable, gc, image->width,
+		              batch_height, x, to_i16_checked(y + (int)row), 0,
+		              image->depth, image->stride * batch_height,
+		              image->data + offset);
+	}
+	if (pool) {
+		pool->put_image_bytes += image->size;
+	}
+	return true;
+}
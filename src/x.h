@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <xcb/render.h>
+#include <xcb/shm.h>
 #include <xcb/sync.h>
 #include <xcb/xcb.h>
 #include <xcb/xcb_renderutil.h>
@@ -290,4 +291,50 @@ x_get_pictfmt_for_standard(xcb_connection_t *c, xcb_pict_standard_t std);
 
 xcb_screen_t *x_screen_of_display(xcb_connection_t *c, int screen);
 
+struct xcb_image_t;
+
+/// Maximum number of shared memory segments kept around for uploading images
+#define X_SHM_POOL_SIZE 4
+
+/// A shared memory segment attached to the X server
+struct x_shm_segment {
+	xcb_shm_seg_t seg;
+	void *addr;
+	size_t size;
+	/// Whether the X server might still be reading from this segment
+	bool busy;
+	/// Cookie of a request sent right after the last upload from this segment. The
+	/// server is done with the segment once this request has a reply.
+	xcb_get_input_focus_cookie_t fence;
+};
+
+/// Create a shared memory segment of `size` bytes, and attach it to the X server. If
+/// `read_only` is false, the server can write to it too, e.g. for ShmGetImage.
+bool x_shm_segment_create(xcb_connection_t *c, struct x_shm_segment *seg, size_t size,
+                          bool read_only);
+/// Wait until the X server is done with `seg`
+void x_shm_segment_wait(xcb_connection_t *c, struct x_shm_segment *seg);
+void x_shm_segment_destroy(xcb_connection_t *c, struct x_shm_segment *seg);
+
+/// Uploads images to the X server, through MIT-SHM when it is available, otherwise
+/// through PutImage requests.
+struct x_shm_pool {
+	/// Whether MIT-SHM can be used
+	bool enabled;
+	int nsegments;
+	struct x_shm_segment segments[X_SHM_POOL_SIZE];
+
+	/// Bytes uploaded through shared memory and through PutImage, respectively
+	uint64_t shm_bytes, put_image_bytes;
+};
+
+/// Initialize `pool`. MIT-SHM is only used if the server supports it.
+void x_shm_pool_init(xcb_connection_t *c, struct x_shm_pool *pool);
+void x_shm_pool_deinit(xcb_connection_t *c, struct x_shm_pool *pool);
+
+/// Upload `image` to `drawable` at (`x`, `y`). Large images are split into multiple
+/// PutImage requests if MIT-SHM can't be used.
+bool x_put_image(xcb_connection_t *c, struct x_shm_pool *pool, xcb_drawable_t drawable,
+                 xcb_gcontext_t gc, struct xcb_image_t *image, int16_t x, int16_t y);
+
 uint32_t attr_deprecated xcb_generate_id(xcb_connection_t *c);